@@ -0,0 +1,154 @@
+/****************************************************************
+** Program Filename: arena.c
+** Author: Chelsea Egan
+** Description: Implements a bump allocator. Allocations are
+** carved sequentially out of large blocks, and all blocks are
+** freed together when the arena is cleaned up.
+****************************************************************/
+
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+
+/**
+* Initializes an empty arena. No memory is allocated until the first
+* arenaAlloc.
+* @param arena
+*/
+void arenaInit(Arena* arena)
+{
+     arena->head = 0;
+     arena->bytesUsed = 0;
+     arena->bytesReserved = 0;
+}
+
+/**
+* Frees every block in the arena. All pointers handed out by the arena become
+* invalid.
+* @param arena
+*/
+void arenaCleanUp(Arena* arena)
+{
+     assert(arena != 0);
+
+     ArenaBlock* block = arena->head;
+     while (block != 0) {
+          ArenaBlock* next = block->next;
+          free(block);
+          block = next;
+     }
+     arenaInit(arena);
+}
+
+/**
+* Allocates a new block able to hold at least the given number of bytes. The
+* block becomes the head of the arena, except that a large block is kept
+* behind the current head so that the head's free space is not abandoned.
+* @param arena
+* @param size
+* @return The new block.
+*/
+static ArenaBlock* arenaGrow(Arena* arena, size_t size)
+{
+     size_t capacity = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+     ArenaBlock* block = malloc(sizeof(ArenaBlock) + capacity);
+     assert(block != 0);
+     block->used = 0;
+     block->capacity = capacity;
+     if (arena->head != 0 && size > ARENA_BLOCK_SIZE / 4) {
+          block->next = arena->head->next;
+          arena->head->next = block;
+     }
+     else {
+          block->next = arena->head;
+          arena->head = block;
+     }
+     arena->bytesReserved += sizeof(ArenaBlock) + capacity;
+     return block;
+}
+
+/**
+* Returns the offset of the next free byte in the block with the given
+* alignment.
+* @param block
+* @param alignment
+* @return Offset into the block's data.
+*/
+static size_t alignedOffset(ArenaBlock* block, size_t alignment)
+{
+     uintptr_t next = (uintptr_t)(block->data + block->used);
+     uintptr_t aligned = (next + alignment - 1) & ~(uintptr_t)(alignment - 1);
+     return block->used + (size_t)(aligned - next);
+}
+
+/**
+* Allocates memory from the arena. The memory lives until arenaCleanUp.
+* @param arena
+* @param size Number of bytes.
+* @param alignment Required alignment, a power of two.
+* @return Pointer to the memory.
+*/
+void* arenaAlloc(Arena* arena, size_t size, size_t alignment)
+{
+     assert(arena != 0);
+     assert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+     ArenaBlock* block = arena->head;
+     if (block == 0 || alignedOffset(block, alignment) + size > block->capacity) {
+          block = arenaGrow(arena, size + alignment - 1);
+     }
+
+     size_t offset = alignedOffset(block, alignment);
+     char* memory = block->data + offset;
+     block->used = offset + size;
+     arena->bytesUsed += size;
+     return memory;
+}
+
+/**
+* Copies a string of the given length into the arena and null terminates it.
+* @param arena
+* @param string
+* @param length Number of characters to copy.
+* @return The copy.
+*/
+char* arenaCopyString(Arena* arena, const char* string, int length)
+{
+     char* copy = arenaAlloc(arena, length + 1, 1);
+     memcpy(copy, string, length);
+     copy[length] = '\0';
+     return copy;
+}
+
+/**
+* Moves every block of one arena into another, so that memory handed out by
+* both is freed together. The blocks go behind the head of into, which keeps
+* allocating from its own head. This lets threads fill arenas of their own
+* and hand the result to a single owner.
+* @param into
+* @param from Left empty.
+*/
+void arenaAppend(Arena* into, Arena* from)
+{
+     assert(into != 0 && from != 0);
+
+     if (from->head == 0) {
+          return;
+     }
+     ArenaBlock* tail = from->head;
+     while (tail->next != 0) {
+          tail = tail->next;
+     }
+     if (into->head == 0) {
+          into->head = from->head;
+     }
+     else {
+          tail->next = into->head->next;
+          into->head->next = from->head;
+     }
+     into->bytesUsed += from->bytesUsed;
+     into->bytesReserved += from->bytesReserved;
+     arenaInit(from);
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+* A bump allocator. Memory is handed out from large blocks and is only
+* released all at once by arenaCleanUp, so allocations are cheap, packed
+* together and never move.
+*/
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct Arena Arena;
+typedef struct ArenaBlock ArenaBlock;
+
+struct ArenaBlock
+{
+     ArenaBlock* next;
+     // Bytes handed out from this block.
+     size_t used;
+     // Bytes available in data.
+     size_t capacity;
+     char data[];
+};
+
+struct Arena
+{
+     // Block currently being allocated from. Older blocks follow it.
+     ArenaBlock* head;
+     // Bytes handed out over the arena's lifetime.
+     size_t bytesUsed;
+     // Bytes obtained from malloc for blocks.
+     size_t bytesReserved;
+};
+
+void arenaInit(Arena* arena);
+void arenaCleanUp(Arena* arena);
+void* arenaAlloc(Arena* arena, size_t size, size_t alignment);
+char* arenaCopyString(Arena* arena, const char* string, int length);
+void arenaAppend(Arena* into, Arena* from);
+
+#endif
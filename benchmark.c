@@ -0,0 +1,660 @@
+/****************************************************************
+** Program Filename: benchmark.c
+** Author: Chelsea Egan
+** Description: Measures the spell checker: how long the
+** dictionary takes to load, how fast words in and out of the
+** dictionary are looked up, how long each suggestion engine
+** takes per misspelled word, how lookups in a shared concurrent
+** map scale with the number of reader threads, alone and with a
+** writer changing the map, and how fast text is split into
+** words. The misspelled words are made from
+** dictionary words by random edits from a fixed seed, so runs
+** with the same options measure the same work. The results are
+** printed as one JSON object, to be compared between versions.
+****************************************************************/
+
+#include "hashMap.h"
+#include "suggest.h"
+#include "dictionary.h"
+#include "threadPool.h"
+#include "concurrentMap.h"
+#include "tokenizer.h"
+#include "fileMap.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Longest dictionary word that is turned into misspellings */
+#define BENCHMARK_MAX_WORD 64
+
+typedef struct BenchmarkOptions
+{
+     const char* dictionaryPath;
+     HashFunction hashFunction;
+     unsigned long long seed;
+     // Misspelled words to make, each timed with every engine.
+     int misspellings;
+     // Lookups timed for words in the dictionary, and again for words not in it.
+     int lookups;
+     // Times the dictionary is loaded; the fastest load is reported.
+     int loadRuns;
+     int threads;
+     // False positive rate of the map's filter, or 0 for none.
+     double bloomRate;
+     // Engines to time, or every engine if none were named.
+     SuggestEngine engines[16];
+     int engineCount;
+} BenchmarkOptions;
+
+/**
+* Returns the time in seconds from a fixed point.
+* @return Seconds.
+*/
+static double wallSeconds(void)
+{
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+* Returns the next number of a splitmix64 sequence. Unlike rand() it gives
+* the same numbers on every platform.
+* @param state
+* @return A random 64-bit number.
+*/
+static unsigned long long nextRandom(unsigned long long* state)
+{
+     unsigned long long z = (*state += 0x9e3779b97f4a7c15ull);
+     z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+     z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+     return z ^ (z >> 31);
+}
+
+/**
+* Returns a random number from 0 to n - 1.
+* @param state
+* @param n
+* @return The number.
+*/
+static int randomBelow(unsigned long long* state, int n)
+{
+     return (int)(nextRandom(state) % (unsigned long long)n);
+}
+
+/**
+* Compares two strings through pointers to them, for qsort.
+*/
+static int compareWords(const void* a, const void* b)
+{
+     return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+* Compares two doubles, for qsort.
+*/
+static int compareDoubles(const void* a, const void* b)
+{
+     double x = *(const double*)a;
+     double y = *(const double*)b;
+     return (x > y) - (x < y);
+}
+
+/**
+* Returns the map's words in strcmp order, so that anything drawn from them
+* does not depend on the hash function.
+* @param map
+* @return The words, to be freed by the caller.
+*/
+static const char** sortedWords(HashMap* map)
+{
+     const char** words = malloc(sizeof(const char*) * (hashMapSize(map) + 1));
+     int count = 0;
+     for (int i = 0; i < hashMapCapacity(map); i++) {
+          const char* key = hashMapKeyAt(map, i);
+          if (key != 0) {
+               words[count++] = key;
+          }
+     }
+     qsort(words, count, sizeof(const char*), compareWords);
+     return words;
+}
+
+/**
+* Applies one random edit to a word in place: inserts a letter, deletes one,
+* substitutes one or swaps two neighbouring letters.
+* @param word Buffer with room for one more letter.
+* @param length Length of the word.
+* @param state Random state.
+* @return Length of the word afterwards.
+*/
+static int randomEdit(char* word, int length, unsigned long long* state)
+{
+     int kind = length < 2 ? 0 : randomBelow(state, 4);
+     char letter = (char)('a' + randomBelow(state, 26));
+
+     if (kind == 0) {
+          int position = randomBelow(state, length + 1);
+          memmove(word + position + 1, word + position, length - position + 1);
+          word[position] = letter;
+          return length + 1;
+     }
+     if (kind == 1) {
+          int position = randomBelow(state, length);
+          memmove(word + position, word + position + 1, length - position);
+          return length - 1;
+     }
+     if (kind == 2) {
+          word[randomBelow(state, length)] = letter;
+          return length;
+     }
+     int position = randomBelow(state, length - 1);
+     char swap = word[position];
+     word[position] = word[position + 1];
+     word[position + 1] = swap;
+     return length;
+}
+
+/**
+* Makes misspelled words from random dictionary words, with one edit three
+* times out of four and two edits otherwise. Edits that give a dictionary
+* word, or nothing, are thrown away.
+* @param map
+* @param words The map's words in strcmp order.
+* @param count Number of misspellings to make.
+* @param seed
+* @return The misspellings, each allocated, to be freed by the caller.
+*/
+static char** makeMisspellings(HashMap* map, const char** words, int count,
+     unsigned long long seed)
+{
+     char** misspellings = malloc(sizeof(char*) * (count + 1));
+     unsigned long long state = seed;
+     char word[BENCHMARK_MAX_WORD + 3];
+     int made = 0;
+
+     while (made < count) {
+          const char* source = words[randomBelow(&state, hashMapSize(map))];
+          int length = (int)strlen(source);
+          if (length > BENCHMARK_MAX_WORD) {
+               continue;
+          }
+          memcpy(word, source, length + 1);
+          int edits = randomBelow(&state, 4) == 0 ? 2 : 1;
+          for (int i = 0; i < edits; i++) {
+               length = randomEdit(word, length, &state);
+          }
+          if (length > 0 && !hashMapContainsKey(map, word)) {
+               misspellings[made++] = strdup(word);
+          }
+     }
+     return misspellings;
+}
+
+/**
+* Returns the value below which the given fraction of the sorted samples
+* lie, by the nearest rank.
+* @param samples Sorted samples.
+* @param count Number of samples, at least 1.
+* @param fraction From 0 to 1.
+* @return The percentile.
+*/
+static double percentile(const double* samples, int count, double fraction)
+{
+     int rank = (int)(fraction * count + 0.999999);
+     if (rank < 1) {
+          rank = 1;
+     }
+     return samples[(rank < count ? rank : count) - 1];
+}
+
+/**
+* Times lookups of the given words, cycling through them.
+* @param map
+* @param words
+* @param count Number of distinct words.
+* @param lookups Number of lookups to time.
+* @param found Set to how many lookups found their word.
+* @return Nanoseconds per lookup.
+*/
+static double timeLookups(HashMap* map, const char* const* words, int count, int lookups,
+     int* found)
+{
+     int hits = 0;
+     double seconds = wallSeconds();
+     for (int i = 0; i < lookups; i++) {
+          hits += hashMapContainsKey(map, words[i % count]);
+     }
+     seconds = wallSeconds() - seconds;
+     *found = hits;
+     return lookups > 0 ? seconds * 1e9 / lookups : 0.0;
+}
+
+/**
+* Times splitting the given text into words, over and over until a quarter
+* of a second has passed.
+* @param data
+* @param length
+* @param fold 1 to fold the words to lower case as well.
+* @return Megabytes split per second.
+*/
+static double timeTokenize(const char* data, size_t length, int fold)
+{
+     long long bytes = 0;
+     long long words = 0;
+     double seconds = wallSeconds();
+     double elapsed;
+     do {
+          Tokenizer tokenizer;
+          Token token;
+          tokenizerInitMemory(&tokenizer, data, length);
+          tokenizerSetFold(&tokenizer, fold);
+          while (tokenizerNext(&tokenizer, &token)) {
+               words += token.length;
+          }
+          tokenizerCleanUp(&tokenizer);
+          bytes += (long long)length;
+          elapsed = wallSeconds() - seconds;
+     } while (elapsed < 0.25 && length > 0);
+     /* Keep the words counted so the loop is not optimized away */
+     if (words < 0) {
+          fprintf(stderr, "%lld\n", words);
+     }
+     return elapsed > 0 ? bytes / elapsed / 1e6 : 0.0;
+}
+
+/* One reader thread of timeSharedLookups */
+typedef struct SharedReader
+{
+     pthread_t thread;
+     ConcurrentMap* concurrent;
+     const char* const* words;
+     int count;
+     int lookups;
+     // Word to start at, so readers do not walk the words in step.
+     int first;
+     int found;
+} SharedReader;
+
+/* The writer thread of timeSharedLookups */
+typedef struct SharedWriter
+{
+     pthread_t thread;
+     ConcurrentMap* concurrent;
+     // Map whose copies are swapped in; only read.
+     HashMap* source;
+     // Set once the readers are done.
+     int stop;
+     int writes;
+} SharedWriter;
+
+/**
+* Looks up the reader's share of words in the concurrent map.
+* @param argument The SharedReader.
+* @return NULL.
+*/
+static void* sharedReaderRun(void* argument)
+{
+     SharedReader* reader = argument;
+     int hits = 0;
+     for (int i = 0; i < reader->lookups; i++) {
+          const char* word = reader->words[(reader->first + i) % reader->count];
+          hits += concurrentMapContainsKey(reader->concurrent, word);
+     }
+     reader->found = hits;
+     return NULL;
+}
+
+/**
+* Changes the concurrent map until told to stop, alternately putting a key
+* that is not a word and swapping in a fresh copy of the source map, so
+* readers keep finding every word of the source.
+* @param argument The SharedWriter.
+* @return NULL.
+*/
+static void* sharedWriterRun(void* argument)
+{
+     SharedWriter* writer = argument;
+     char key[32];
+     while (!__atomic_load_n(&writer->stop, __ATOMIC_ACQUIRE)) {
+          if (writer->writes % 2 == 0) {
+               snprintf(key, sizeof(key), "0written%d", writer->writes);
+               concurrentMapPut(writer->concurrent, key, 1);
+          }
+          else {
+               concurrentMapSwap(writer->concurrent, hashMapClone(writer->source));
+          }
+          writer->writes++;
+     }
+     return NULL;
+}
+
+/**
+* Times the given number of threads each looking up the given number of
+* words in a concurrent map at the same time, optionally while a writer
+* changes the map.
+* @param concurrent
+* @param words
+* @param count Number of distinct words.
+* @param lookups Lookups per thread.
+* @param readers Number of threads.
+* @param writer Writer to run alongside the readers, or NULL.
+* @param found Set to the number of lookups that found their word.
+* @return Lookups per second, over all threads.
+*/
+static double timeSharedLookups(ConcurrentMap* concurrent, const char* const* words, int count,
+     int lookups, int readers, SharedWriter* writer, long long* found)
+{
+     SharedReader* threads = malloc(sizeof(SharedReader) * readers);
+     if (writer != NULL) {
+          writer->concurrent = concurrent;
+          writer->stop = 0;
+          writer->writes = 0;
+          pthread_create(&writer->thread, NULL, sharedWriterRun, writer);
+     }
+     double seconds = wallSeconds();
+     for (int i = 0; i < readers; i++) {
+          threads[i].concurrent = concurrent;
+          threads[i].words = words;
+          threads[i].count = count;
+          threads[i].lookups = lookups;
+          threads[i].first = (int)((long long)count * i / readers);
+          pthread_create(&threads[i].thread, NULL, sharedReaderRun, &threads[i]);
+     }
+     *found = 0;
+     for (int i = 0; i < readers; i++) {
+          pthread_join(threads[i].thread, NULL);
+          *found += threads[i].found;
+     }
+     seconds = wallSeconds() - seconds;
+     if (writer != NULL) {
+          __atomic_store_n(&writer->stop, 1, __ATOMIC_RELEASE);
+          pthread_join(writer->thread, NULL);
+     }
+     free(threads);
+     return seconds > 0 ? (double)lookups * readers / seconds : 0.0;
+}
+
+/**
+* Builds a suggester with the given engine, times every misspelling, and
+* prints the engine's results as a JSON object.
+* @param map
+* @param options
+* @param engine
+* @param pool
+* @param misspellings
+* @param out
+*/
+static void benchmarkEngine(HashMap* map, const BenchmarkOptions* options, SuggestEngine engine,
+     ThreadPool* pool, char** misspellings, FILE* out)
+{
+     SuggestOptions suggestOptions;
+     suggestOptionsInit(&suggestOptions);
+     suggestOptions.engine = engine;
+     suggestOptions.threads = options->threads;
+     suggestOptions.pool = pool;
+
+     double buildSeconds = wallSeconds();
+     Suggester* suggester = suggesterNew(map, &suggestOptions);
+     buildSeconds = wallSeconds() - buildSeconds;
+
+     double* micros = malloc(sizeof(double) * (options->misspellings + 1));
+     double total = 0;
+     long long suggestions = 0;
+     for (int i = 0; i < options->misspellings; i++) {
+          Suggestion found[SUGGESTION_COUNT];
+          double seconds = wallSeconds();
+          suggestions += suggesterFind(suggester, misspellings[i], found, SUGGESTION_COUNT);
+          micros[i] = (wallSeconds() - seconds) * 1e6;
+          total += micros[i];
+     }
+     qsort(micros, options->misspellings, sizeof(double), compareDoubles);
+
+     int count = options->misspellings;
+     fprintf(out, "    {\"engine\": \"%s\", \"buildSeconds\": %.6f, \"queries\": %d, "
+          "\"suggestions\": %lld, \"meanMicros\": %.2f, \"p50Micros\": %.2f, "
+          "\"p99Micros\": %.2f, \"maxMicros\": %.2f}",
+          suggestEngineName(engine), buildSeconds, count, suggestions,
+          count > 0 ? total / count : 0.0,
+          count > 0 ? percentile(micros, count, 0.50) : 0.0,
+          count > 0 ? percentile(micros, count, 0.99) : 0.0,
+          count > 0 ? micros[count - 1] : 0.0);
+
+     free(micros);
+     suggesterDelete(suggester);
+}
+
+/**
+* Runs the benchmark. Options:
+*   --dictionary=PATH  word list to load (default dictionary.txt)
+*   --hash=NAME        hash function for the dictionary (default
+*                      HASH_FUNCTION)
+*   --seed=N           seed of the misspellings (default 1)
+*   --misspellings=N   misspellings to time each engine with (default 1000)
+*   --lookups=N        lookups to time, of words in the dictionary and of
+*                      words not in it (default 1000000 each)
+*   --load-runs=N      times to load the dictionary (default 3)
+*   --threads=N        threads for loading and the parallel engine, and the
+*                      most readers of the shared map (default: one per
+*                      processor)
+*   --bloom=RATE       look words up through a Bloom filter with false
+*                      positive rate RATE
+*   --engine=NAME      time this engine; repeat for more (default: all)
+* @param argc
+* @param argv
+* @return 0 on success, 1 on a bad option or a missing dictionary.
+*/
+int main(int argc, const char** argv)
+{
+     BenchmarkOptions options;
+     options.dictionaryPath = "dictionary.txt";
+     options.hashFunction = HASH_FUNCTION;
+     options.seed = 1;
+     options.misspellings = 1000;
+     options.lookups = 1000000;
+     options.loadRuns = 3;
+     options.threads = 0;
+     options.bloomRate = 0;
+     options.engineCount = 0;
+
+     for (int i = 1; i < argc; i++) {
+          if (strncmp(argv[i], "--dictionary=", 13) == 0) {
+               options.dictionaryPath = argv[i] + 13;
+          }
+          else if (strncmp(argv[i], "--hash=", 7) == 0) {
+               options.hashFunction = hashFunctionByName(argv[i] + 7);
+               if (options.hashFunction == NULL) {
+                    fprintf(stderr, "Unknown hash function %s. Choose one of: ", argv[i] + 7);
+                    hashFunctionPrintNames(stderr);
+                    return 1;
+               }
+          }
+          else if (strncmp(argv[i], "--seed=", 7) == 0) {
+               options.seed = strtoull(argv[i] + 7, NULL, 10);
+          }
+          else if (strncmp(argv[i], "--misspellings=", 15) == 0) {
+               options.misspellings = atoi(argv[i] + 15);
+          }
+          else if (strncmp(argv[i], "--lookups=", 10) == 0) {
+               options.lookups = atoi(argv[i] + 10);
+          }
+          else if (strncmp(argv[i], "--load-runs=", 12) == 0) {
+               options.loadRuns = atoi(argv[i] + 12);
+          }
+          else if (strncmp(argv[i], "--threads=", 10) == 0) {
+               options.threads = atoi(argv[i] + 10);
+          }
+          else if (strncmp(argv[i], "--bloom=", 8) == 0) {
+               options.bloomRate = atof(argv[i] + 8);
+               if (options.bloomRate <= 0 || options.bloomRate >= 1) {
+                    fprintf(stderr, "The Bloom filter's false positive rate must be between 0 and 1\n");
+                    return 1;
+               }
+          }
+          else if (strncmp(argv[i], "--engine=", 9) == 0) {
+               int known = options.engineCount < (int)(sizeof(options.engines) / sizeof(options.engines[0])) &&
+                    suggestEngineByName(argv[i] + 9, &options.engines[options.engineCount]);
+               if (!known) {
+                    fprintf(stderr, "Unknown engine %s. Choose one of: ", argv[i] + 9);
+                    suggestEnginePrintNames(stderr);
+                    return 1;
+               }
+               options.engineCount++;
+          }
+          else {
+               fprintf(stderr, "Unknown option %s\n", argv[i]);
+               return 1;
+          }
+     }
+     if (options.misspellings < 1 || options.lookups < 1 || options.loadRuns < 1) {
+          fprintf(stderr, "--misspellings, --lookups and --load-runs must be at least 1\n");
+          return 1;
+     }
+     if (options.engineCount == 0) {
+          for (int i = 0; suggestEngineByIndex(i, &options.engines[i]); i++) {
+               options.engineCount++;
+          }
+     }
+
+     ThreadPool* pool = options.threads != 1 ? threadPoolNew(options.threads) : NULL;
+
+     /* Load the dictionary, keeping the last map */
+     HashMap* map = NULL;
+     double bestLoad = 0;
+     int wordsRead = 0;
+     for (int run = 0; run < options.loadRuns; run++) {
+          if (map != NULL) {
+               hashMapDelete(map);
+          }
+          map = hashMapNewWithHash(1000, options.hashFunction);
+          double seconds = wallSeconds();
+          wordsRead = loadDictionary(options.dictionaryPath, map, pool);
+          seconds = wallSeconds() - seconds;
+          if (wordsRead < 0) {
+               fprintf(stderr, "Cannot open %s\n", options.dictionaryPath);
+               hashMapDelete(map);
+               if (pool != NULL) {
+                    threadPoolDelete(pool);
+               }
+               return 1;
+          }
+          if (run == 0 || seconds < bestLoad) {
+               bestLoad = seconds;
+          }
+     }
+     if (hashMapSize(map) == 0) {
+          fprintf(stderr, "No words in %s\n", options.dictionaryPath);
+          hashMapDelete(map);
+          if (pool != NULL) {
+               threadPoolDelete(pool);
+          }
+          return 1;
+     }
+     if (options.bloomRate > 0) {
+          hashMapSetFilter(map, options.bloomRate);
+     }
+
+     /* Look words up in a random order, so the table is not walked in sequence,
+        and look up as many distinct misses as there are words */
+     const char** words = sortedWords(map);
+     char** misspellings = makeMisspellings(map, words, options.misspellings, options.seed);
+     int missCount = hashMapSize(map);
+     char** misses = makeMisspellings(map, words, missCount, options.seed + 1);
+     const char** shuffled = malloc(sizeof(const char*) * hashMapSize(map));
+     memcpy(shuffled, words, sizeof(const char*) * hashMapSize(map));
+     unsigned long long state = options.seed;
+     for (int i = hashMapSize(map) - 1; i > 0; i--) {
+          int j = randomBelow(&state, i + 1);
+          const char* swap = shuffled[i];
+          shuffled[i] = shuffled[j];
+          shuffled[j] = swap;
+     }
+     int hitsFound;
+     int missesFound;
+     double hitNanos = timeLookups(map, shuffled, hashMapSize(map), options.lookups, &hitsFound);
+     double missNanos = timeLookups(map, (const char* const*)misses, missCount, options.lookups,
+          &missesFound);
+
+     printf("{\n");
+     printf("  \"dictionary\": \"%s\",\n", options.dictionaryPath);
+     printf("  \"words\": %d,\n", hashMapSize(map));
+     printf("  \"hash\": \"%s\",\n", hashFunctionName(options.hashFunction));
+     printf("  \"seed\": %llu,\n", options.seed);
+     printf("  \"threads\": %d,\n", pool != NULL ? threadPoolSize(pool) : 1);
+     printf("  \"bloom\": %g,\n", options.bloomRate);
+     printf("  \"load\": {\"runs\": %d, \"seconds\": %.6f, \"wordsPerSecond\": %.0f},\n",
+          options.loadRuns, bestLoad, bestLoad > 0 ? wordsRead / bestLoad : 0.0);
+     FileMap text;
+     if (fileMapOpen(&text, options.dictionaryPath) == 0) {
+          printf("  \"tokenize\": {\"kernel\": \"%s\", \"megabytesPerSecond\": %.1f, "
+               "\"foldedMegabytesPerSecond\": %.1f},\n", tokenizerKernelName(),
+               timeTokenize(text.data, text.length, 0), timeTokenize(text.data, text.length, 1));
+          fileMapClose(&text);
+     }
+     printf("  \"lookups\": {\n");
+     printf("    \"hits\": {\"count\": %d, \"found\": %d, \"nanosPerLookup\": %.2f},\n",
+          options.lookups, hitsFound, hitNanos);
+     printf("    \"misses\": {\"count\": %d, \"found\": %d, \"nanosPerLookup\": %.2f}\n",
+          options.lookups, missesFound, missNanos);
+     printf("  },\n");
+
+     /* Readers of a shared copy of the map, doubling up to the thread count */
+     ConcurrentMap* concurrent = concurrentMapNew(hashMapClone(map));
+     int maxReaders = pool != NULL ? threadPoolSize(pool) : 1;
+     printf("  \"sharedLookups\": [\n");
+     int readers = 1;
+     long long sharedFound;
+     while (1) {
+          double rate = timeSharedLookups(concurrent, shuffled, hashMapSize(map), options.lookups, readers,
+               NULL, &sharedFound);
+          printf("    {\"readers\": %d, \"lookupsPerSecond\": %.0f}%s\n", readers, rate,
+               readers < maxReaders ? "," : "");
+          if (readers == maxReaders) {
+               break;
+          }
+          readers = readers * 2 < maxReaders ? readers * 2 : maxReaders;
+     }
+     printf("  ],\n");
+
+     /* The same readers while a writer publishes maps under them; every
+        lookup must still find its word */
+     SharedWriter writer;
+     writer.source = map;
+     double writtenRate = timeSharedLookups(concurrent, shuffled, hashMapSize(map), options.lookups,
+          maxReaders, &writer, &sharedFound);
+     printf("  \"sharedLookupsWithWriter\": {\"readers\": %d, \"lookupsPerSecond\": %.0f, "
+          "\"found\": %lld, \"lookups\": %lld, \"writes\": %d},\n", maxReaders, writtenRate, sharedFound,
+          (long long)options.lookups * maxReaders, writer.writes);
+     if (sharedFound != (long long)options.lookups * maxReaders) {
+          fprintf(stderr, "Readers missed %lld words while the map was written\n",
+               (long long)options.lookups * maxReaders - sharedFound);
+     }
+     concurrentMapDelete(concurrent);
+
+     printf("  \"suggestions\": [\n");
+     for (int i = 0; i < options.engineCount; i++) {
+          benchmarkEngine(map, &options, options.engines[i], pool, misspellings, stdout);
+          printf("%s\n", i + 1 < options.engineCount ? "," : "");
+          fflush(stdout);
+     }
+     printf("  ]\n");
+     printf("}\n");
+
+     for (int i = 0; i < options.misspellings; i++) {
+          free(misspellings[i]);
+     }
+     free(misspellings);
+     for (int i = 0; i < missCount; i++) {
+          free(misses[i]);
+     }
+     free(misses);
+     free(shuffled);
+     free(words);
+     hashMapDelete(map);
+     if (pool != NULL) {
+          threadPoolDelete(pool);
+     }
+     return 0;
+}
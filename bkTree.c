@@ -0,0 +1,257 @@
+/****************************************************************
+** Program Filename: bkTree.c
+** Author: Chelsea Egan
+** Description: Implements a BK-tree over Levenshtein distance.
+** Nodes are kept in one growing array and linked to their
+** children by index. Queries walk the tree with an explicit
+** stack and skip every subtree that the triangle inequality
+** rules out.
+****************************************************************/
+
+#include "bkTree.h"
+#include "editDistance.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+/**
+* Creates an empty BK-tree.
+* @return The allocated tree.
+*/
+BkTree* bkTreeNew(void)
+{
+     BkTree* tree = malloc(sizeof(BkTree));
+     tree->capacity = 1024;
+     tree->size = 0;
+     tree->nodes = malloc(sizeof(BkNode) * tree->capacity);
+     return tree;
+}
+
+/**
+* Creates a BK-tree holding every key of the map. The tree points at the map's
+* keys, so the map must outlive it. Keys are inserted in slot order, which is
+* effectively random and keeps the tree shallow.
+* @param map
+* @return The allocated tree.
+*/
+BkTree* bkTreeBuild(HashMap* map)
+{
+     BkTree* tree = bkTreeNew();
+     for (int i = 0; i < hashMapCapacity(map); i++) {
+          const char* key = hashMapKeyAt(map, i);
+          if (key != 0) {
+               bkTreeAdd(tree, key);
+          }
+     }
+     return tree;
+}
+
+/**
+* Frees the tree. The words are not freed.
+* @param tree
+*/
+void bkTreeDelete(BkTree* tree)
+{
+     free(tree->nodes);
+     free(tree);
+}
+
+/**
+* Appends a node to the tree's node array.
+* @param tree
+* @param word
+* @param distance Distance to the parent.
+* @return Index of the new node.
+*/
+static int addNode(BkTree* tree, const char* word, int distance)
+{
+     if (tree->size == tree->capacity) {
+          tree->capacity *= 2;
+          tree->nodes = realloc(tree->nodes, sizeof(BkNode) * tree->capacity);
+     }
+     BkNode* node = &tree->nodes[tree->size];
+     node->word = word;
+     node->distance = distance;
+     node->maxChildDistance = 0;
+     node->firstChild = -1;
+     node->nextSibling = -1;
+     return tree->size++;
+}
+
+/**
+* Adds a word to the tree. The tree keeps the pointer, not a copy. Adding a
+* word that is already in the tree does nothing.
+* @param tree
+* @param word
+*/
+void bkTreeAdd(BkTree* tree, const char* word)
+{
+     assert(tree != 0);
+
+     if (tree->size == 0) {
+          addNode(tree, word, 0);
+          return;
+     }
+
+     int current = 0;
+     while (1) {
+          int distance = levenshtein(word, tree->nodes[current].word);
+          if (distance == 0) {
+               return;
+          }
+
+          /* Follow the child at the same distance, if there is one */
+          int child = tree->nodes[current].firstChild;
+          while (child >= 0 && tree->nodes[child].distance != distance) {
+               child = tree->nodes[child].nextSibling;
+          }
+          if (child < 0) {
+               int node = addNode(tree, word, distance);
+               tree->nodes[node].nextSibling = tree->nodes[current].firstChild;
+               tree->nodes[current].firstChild = node;
+               if (distance > tree->nodes[current].maxChildDistance) {
+                    tree->nodes[current].maxChildDistance = distance;
+               }
+               return;
+          }
+          current = child;
+     }
+}
+
+/*
+* Stack of node indices still to visit during a query.
+*/
+typedef struct
+{
+     int* nodes;
+     int size;
+     int capacity;
+} NodeStack;
+
+static void stackPush(NodeStack* stack, int node)
+{
+     if (stack->size == stack->capacity) {
+          stack->capacity *= 2;
+          stack->nodes = realloc(stack->nodes, sizeof(int) * stack->capacity);
+     }
+     stack->nodes[stack->size++] = node;
+}
+
+/**
+* Pushes the children of a node that can hold words within the radius of the
+* query, given the query's distance to the node.
+* @param tree
+* @param stack
+* @param node
+* @param distance Distance between the query and the node.
+* @param radius
+*/
+static void pushChildren(BkTree* tree, NodeStack* stack, int node, int distance, int radius)
+{
+     for (int child = tree->nodes[node].firstChild; child >= 0;
+          child = tree->nodes[child].nextSibling) {
+          int edge = tree->nodes[child].distance;
+          /* Triangle inequality: |edge - distance| <= radius */
+          if (edge >= distance - radius && edge <= distance + radius) {
+               stackPush(stack, child);
+          }
+     }
+}
+
+/**
+* Returns the distance between the query and a node when it matters: a node
+* further than radius + its largest child label from the query is not a match
+* and none of its subtrees can hold one, so the exact distance is not needed.
+* @param tree
+* @param pattern Preprocessed query.
+* @param node
+* @param radius
+* @return The distance, or a larger number that prunes the same subtrees.
+*/
+static int nodeDistance(BkTree* tree, const EditPattern* pattern, int node, int radius)
+{
+     const char* word = tree->nodes[node].word;
+     return editPatternDistance(pattern, word, (int)strlen(word),
+          radius + tree->nodes[node].maxChildDistance);
+}
+
+/**
+* Calls visit for every word within maxDistance of the query.
+* @param tree
+* @param query
+* @param maxDistance
+* @param visit
+* @param context Passed through to visit.
+* @return Number of words visited.
+*/
+int bkTreeWithin(BkTree* tree, const char* query, int maxDistance, BkTreeVisit visit,
+     void* context)
+{
+     assert(tree != 0);
+     if (tree->size == 0) {
+          return 0;
+     }
+
+     NodeStack stack = { malloc(sizeof(int) * 64), 0, 64 };
+     EditPattern pattern;
+     editPatternInit(&pattern, query, (int)strlen(query));
+     int found = 0;
+
+     stackPush(&stack, 0);
+     while (stack.size > 0) {
+          int node = stack.nodes[--stack.size];
+          int distance = nodeDistance(tree, &pattern, node, maxDistance);
+          if (distance <= maxDistance) {
+               visit(tree->nodes[node].word, distance, context);
+               found++;
+          }
+          pushChildren(tree, &stack, node, distance, maxDistance);
+     }
+
+     free(stack.nodes);
+     return found;
+}
+
+/**
+* Finds the words nearest to the query. The search radius starts unbounded
+* and shrinks to the distance of the worst word kept as soon as count words
+* have been found.
+* @param tree
+* @param query
+* @param minDistance Words closer than this are ignored; pass 1 to leave out
+* the query itself.
+* @param nearest Filled with the words found, nearest first.
+* @param count Number of words wanted.
+* @return Number of words found, at most count.
+*/
+int bkTreeNearest(BkTree* tree, const char* query, int minDistance, Suggestion* nearest,
+     int count)
+{
+     assert(tree != 0);
+     if (tree->size == 0 || count <= 0) {
+          return 0;
+     }
+
+     NodeStack stack = { malloc(sizeof(int) * 64), 0, 64 };
+     EditPattern pattern;
+     editPatternInit(&pattern, query, (int)strlen(query));
+     int found = 0;
+     int radius = INT_MAX / 2;
+
+     stackPush(&stack, 0);
+     while (stack.size > 0) {
+          int node = stack.nodes[--stack.size];
+          int distance = nodeDistance(tree, &pattern, node, radius);
+          if (distance >= minDistance && distance <= radius) {
+               found = suggestionInsert(nearest, found, count, tree->nodes[node].word, distance);
+          }
+          if (found == count) {
+               radius = nearest[count - 1].distance;
+          }
+          pushChildren(tree, &stack, node, distance, radius);
+     }
+
+     free(stack.nodes);
+     return found;
+}
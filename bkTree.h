@@ -0,0 +1,49 @@
+#ifndef BK_TREE_H
+#define BK_TREE_H
+
+#include "suggest.h"
+
+/*
+* A BK-tree is a metric tree over edit distance. Every child of a node is
+* labelled with its distance to the node, and by the triangle inequality a
+* query within distance r of a node at distance d from it can only match in
+* the subtrees labelled d - r to d + r.
+*/
+
+typedef struct BkNode BkNode;
+
+struct BkNode
+{
+     // Word of the node, owned by the caller (for example a map's arena).
+     const char* word;
+     // Edit distance between this node and its parent.
+     int distance;
+     // Largest distance label among the node's children.
+     int maxChildDistance;
+     // Index of the first child, or -1.
+     int firstChild;
+     // Index of the next child of the same parent, or -1.
+     int nextSibling;
+};
+
+struct BkTree
+{
+     // Nodes in insertion order. Node 0 is the root.
+     BkNode* nodes;
+     int size;
+     int capacity;
+};
+
+/* Called for each word found by bkTreeWithin */
+typedef void (*BkTreeVisit)(const char* word, int distance, void* context);
+
+BkTree* bkTreeNew(void);
+BkTree* bkTreeBuild(HashMap* map);
+void bkTreeDelete(BkTree* tree);
+void bkTreeAdd(BkTree* tree, const char* word);
+int bkTreeWithin(BkTree* tree, const char* query, int maxDistance, BkTreeVisit visit,
+     void* context);
+int bkTreeNearest(BkTree* tree, const char* query, int minDistance, Suggestion* nearest,
+     int count);
+
+#endif
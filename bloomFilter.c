@@ -0,0 +1,174 @@
+/****************************************************************
+** Program Filename: bloomFilter.c
+** Author: Chelsea Egan
+** Description: Implements a split block Bloom filter over 64-bit
+** key hashes. The high half of the hash picks the block and the
+** low half, multiplied by a different odd constant for each
+** word of the block, picks one bit per word. The filter is sized
+** from the number of keys and the wanted false positive rate.
+****************************************************************/
+
+#include "bloomFilter.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+/* Source: the split block Bloom filter of Apache Parquet */
+static const unsigned int bloomSalts[BLOOM_BLOCK_WORDS] = {
+     0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+     0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+/**
+* Returns the false positive rate of a split block filter with the given
+* number of bits per key. The keys in a block follow a Poisson distribution;
+* a block holding j keys has a bit of each word set with probability
+* 1 - (31/32)^j, and a false positive needs all eight.
+* @param bitsPerKey
+* @return Expected false positive rate.
+*/
+static double expectedRate(double bitsPerKey)
+{
+     double keysPerBlock = 32 * BLOOM_BLOCK_WORDS / bitsPerKey;
+     double probability = exp(-keysPerBlock);
+     double rate = 0;
+     int limit = (int)(keysPerBlock * 4) + 50;
+     for (int j = 0; j <= limit; j++) {
+          if (j > 0) {
+               probability *= keysPerBlock / j;
+          }
+          rate += probability * pow(1 - pow(31.0 / 32, j), BLOOM_BLOCK_WORDS);
+     }
+     return rate;
+}
+
+/**
+* Creates an empty filter sized so that the given number of keys give about
+* the given false positive rate. Adding more keys raises the rate.
+* @param keys Number of keys expected.
+* @param falsePositiveRate Between 0 and 1, for example 0.01.
+* @return The allocated filter.
+*/
+BloomFilter* bloomFilterNew(int keys, double falsePositiveRate)
+{
+     assert(falsePositiveRate > 0 && falsePositiveRate < 1);
+
+     /* The fewest bits per key, in half bits, that reach the rate */
+     double bitsPerKey = 1;
+     while (bitsPerKey < 64 && expectedRate(bitsPerKey) > falsePositiveRate) {
+          bitsPerKey += 0.5;
+     }
+
+     /* Aligned so the counters really start a cache line of their own */
+     BloomFilter* filter = aligned_alloc(64, sizeof(BloomFilter));
+     double bits = (keys > 0 ? keys : 1) * bitsPerKey;
+     filter->blockCount = (int)ceil(bits / (32 * BLOOM_BLOCK_WORDS));
+     filter->blocks = aligned_alloc(sizeof(filter->blocks[0]),
+          sizeof(filter->blocks[0]) * (size_t)filter->blockCount);
+     memset(filter->blocks, 0, sizeof(filter->blocks[0]) * (size_t)filter->blockCount);
+     filter->bitsPerKey = bitsPerKey;
+     filter->falsePositiveRate = expectedRate(bitsPerKey);
+     filter->keys = 0;
+     filter->queries = 0;
+     filter->rejections = 0;
+     return filter;
+}
+
+/**
+* Frees the filter.
+* @param filter
+*/
+void bloomFilterDelete(BloomFilter* filter)
+{
+     free(filter->blocks);
+     free(filter);
+}
+
+/**
+* Returns the block a hash maps to, scaling the hash's high half to the
+* number of blocks instead of taking a remainder.
+* @param filter
+* @param hash
+* @return The block.
+*/
+static unsigned int* blockOf(BloomFilter* filter, unsigned long long hash)
+{
+     unsigned long long index = ((hash >> 32) * (unsigned long long)filter->blockCount) >> 32;
+     return filter->blocks[index];
+}
+
+/**
+* Adds a key, given by its hash.
+* @param filter
+* @param hash 64-bit hash of the key.
+*/
+void bloomFilterAdd(BloomFilter* filter, unsigned long long hash)
+{
+     unsigned int* block = blockOf(filter, hash);
+     unsigned int key = (unsigned int)hash;
+     for (int i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+          block[i] |= 1u << ((key * bloomSalts[i]) >> 27);
+     }
+     filter->keys++;
+}
+
+/**
+* Returns 0 if the key with the given hash was never added, and 1 if it may
+* have been. Safe to call from several threads at once, as long as none adds
+* keys. Lookups write nothing, so threads sharing a filter do not contend;
+* callers that want them counted use bloomFilterCountLookup.
+* @param filter
+* @param hash 64-bit hash of the key.
+* @return 0 if the key is absent, 1 if it may be present.
+*/
+int bloomFilterMayContain(BloomFilter* filter, unsigned long long hash)
+{
+     const unsigned int* block = blockOf(filter, hash);
+     unsigned int key = (unsigned int)hash;
+     unsigned int missing = 0;
+     for (int i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+          missing |= ~block[i] & (1u << ((key * bloomSalts[i]) >> 27));
+     }
+     return missing == 0;
+}
+
+/**
+* Counts a lookup for bloomFilterPrintStats. Safe to call from several
+* threads at once.
+* @param filter
+* @param rejected 1 if the filter answered "absent".
+*/
+void bloomFilterCountLookup(BloomFilter* filter, int rejected)
+{
+     __atomic_add_fetch(&filter->queries, 1, __ATOMIC_RELAXED);
+     if (rejected) {
+          __atomic_add_fetch(&filter->rejections, 1, __ATOMIC_RELAXED);
+     }
+}
+
+/**
+* Returns the bytes taken by the filter's blocks.
+* @param filter
+* @return Size of the filter in bytes.
+*/
+size_t bloomFilterMemory(BloomFilter* filter)
+{
+     return sizeof(filter->blocks[0]) * (size_t)filter->blockCount;
+}
+
+/**
+* Prints the filter's size and how many counted lookups it answered on one
+* line.
+* @param filter
+* @param out
+*/
+void bloomFilterPrintStats(BloomFilter* filter, FILE* out)
+{
+     long long queries = __atomic_load_n(&filter->queries, __ATOMIC_RELAXED);
+     long long rejections = __atomic_load_n(&filter->rejections, __ATOMIC_RELAXED);
+     fprintf(out, "Bloom filter: %d keys, %.1f KB, %.1f bits per key, %.2f%% false positives expected, "
+          "%lld lookups, %lld skipped the table (%.1f%%)\n", filter->keys,
+          (double)bloomFilterMemory(filter) / 1024, filter->bitsPerKey, 100 * filter->falsePositiveRate,
+          queries, rejections, queries > 0 ? 100.0 * rejections / queries : 0.0);
+}
@@ -0,0 +1,42 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+* A split block Bloom filter. Every key sets one bit in each of the eight
+* 32-bit words of a single 32-byte block, so a lookup touches one cache line
+* whatever the false positive rate. A filter answers either "absent", which
+* is always right, or "maybe present".
+*/
+
+#define BLOOM_BLOCK_WORDS 8
+
+typedef struct BloomFilter BloomFilter;
+
+struct BloomFilter
+{
+     unsigned int (*blocks)[BLOOM_BLOCK_WORDS];
+     int blockCount;
+     // Bits per key and false positive rate the filter was sized for.
+     double bitsPerKey;
+     double falsePositiveRate;
+     // Keys added.
+     int keys;
+     // Lookups counted with bloomFilterCountLookup, and those answered
+     // "absent". Counted atomically, on a cache line of their own so the
+     // lines read by lookups stay shared.
+     long long queries __attribute__((aligned(64)));
+     long long rejections;
+};
+
+BloomFilter* bloomFilterNew(int keys, double falsePositiveRate);
+void bloomFilterDelete(BloomFilter* filter);
+void bloomFilterAdd(BloomFilter* filter, unsigned long long hash);
+int bloomFilterMayContain(BloomFilter* filter, unsigned long long hash);
+void bloomFilterCountLookup(BloomFilter* filter, int rejected);
+size_t bloomFilterMemory(BloomFilter* filter);
+void bloomFilterPrintStats(BloomFilter* filter, FILE* out);
+
+#endif
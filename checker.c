@@ -0,0 +1,427 @@
+/****************************************************************
+** Program Filename: checker.c
+** Author: Chelsea Egan
+** Description: Checks a whole document against the dictionary.
+** The input is split into words by a tokenizer, the same way as
+** the dictionary, and each word is looked up in place.
+** Misspelled words are written as JSON lines with their
+** position and suggestions. The parallel check runs reading,
+** lookup and suggestions as separate stages on a thread pool.
+****************************************************************/
+
+#include "checker.h"
+#include "threadPool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/**
+* Copies a word in ASCII lower case.
+* @param word
+* @param length
+* @param lower Receives length bytes.
+*/
+static void lowerCase(const char* word, int length, char* lower)
+{
+     for (int i = 0; i < length; i++) {
+          lower[i] = (char)(word[i] >= 'A' && word[i] <= 'Z' ? word[i] - 'A' + 'a' : word[i]);
+     }
+}
+
+/**
+* Returns 1 if the word is in the dictionary as written or, failing that, in
+* lower case, so that capitalized words at the start of a sentence are not
+* flagged.
+* @param map
+* @param word
+* @param folded The word in lower case, as a folding tokenizer gives it, or
+* NULL to fold it here.
+* @param length At most CHECK_MAX_WORD.
+* @return 1 if the word is spelled correctly, 0 otherwise.
+*/
+int checkWord(HashMap* map, const char* word, const char* folded, int length)
+{
+     assert(length <= CHECK_MAX_WORD);
+
+     if (hashMapContainsSlice(map, word, length)) {
+          return 1;
+     }
+
+     char lower[CHECK_MAX_WORD];
+     if (folded == 0) {
+          lowerCase(word, length, lower);
+          folded = lower;
+     }
+     return memcmp(folded, word, length) != 0 && hashMapContainsSlice(map, folded, length);
+}
+
+/**
+* Finds suggestions for a misspelled word in lower case. checkWord accepts a
+* capitalized word whose lower case form is in the dictionary, so "Helo" must
+* be corrected the way "helo" is, not by the words nearest its capital.
+* @param suggester
+* @param word
+* @param folded The word in lower case, as a folding tokenizer gives it, or
+* NULL to fold it here.
+* @param length At most CHECK_MAX_WORD.
+* @param suggestions Filled with the suggestions found.
+* @param count Number of suggestions wanted.
+* @return Number of suggestions found, at most count.
+*/
+int checkSuggest(Suggester* suggester, const char* word, const char* folded, int length,
+     Suggestion* suggestions, int count)
+{
+     assert(length <= CHECK_MAX_WORD);
+
+     char lower[CHECK_MAX_WORD + 1];
+     if (folded != 0) {
+          memcpy(lower, folded, length);
+     }
+     else {
+          lowerCase(word, length, lower);
+     }
+     lower[length] = '\0';
+     return suggesterFind(suggester, lower, suggestions, count);
+}
+
+/**
+* Writes a misspelled word as a JSON line. Words only hold letters, digits
+* and apostrophes, so they need no escaping.
+* @param out
+* @param word Null terminated, at most CHECK_MAX_WORD characters.
+* @param length Length of the word in the document, which may be longer.
+* @param line
+* @param column
+* @param suggestions
+* @param found Number of suggestions.
+*/
+static void writeMiss(FILE* out, const char* word, long long length, long long line,
+     long long column, const Suggestion* suggestions, int found)
+{
+     fprintf(out, "{\"line\":%lld,\"column\":%lld,\"word\":\"%s\"", line, column, word);
+     if (length > CHECK_MAX_WORD) {
+          fprintf(out, ",\"length\":%lld", length);
+     }
+     fprintf(out, ",\"suggestions\":[");
+     for (int i = 0; i < found; i++) {
+          fprintf(out, "%s\"%s\"", i > 0 ? "," : "", suggestions[i].word);
+     }
+     fprintf(out, "]}\n");
+}
+
+/**
+* Checks one word of the document and writes it out if it is misspelled. The
+* word is only copied, to null terminate it, when it is misspelled.
+* @param out
+* @param map
+* @param suggester
+* @param token The word, at most CHECK_MAX_WORD bytes of it.
+* @param stats
+*/
+static void checkToken(FILE* out, HashMap* map, Suggester* suggester, const Token* token,
+     CheckStats* stats)
+{
+     stats->words++;
+     int truncated = token->fullLength > CHECK_MAX_WORD;
+     if (!truncated && checkWord(map, token->word, token->folded, token->length)) {
+          return;
+     }
+     stats->misspelled++;
+
+     char word[CHECK_MAX_WORD + 1];
+     memcpy(word, token->word, token->length);
+     word[token->length] = '\0';
+     Suggestion suggestions[SUGGESTION_COUNT];
+     int found = truncated ? 0 :
+          checkSuggest(suggester, word, token->folded, token->length, suggestions, SUGGESTION_COUNT);
+     writeMiss(out, word, token->fullLength, token->line, token->column, suggestions, found);
+}
+
+/**
+* Checks every word read from in and writes the misspelled ones to out.
+* @param in
+* @param out
+* @param map
+* @param suggester
+* @param stats Set to the counts for the document, or NULL.
+* @return 0 on success, -1 on a read error.
+*/
+int checkStream(FILE* in, FILE* out, HashMap* map, Suggester* suggester, CheckStats* stats)
+{
+     Tokenizer tokenizer;
+     Token token;
+     CheckStats counts = { 0, 0, 0 };
+
+     tokenizerInitStream(&tokenizer, in, CHECK_MAX_WORD);
+     tokenizerSetFold(&tokenizer, 1);
+     while (tokenizerNext(&tokenizer, &token)) {
+          checkToken(out, map, suggester, &token, &counts);
+     }
+     counts.bytes = tokenizer.bytes;
+
+     int error = tokenizer.error ? -1 : 0;
+     tokenizerCleanUp(&tokenizer);
+     if (stats != 0) {
+          *stats = counts;
+     }
+     return error;
+}
+
+/* A misspelled word found in a chunk */
+typedef struct CheckMiss
+{
+     // First CHECK_MAX_WORD characters of the word, in the chunk's arena.
+     const char* word;
+     long long length;
+     long long line;
+     long long column;
+     Suggestion suggestions[SUGGESTION_COUNT];
+     int found;
+} CheckMiss;
+
+/* A piece of the document that starts and ends between words */
+typedef struct CheckChunk
+{
+     HashMap* map;
+     Suggester* suggester;
+     ThreadPool* pool;
+     char* data;
+     size_t length;
+     // Position of data[0]: its line, and the number of bytes before it on
+     // that line.
+     long long line;
+     long long column;
+     // Bytes cut from the chunk's first word because it was too long to check.
+     long long dropped;
+     // The chunk's lookup task and the suggestion tasks it queues.
+     ThreadPoolGroup group;
+     long long words;
+     CheckMiss* misses;
+     int missCount;
+     int missCapacity;
+     // Holds the misspelled words.
+     Arena arena;
+} CheckChunk;
+
+/**
+* Finds the suggestions for one misspelled word of a chunk.
+* @param context The CheckChunk.
+* @param task Index of the word in the chunk's misses.
+* @param worker
+*/
+static void suggestMiss(void* context, int task, int worker)
+{
+     CheckChunk* chunk = context;
+     CheckMiss* miss = &chunk->misses[task];
+     (void)worker;
+     miss->found = checkSuggest(chunk->suggester, miss->word, 0, (int)miss->length,
+          miss->suggestions, SUGGESTION_COUNT);
+}
+
+/**
+* Splits a chunk into words and looks each one up, then queues a suggestion
+* task for every misspelled word so that they can run on other workers.
+* @param context The CheckChunk.
+* @param task Unused.
+* @param worker
+*/
+static void checkChunk(void* context, int task, int worker)
+{
+     CheckChunk* chunk = context;
+     Tokenizer tokenizer;
+     Token token;
+     (void)task;
+     (void)worker;
+
+     /* Bytes dropped from the first word shift the rest of its line */
+     tokenizerInitMemory(&tokenizer, chunk->data, chunk->length);
+     tokenizerSetStart(&tokenizer, chunk->line, chunk->column, chunk->dropped);
+     tokenizerSetFold(&tokenizer, 1);
+     while (tokenizerNext(&tokenizer, &token)) {
+          chunk->words++;
+          if (token.fullLength <= CHECK_MAX_WORD &&
+               checkWord(chunk->map, token.word, token.folded, token.length)) {
+               continue;
+          }
+
+          if (chunk->missCount == chunk->missCapacity) {
+               chunk->missCapacity = chunk->missCapacity > 0 ? chunk->missCapacity * 2 : 64;
+               chunk->misses = realloc(chunk->misses, sizeof(CheckMiss) * chunk->missCapacity);
+          }
+          CheckMiss* miss = &chunk->misses[chunk->missCount++];
+          int kept = token.length < CHECK_MAX_WORD ? token.length : CHECK_MAX_WORD;
+          miss->word = arenaCopyString(&chunk->arena, token.word, kept);
+          miss->length = token.fullLength;
+          miss->line = token.line;
+          miss->column = token.column;
+          miss->found = 0;
+     }
+     tokenizerCleanUp(&tokenizer);
+
+     for (int m = 0; m < chunk->missCount; m++) {
+          if (chunk->misses[m].length <= CHECK_MAX_WORD) {
+               threadPoolSubmit(chunk->pool, &chunk->group, suggestMiss, chunk, m);
+          }
+     }
+}
+
+/**
+* Waits for a chunk's tasks, writes its misspelled words and empties it for
+* reuse.
+* @param chunk
+* @param out
+* @param stats
+*/
+static void flushChunk(CheckChunk* chunk, FILE* out, CheckStats* stats)
+{
+     threadPoolWait(chunk->pool, &chunk->group);
+
+     for (int m = 0; m < chunk->missCount; m++) {
+          CheckMiss* miss = &chunk->misses[m];
+          writeMiss(out, miss->word, miss->length, miss->line, miss->column, miss->suggestions,
+               miss->found);
+     }
+     stats->words += chunk->words;
+     stats->misspelled += chunk->missCount;
+
+     chunk->words = 0;
+     chunk->missCount = 0;
+     arenaCleanUp(&chunk->arena);
+     arenaInit(&chunk->arena);
+}
+
+/**
+* Moves a position past the given bytes.
+* @param line
+* @param column Bytes before the position on its line.
+* @param data
+* @param length
+*/
+static void advance(long long* line, long long* column, const char* data, size_t length)
+{
+     const char* end = data + length;
+     const char* lineStart = data;
+     const char* newline;
+     while ((newline = memchr(lineStart, '\n', (size_t)(end - lineStart))) != 0) {
+          (*line)++;
+          lineStart = newline + 1;
+     }
+     *column = lineStart == data ? *column + (long long)length : (long long)(end - lineStart);
+}
+
+/**
+* Checks every word read from in on the thread pool and writes the misspelled
+* ones to out, in document order. Reading happens on the calling thread,
+* which must have created the pool; it cuts the input after the last byte
+* that is not part of a word and carries the partial word over to the next
+* chunk. At most 2 * size + 1 chunks are in flight, so memory use does not
+* depend on the size of the document.
+* @param in
+* @param out
+* @param map
+* @param suggester
+* @param pool
+* @param stats Set to the counts for the document, or NULL.
+* @return 0 on success, -1 on a read error.
+*/
+int checkStreamParallel(FILE* in, FILE* out, HashMap* map, Suggester* suggester,
+     ThreadPool* pool, CheckStats* stats)
+{
+     int slots = 2 * threadPoolSize(pool) + 1;
+     CheckChunk* chunks = calloc(slots, sizeof(CheckChunk));
+     for (int i = 0; i < slots; i++) {
+          chunks[i].map = map;
+          chunks[i].suggester = suggester;
+          chunks[i].pool = pool;
+          chunks[i].data = malloc(CHECK_CHUNK_SIZE + CHECK_MAX_WORD + 1);
+          arenaInit(&chunks[i].arena);
+     }
+
+     CheckStats counts = { 0, 0, 0 };
+     /* Start of the next byte to read */
+     long long line = 1;
+     long long column = 0;
+     /* Partial word at the end of the last chunk, and where it starts */
+     char carry[CHECK_MAX_WORD + 1];
+     int carryLength = 0;
+     long long carryDropped = 0;
+     long long carryLine = 1;
+     long long carryColumn = 0;
+     /* Chunks handed to the pool, and chunks written out */
+     long long started = 0;
+     long long written = 0;
+
+     for (;;) {
+          CheckChunk* chunk = &chunks[started % slots];
+          if (started - written == slots) {
+               flushChunk(chunk, out, &counts);
+               written++;
+          }
+
+          /* The chunk starts with the partial word */
+          memcpy(chunk->data, carry, carryLength);
+          chunk->line = carryLength > 0 ? carryLine : line;
+          chunk->column = carryLength > 0 ? carryColumn : column;
+          chunk->dropped = carryDropped;
+
+          size_t count = fread(chunk->data + carryLength, 1, CHECK_CHUNK_SIZE, in);
+          size_t total = carryLength + count;
+          counts.bytes += (long long)count;
+          if (count == 0) {
+               if (total > 0) {
+                    chunk->length = total;
+                    threadPoolSubmit(pool, &chunk->group, checkChunk, chunk, 0);
+                    started++;
+               }
+               break;
+          }
+          advance(&line, &column, chunk->data + carryLength, count);
+
+          /* Cut after the last byte that is not part of a word */
+          size_t split = total;
+          while (split > (size_t)carryLength && isWordChar((unsigned char)chunk->data[split - 1])) {
+               split--;
+          }
+          if (split == (size_t)carryLength) {
+               /* All one word so far: keep its start and count the rest */
+               int kept = total < CHECK_MAX_WORD + 1 ? (int)total : CHECK_MAX_WORD + 1;
+               memcpy(carry, chunk->data, kept);
+               carryDropped += (long long)(total - kept);
+               carryLength = kept;
+               carryLine = chunk->line;
+               carryColumn = chunk->column;
+               continue;
+          }
+
+          size_t tail = total - split;
+          int kept = tail < CHECK_MAX_WORD + 1 ? (int)tail : CHECK_MAX_WORD + 1;
+          memcpy(carry, chunk->data + split, kept);
+          carryDropped = (long long)(tail - kept);
+          carryLength = kept;
+          carryLine = line;
+          carryColumn = column - (long long)tail;
+
+          chunk->length = split;
+          threadPoolSubmit(pool, &chunk->group, checkChunk, chunk, 0);
+          started++;
+     }
+
+     /* Write out the chunks still in flight */
+     while (written < started) {
+          flushChunk(&chunks[written % slots], out, &counts);
+          written++;
+     }
+
+     for (int i = 0; i < slots; i++) {
+          free(chunks[i].data);
+          free(chunks[i].misses);
+          arenaCleanUp(&chunks[i].arena);
+     }
+     free(chunks);
+
+     int error = ferror(in) ? -1 : 0;
+     if (stats != 0) {
+          *stats = counts;
+     }
+     return error;
+}
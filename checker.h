@@ -0,0 +1,44 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include "hashMap.h"
+#include "suggest.h"
+#include "tokenizer.h"
+#include <stdio.h>
+
+/*
+* Checks every word of a document against the dictionary. The document is
+* streamed through a tokenizer's block buffer, so memory use does not depend
+* on its size, and each misspelled word is written as one line of JSON:
+*   {"line":3,"column":14,"word":"teh","suggestions":["the","tea"]}
+* Lines and columns count from 1; columns are in bytes.
+*
+* checkStreamParallel splits the document into chunks that end between words
+* and checks them on a thread pool: each chunk is looked up by one task,
+* which queues one more task per misspelled word for its suggestions. Chunks
+* are written out in document order once all their tasks are done.
+*/
+
+// Bytes read for each chunk of a parallel check.
+#define CHECK_CHUNK_SIZE (256 * 1024)
+// Longest word that is looked up. Longer runs of word characters are
+// reported as misspelled, cut to this length, with no suggestions.
+#define CHECK_MAX_WORD 255
+
+typedef struct CheckStats CheckStats;
+
+struct CheckStats
+{
+     long long words;
+     long long misspelled;
+     long long bytes;
+};
+
+int checkWord(HashMap* map, const char* word, const char* folded, int length);
+int checkSuggest(Suggester* suggester, const char* word, const char* folded, int length,
+     Suggestion* suggestions, int count);
+int checkStream(FILE* in, FILE* out, HashMap* map, Suggester* suggester, CheckStats* stats);
+int checkStreamParallel(FILE* in, FILE* out, HashMap* map, Suggester* suggester,
+     ThreadPool* pool, CheckStats* stats);
+
+#endif
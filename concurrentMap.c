@@ -0,0 +1,287 @@
+/****************************************************************
+** Program Filename: concurrentMap.c
+** Author: Chelsea Egan
+** Description: Implements a read-mostly hash map for many
+** threads. Lookups never lock: a reader announces itself in its
+** slot, loads the published map and looks the key up there.
+** Writers serialize on a mutex, publish a changed copy of the
+** map and delete the replaced map after a grace period, once no
+** reader can still hold it.
+****************************************************************/
+
+#include "concurrentMap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <assert.h>
+
+/* Reader slot of the running thread, or -1 before its first lookup */
+static __thread int readerSlot = -1;
+/* Next reader slot to hand out */
+static int nextReaderSlot = 0;
+
+/**
+* Returns the reader slot of the running thread, handing out the next one
+* on its first call. Threads take slots in turn, so up to
+* CONCURRENT_MAP_SLOTS threads each have a slot of their own.
+* @return Slot number.
+*/
+static int currentSlot(void)
+{
+     if (readerSlot < 0) {
+          readerSlot = __atomic_fetch_add(&nextReaderSlot, 1, __ATOMIC_RELAXED) % CONCURRENT_MAP_SLOTS;
+     }
+     return readerSlot;
+}
+
+/**
+* Creates a concurrent map serving the given map, which it takes over.
+* @param map
+* @return The allocated concurrent map.
+*/
+ConcurrentMap* concurrentMapNew(HashMap* map)
+{
+     assert(map != 0);
+
+     ConcurrentMap* concurrent = malloc(sizeof(ConcurrentMap));
+     hashMapFinishResize(map);
+     concurrent->current = map;
+     concurrent->epoch = 0;
+     concurrent->slots = aligned_alloc(sizeof(ConcurrentMapSlot),
+          sizeof(ConcurrentMapSlot) * CONCURRENT_MAP_SLOTS);
+     memset(concurrent->slots, 0, sizeof(ConcurrentMapSlot) * CONCURRENT_MAP_SLOTS);
+     pthread_mutex_init(&concurrent->writeLock, 0);
+     return concurrent;
+}
+
+/**
+* Deletes the concurrent map and the map it serves. No thread may be using
+* it any more.
+* @param concurrent
+*/
+void concurrentMapDelete(ConcurrentMap* concurrent)
+{
+     hashMapDelete(concurrent->current);
+     free(concurrent->slots);
+     pthread_mutex_destroy(&concurrent->writeLock);
+     free(concurrent);
+}
+
+/**
+* Starts a read: returns the published map, which stays valid until the
+* matching concurrentMapLeave however many maps are published meanwhile.
+* Only look keys up in it; never change it. Reads may nest but should be
+* short, since writers wait for them.
+* @param concurrent
+* @param ticket Set to the value to pass to concurrentMapLeave.
+* @return The published map.
+*/
+HashMap* concurrentMapEnter(ConcurrentMap* concurrent, int* ticket)
+{
+     int slot = currentSlot();
+     int parity = (int)(__atomic_load_n(&concurrent->epoch, __ATOMIC_SEQ_CST) & 1);
+
+     /* Announce the read before loading the map, so a writer that flips the
+        epoch after this either sees the count or published before the load */
+     __atomic_add_fetch(&concurrent->slots[slot].readers[parity], 1, __ATOMIC_SEQ_CST);
+     *ticket = slot * 2 + parity;
+     return __atomic_load_n(&concurrent->current, __ATOMIC_SEQ_CST);
+}
+
+/**
+* Ends a read started by concurrentMapEnter.
+* @param concurrent
+* @param ticket
+*/
+void concurrentMapLeave(ConcurrentMap* concurrent, int ticket)
+{
+     __atomic_sub_fetch(&concurrent->slots[ticket / 2].readers[ticket % 2], 1, __ATOMIC_RELEASE);
+}
+
+/**
+* Returns 1 if the given key is in the published map and 0 otherwise.
+* @param concurrent
+* @param key
+* @return 1 if the key is found, 0 otherwise.
+*/
+int concurrentMapContainsKey(ConcurrentMap* concurrent, const char* key)
+{
+     return concurrentMapContainsSlice(concurrent, key, (int)strlen(key));
+}
+
+/**
+* Same as concurrentMapContainsKey for a key given as a pointer and length.
+* @param concurrent
+* @param key
+* @param length
+* @return 1 if the key is found, 0 otherwise.
+*/
+int concurrentMapContainsSlice(ConcurrentMap* concurrent, const char* key, int length)
+{
+     int ticket;
+     HashMap* map = concurrentMapEnter(concurrent, &ticket);
+     int found = hashMapContainsSlice(map, key, length);
+     concurrentMapLeave(concurrent, ticket);
+     return found;
+}
+
+/**
+* Looks up the value stored with the given key. The value is copied out,
+* since the slot holding it may be freed as soon as the read ends.
+* @param concurrent
+* @param key
+* @param value Set to the key's value if it is found.
+* @return 1 if the key is found, 0 otherwise.
+*/
+int concurrentMapGet(ConcurrentMap* concurrent, const char* key, int* value)
+{
+     int ticket;
+     HashMap* map = concurrentMapEnter(concurrent, &ticket);
+     int* slot = hashMapGet(map, key);
+     if (slot != 0) {
+          *value = *slot;
+     }
+     concurrentMapLeave(concurrent, ticket);
+     return slot != 0;
+}
+
+/**
+* Waits until every read counted in the given parity of the slots is done.
+* @param concurrent
+* @param parity
+*/
+static void waitForReaders(ConcurrentMap* concurrent, int parity)
+{
+     for (int i = 0; i < CONCURRENT_MAP_SLOTS; i++) {
+          while (__atomic_load_n(&concurrent->slots[i].readers[parity], __ATOMIC_ACQUIRE) != 0) {
+               sched_yield();
+          }
+     }
+}
+
+/**
+* Publishes a map and deletes the one it replaces once no read can still be
+* using it. Reads that start after the store get the new map. Reads already
+* running are counted under the current parity: flipping the epoch sends
+* new reads to the other parity, so the current one drains. A read that
+* loaded the epoch just before an earlier flip may have been counted under
+* the other parity after that writer stopped waiting, so that parity is
+* drained first. The caller holds the write lock.
+* @param concurrent
+* @param map
+*/
+static void publish(ConcurrentMap* concurrent, HashMap* map)
+{
+     hashMapFinishResize(map);
+     HashMap* old = __atomic_exchange_n(&concurrent->current, map, __ATOMIC_SEQ_CST);
+
+     unsigned int epoch = concurrent->epoch;
+     waitForReaders(concurrent, (int)((epoch + 1) & 1));
+     __atomic_store_n(&concurrent->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+     waitForReaders(concurrent, (int)(epoch & 1));
+
+     hashMapDelete(old);
+}
+
+/**
+* Applies a change to a copy of the published map and publishes the copy.
+* Readers keep using the old map until the copy is published and are never
+* blocked. Copying costs time in proportion to the map, so group changes
+* into one update where possible. Writers run one at a time, and a thread
+* must not write while it is in a read, since the write would wait for it.
+* @param concurrent
+* @param update Called with the copy.
+* @param context Passed to update.
+*/
+void concurrentMapUpdate(ConcurrentMap* concurrent, ConcurrentMapUpdate update, void* context)
+{
+     pthread_mutex_lock(&concurrent->writeLock);
+     HashMap* copy = hashMapClone(concurrent->current);
+     update(copy, context);
+     publish(concurrent, copy);
+     pthread_mutex_unlock(&concurrent->writeLock);
+}
+
+/* A single put or remove for concurrentMapUpdate */
+typedef struct ConcurrentMapChange
+{
+     const char* key;
+     int value;
+} ConcurrentMapChange;
+
+/**
+* Puts the key of a ConcurrentMapChange.
+* @param map
+* @param context The change.
+*/
+static void putChange(HashMap* map, void* context)
+{
+     ConcurrentMapChange* change = context;
+     hashMapPut(map, change->key, change->value);
+}
+
+/**
+* Removes the key of a ConcurrentMapChange, if the map has any keys.
+* @param map
+* @param context The change.
+*/
+static void removeChange(HashMap* map, void* context)
+{
+     ConcurrentMapChange* change = context;
+     if (hashMapSize(map) > 0) {
+          hashMapRemove(map, change->key);
+     }
+}
+
+/**
+* Puts a key with the given value, publishing a copy of the map.
+* @param concurrent
+* @param key
+* @param value
+*/
+void concurrentMapPut(ConcurrentMap* concurrent, const char* key, int value)
+{
+     ConcurrentMapChange change = { key, value };
+     concurrentMapUpdate(concurrent, putChange, &change);
+}
+
+/**
+* Removes a key, publishing a copy of the map. Removing a key that is not
+* in the map still publishes a copy.
+* @param concurrent
+* @param key
+*/
+void concurrentMapRemove(ConcurrentMap* concurrent, const char* key)
+{
+     ConcurrentMapChange change = { key, 0 };
+     concurrentMapUpdate(concurrent, removeChange, &change);
+}
+
+/**
+* Publishes a whole new map, for example a reloaded dictionary, in place of
+* the current one, which is deleted once no read uses it. Lookups running
+* meanwhile finish in the old map.
+* @param concurrent
+* @param map Map to take over.
+*/
+void concurrentMapSwap(ConcurrentMap* concurrent, HashMap* map)
+{
+     assert(map != 0);
+
+     pthread_mutex_lock(&concurrent->writeLock);
+     publish(concurrent, map);
+     pthread_mutex_unlock(&concurrent->writeLock);
+}
+
+/**
+* Returns the number of keys in the published map.
+* @param concurrent
+* @return Number of keys.
+*/
+int concurrentMapSize(ConcurrentMap* concurrent)
+{
+     int ticket;
+     int size = hashMapSize(concurrentMapEnter(concurrent, &ticket));
+     concurrentMapLeave(concurrent, ticket);
+     return size;
+}
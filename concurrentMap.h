@@ -0,0 +1,64 @@
+#ifndef CONCURRENT_MAP_H
+#define CONCURRENT_MAP_H
+
+#include "hashMap.h"
+#include <pthread.h>
+
+/*
+* A hash map shared by many reader threads and changed by writers without
+* ever making a reader wait. Readers look keys up in the published map
+* without taking a lock. Writers copy the published map, change the copy and
+* publish it in one atomic store; the map it replaced is deleted once every
+* lookup that could still be reading it has finished. A whole new dictionary
+* can be published the same way.
+*
+* Lookups in progress are counted per reader slot, each on a cache line of
+* its own, so readers on different cores do not share any line they write.
+* Each slot has two counters, one for each parity of the map's epoch: a
+* writer flips the epoch and waits for the counters of the old parity to
+* drain, which they do as soon as the lookups that started before the flip
+* are done.
+*/
+
+// Reader slots; threads beyond this many share slots, which stays correct.
+#define CONCURRENT_MAP_SLOTS 64
+
+typedef struct ConcurrentMap ConcurrentMap;
+typedef struct ConcurrentMapSlot ConcurrentMapSlot;
+
+/*
+* A function that changes a private copy of the map for concurrentMapUpdate.
+*/
+typedef void (*ConcurrentMapUpdate)(HashMap* map, void* context);
+
+struct ConcurrentMapSlot
+{
+     // Lookups in progress that entered with epoch parity 0 and 1.
+     long long readers[2];
+} __attribute__((aligned(64)));
+
+struct ConcurrentMap
+{
+     // Published map. Readers load it atomically.
+     HashMap* current;
+     // Bumped by every writer after it publishes a map.
+     unsigned int epoch;
+     ConcurrentMapSlot* slots;
+     // Held by writers, one at a time.
+     pthread_mutex_t writeLock;
+};
+
+ConcurrentMap* concurrentMapNew(HashMap* map);
+void concurrentMapDelete(ConcurrentMap* concurrent);
+HashMap* concurrentMapEnter(ConcurrentMap* concurrent, int* ticket);
+void concurrentMapLeave(ConcurrentMap* concurrent, int ticket);
+int concurrentMapContainsKey(ConcurrentMap* concurrent, const char* key);
+int concurrentMapContainsSlice(ConcurrentMap* concurrent, const char* key, int length);
+int concurrentMapGet(ConcurrentMap* concurrent, const char* key, int* value);
+void concurrentMapPut(ConcurrentMap* concurrent, const char* key, int value);
+void concurrentMapRemove(ConcurrentMap* concurrent, const char* key);
+void concurrentMapUpdate(ConcurrentMap* concurrent, ConcurrentMapUpdate update, void* context);
+void concurrentMapSwap(ConcurrentMap* concurrent, HashMap* map);
+int concurrentMapSize(ConcurrentMap* concurrent);
+
+#endif
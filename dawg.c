@@ -0,0 +1,470 @@
+/****************************************************************
+** Program Filename: dawg.c
+** Author: Chelsea Egan
+** Description: Implements a minimized directed acyclic word
+** graph. It is built from sorted words with the incremental
+** algorithm of Daciuk et al.: the path of the previous word is
+** kept open, and when the next word leaves it the nodes below
+** the fork are frozen, each one replaced by an equal node frozen
+** earlier if there is one. Suggestions walk the graph depth
+** first with one row of the Levenshtein table per letter and
+** abandon every prefix whose row is already past the radius.
+****************************************************************/
+
+#include "dawg.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+/* A node on the path of the previous word, which can still gain edges */
+typedef struct DawgOpenNode
+{
+     unsigned int* edges;
+     int count;
+     int capacity;
+     int final;
+} DawgOpenNode;
+
+/* State of a build */
+typedef struct DawgBuilder
+{
+     Dawg* dawg;
+     int nodeCapacity;
+     int edgeCapacity;
+     // Open nodes of the previous word's path, one per prefix length.
+     DawgOpenNode* path;
+     int pathCapacity;
+     // Frozen nodes by signature (see freezeNode).
+     HashMap* registry;
+     char* signature;
+     int signatureCapacity;
+} DawgBuilder;
+
+/* State of a dawgNearest query */
+typedef struct DawgSearch
+{
+     Dawg* dawg;
+     const char* query;
+     int queryLength;
+     int minDistance;
+     // Largest distance a word can have and still be kept. It starts at the
+     // farthest any word can be and shrinks once count words are kept.
+     int radius;
+     // Row d holds the distances between the first d letters of the path
+     // and every prefix of the query.
+     int* rows;
+     char* path;
+     Suggestion* nearest;
+     int count;
+     int found;
+} DawgSearch;
+
+static unsigned int packEdge(unsigned char label, int target)
+{
+     return (unsigned int)label | (unsigned int)target << DAWG_LABEL_BITS;
+}
+
+static unsigned char edgeLabel(unsigned int edge)
+{
+     return (unsigned char)(edge & ((1u << DAWG_LABEL_BITS) - 1));
+}
+
+static int edgeTarget(unsigned int edge)
+{
+     return (int)(edge >> DAWG_LABEL_BITS);
+}
+
+/**
+* Adds an edge to an open node.
+* @param node
+* @param label
+* @param target Frozen node the edge leads to.
+*/
+static void addEdge(DawgOpenNode* node, unsigned char label, int target)
+{
+     if (node->count == node->capacity) {
+          node->capacity = node->capacity > 0 ? node->capacity * 2 : 4;
+          node->edges = realloc(node->edges, sizeof(unsigned int) * node->capacity);
+     }
+     node->edges[node->count++] = packEdge(label, target);
+}
+
+/**
+* Freezes an open node and empties it for reuse. The node's signature spells
+* out whether it is final and every edge with its label and target. The
+* targets are frozen already, so two nodes with the same signature have the
+* same subtree, and a node whose signature was seen before is replaced by
+* the node frozen then.
+* @param builder
+* @param open
+* @return Index of the frozen node.
+*/
+static int freezeNode(DawgBuilder* builder, DawgOpenNode* open)
+{
+     Dawg* dawg = builder->dawg;
+     int needed = 2 + open->count * 12;
+     if (needed > builder->signatureCapacity) {
+          builder->signatureCapacity = needed * 2;
+          builder->signature = realloc(builder->signature, builder->signatureCapacity);
+     }
+
+     int length = 0;
+     builder->signature[length++] = open->final ? 'F' : 'N';
+     for (int i = 0; i < open->count; i++) {
+          length += sprintf(builder->signature + length, "%c%x,", edgeLabel(open->edges[i]),
+               (unsigned int)edgeTarget(open->edges[i]));
+     }
+
+     int* existing = hashMapGetSlice(builder->registry, builder->signature, length);
+     int id;
+     if (existing != 0) {
+          id = *existing;
+     }
+     else {
+          id = dawg->nodeCount++;
+          assert(id < DAWG_MAX_NODES);
+          if (dawg->nodeCount > builder->nodeCapacity) {
+               builder->nodeCapacity *= 2;
+               dawg->nodes = realloc(dawg->nodes, sizeof(DawgNode) * builder->nodeCapacity);
+          }
+          while (dawg->edgeCount + open->count > builder->edgeCapacity) {
+               builder->edgeCapacity *= 2;
+               dawg->edges = realloc(dawg->edges, sizeof(unsigned int) * builder->edgeCapacity);
+          }
+          dawg->nodes[id].firstEdge = dawg->edgeCount;
+          dawg->nodes[id].edgeCount = (unsigned short)open->count;
+          dawg->nodes[id].final = (unsigned char)open->final;
+          if (open->count > 0) {
+               memcpy(dawg->edges + dawg->edgeCount, open->edges, sizeof(unsigned int) * open->count);
+               dawg->edgeCount += open->count;
+          }
+          hashMapPutSlice(builder->registry, builder->signature, length, id);
+     }
+
+     open->count = 0;
+     open->final = 0;
+     return id;
+}
+
+/**
+* Freezes the open nodes of a word's path below the given depth, linking
+* each one into its parent.
+* @param builder
+* @param word
+* @param length Length of the word, the depth of its last node.
+* @param depth Depth of the deepest node that stays open.
+*/
+static void closePath(DawgBuilder* builder, const char* word, int length, int depth)
+{
+     for (int d = length; d > depth; d--) {
+          int id = freezeNode(builder, &builder->path[d]);
+          addEdge(&builder->path[d - 1], (unsigned char)word[d - 1], id);
+     }
+}
+
+/**
+* Builds the graph of a list of words.
+* @param words Null terminated words in strcmp order. Repeated words are
+* skipped.
+* @param count Number of words.
+* @return The allocated graph, with no map set.
+*/
+static Dawg* buildGraph(const char* const* words, int count)
+{
+     Dawg* dawg = malloc(sizeof(Dawg));
+     dawg->nodeCount = 0;
+     dawg->edgeCount = 0;
+     dawg->size = 0;
+     dawg->maxLength = 0;
+     dawg->map = 0;
+
+     DawgBuilder builder;
+     builder.dawg = dawg;
+     builder.nodeCapacity = 1024;
+     builder.edgeCapacity = 1024;
+     dawg->nodes = malloc(sizeof(DawgNode) * builder.nodeCapacity);
+     dawg->edges = malloc(sizeof(unsigned int) * builder.edgeCapacity);
+     builder.pathCapacity = 64;
+     builder.path = calloc(builder.pathCapacity, sizeof(DawgOpenNode));
+     builder.registry = hashMapNew(count + 1);
+     builder.signatureCapacity = 256;
+     builder.signature = malloc(builder.signatureCapacity);
+
+     const char* previous = "";
+     int previousLength = 0;
+     for (int i = 0; i < count; i++) {
+          const char* word = words[i];
+          int length = (int)strlen(word);
+          if (i > 0 && strcmp(previous, word) == 0) {
+               continue;
+          }
+          assert(i == 0 || strcmp(previous, word) < 0);
+
+          /* Freeze what the new word does not share with the previous one */
+          int common = 0;
+          while (common < length && common < previousLength && word[common] == previous[common]) {
+               common++;
+          }
+          closePath(&builder, previous, previousLength, common);
+
+          if (length >= builder.pathCapacity) {
+               int capacity = builder.pathCapacity;
+               while (length >= builder.pathCapacity) {
+                    builder.pathCapacity *= 2;
+               }
+               builder.path = realloc(builder.path, sizeof(DawgOpenNode) * builder.pathCapacity);
+               memset(builder.path + capacity, 0, sizeof(DawgOpenNode) * (builder.pathCapacity - capacity));
+          }
+          builder.path[length].final = 1;
+
+          if (length > dawg->maxLength) {
+               dawg->maxLength = length;
+          }
+          dawg->size++;
+          previous = word;
+          previousLength = length;
+     }
+     closePath(&builder, previous, previousLength, 0);
+     dawg->root = freezeNode(&builder, &builder.path[0]);
+
+     for (int d = 0; d < builder.pathCapacity; d++) {
+          free(builder.path[d].edges);
+     }
+     free(builder.path);
+     free(builder.signature);
+     hashMapDelete(builder.registry);
+
+     /* Give back what the arrays grew past */
+     dawg->nodes = realloc(dawg->nodes, sizeof(DawgNode) * dawg->nodeCount);
+     dawg->edges = realloc(dawg->edges, sizeof(unsigned int) * (dawg->edgeCount + 1));
+     return dawg;
+}
+
+/**
+* Compares two strings through pointers to them, for qsort.
+*/
+static int compareWords(const void* a, const void* b)
+{
+     return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+/**
+* Builds the graph of every key of the map. The map must outlive the graph
+* and not change while it is used.
+* @param map
+* @return The allocated graph.
+*/
+Dawg* dawgBuildFromMap(HashMap* map)
+{
+     const char** words = malloc(sizeof(const char*) * (hashMapSize(map) + 1));
+     int count = 0;
+     for (int i = 0; i < hashMapCapacity(map); i++) {
+          const char* key = hashMapKeyAt(map, i);
+          if (key != 0) {
+               words[count++] = key;
+          }
+     }
+     qsort(words, count, sizeof(const char*), compareWords);
+
+     Dawg* dawg = buildGraph(words, count);
+     dawg->map = map;
+     free(words);
+     return dawg;
+}
+
+/**
+* Frees the graph. Its map is not freed.
+* @param dawg
+*/
+void dawgDelete(Dawg* dawg)
+{
+     free(dawg->nodes);
+     free(dawg->edges);
+     free(dawg);
+}
+
+/**
+* Returns the node an edge with the given label leads to, searching the
+* node's sorted edges by halves.
+* @param dawg
+* @param node
+* @param label
+* @return The target node or -1 if the node has no such edge.
+*/
+static int findChild(Dawg* dawg, int node, unsigned char label)
+{
+     const unsigned int* edges = dawg->edges + dawg->nodes[node].firstEdge;
+     int low = 0;
+     int high = dawg->nodes[node].edgeCount;
+     while (low < high) {
+          int middle = (low + high) / 2;
+          if (edgeLabel(edges[middle]) < label) {
+               low = middle + 1;
+          }
+          else {
+               high = middle;
+          }
+     }
+     if (low < dawg->nodes[node].edgeCount && edgeLabel(edges[low]) == label) {
+          return edgeTarget(edges[low]);
+     }
+     return -1;
+}
+
+/**
+* Returns 1 if the given word is in the graph and 0 otherwise.
+* @param dawg
+* @param key
+* @return 1 if the word is found, 0 otherwise.
+*/
+int dawgContainsKey(Dawg* dawg, const char* key)
+{
+     return dawgContainsSlice(dawg, key, (int)strlen(key));
+}
+
+/**
+* Same as dawgContainsKey for a word given as a pointer and length.
+* @param dawg
+* @param key
+* @param length
+* @return 1 if the word is found, 0 otherwise.
+*/
+int dawgContainsSlice(Dawg* dawg, const char* key, int length)
+{
+     assert(dawg != 0);
+
+     int node = dawg->root;
+     for (int i = 0; i < length; i++) {
+          node = findChild(dawg, node, (unsigned char)key[i]);
+          if (node < 0) {
+               return 0;
+          }
+     }
+     return dawg->nodes[node].final;
+}
+
+/**
+* Keeps a word found by the search among the nearest. Words are found in
+* strcmp order, so a word tying with the worst one kept would rank after it;
+* the radius leaves such words out before they get here.
+* @param search
+* @param length Length of the word, which is the search's current path.
+* @param distance
+*/
+static void keepWord(DawgSearch* search, int length, int distance)
+{
+     /* Return the map's own copy, which outlives the search */
+     const char* word = hashMapFindSlice(search->dawg->map, search->path, length);
+     assert(word != 0);
+
+     search->found = suggestionInsert(search->nearest, search->found, search->count, word, distance);
+     if (search->found == search->count) {
+          search->radius = search->nearest[search->count - 1].distance - 1;
+     }
+}
+
+/**
+* Visits a node and, in label order, every child whose prefix is still
+* within the radius of the query. The row of the node's own prefix is
+* already filled in.
+* @param search
+* @param node
+* @param depth Length of the node's prefix.
+*/
+static void searchNode(DawgSearch* search, int node, int depth)
+{
+     Dawg* dawg = search->dawg;
+     int columns = search->queryLength + 1;
+     const int* row = search->rows + depth * columns;
+     int* next = search->rows + (depth + 1) * columns;
+     const DawgNode* current = &dawg->nodes[node];
+
+     int distance = row[search->queryLength];
+     if (current->final && distance >= search->minDistance && distance <= search->radius) {
+          keepWord(search, depth, distance);
+     }
+
+     for (int i = 0; i < current->edgeCount; i++) {
+          unsigned int edge = dawg->edges[current->firstEdge + i];
+          unsigned char label = edgeLabel(edge);
+
+          next[0] = depth + 1;
+          int best = next[0];
+          for (int j = 1; j < columns; j++) {
+               int cost = (unsigned char)search->query[j - 1] == label ? 0 : 1;
+               int value = row[j - 1] + cost;
+               if (row[j] + 1 < value) {
+                    value = row[j] + 1;
+               }
+               if (next[j - 1] + 1 < value) {
+                    value = next[j - 1] + 1;
+               }
+               next[j] = value;
+               if (value < best) {
+                    best = value;
+               }
+          }
+
+          /* Every word below is at least the row's minimum away; the radius
+             is read again for each child, as it shrinks during the walk */
+          if (best <= search->radius) {
+               search->path[depth] = (char)label;
+               searchNode(search, edgeTarget(edge), depth + 1);
+          }
+     }
+}
+
+/**
+* Finds the words nearest to the query in a single walk of the graph. The
+* radius starts at the farthest any word can be and, once count words are
+* kept, shrinks to just inside the worst of them, so every later prefix is
+* cut off as soon as it cannot beat that word. The words returned are keys
+* of the graph's map. Safe to call from several threads at once.
+* @param dawg
+* @param query
+* @param minDistance Words closer than this are ignored; pass 1 to leave out
+* the query itself.
+* @param nearest Filled with the words found, nearest first.
+* @param count Number of words wanted.
+* @return Number of words found, at most count.
+*/
+int dawgNearest(Dawg* dawg, const char* query, int minDistance, Suggestion* nearest, int count)
+{
+     assert(dawg != 0);
+     if (dawg->size == 0 || count <= 0) {
+          return 0;
+     }
+
+     DawgSearch search;
+     search.dawg = dawg;
+     search.query = query;
+     search.queryLength = (int)strlen(query);
+     search.minDistance = minDistance;
+     /* No word is further than the longer of the two lengths */
+     search.radius = search.queryLength > dawg->maxLength ? search.queryLength : dawg->maxLength;
+     search.rows = malloc(sizeof(int) * (dawg->maxLength + 2) * (search.queryLength + 1));
+     search.path = malloc(dawg->maxLength + 1);
+     search.nearest = nearest;
+     search.count = count;
+     search.found = 0;
+     for (int j = 0; j <= search.queryLength; j++) {
+          search.rows[j] = j;
+     }
+
+     searchNode(&search, dawg->root, 0);
+
+     free(search.path);
+     free(search.rows);
+     return search.found;
+}
+
+/**
+* Returns the bytes taken by the graph's nodes and edges.
+* @param dawg
+* @return Size of the graph in bytes.
+*/
+size_t dawgMemory(Dawg* dawg)
+{
+     return sizeof(DawgNode) * (size_t)dawg->nodeCount + sizeof(unsigned int) * (size_t)dawg->edgeCount;
+}
@@ -0,0 +1,58 @@
+#ifndef DAWG_H
+#define DAWG_H
+
+#include "suggest.h"
+
+/*
+* A directed acyclic word graph: a trie whose equal subtrees are merged, so
+* words that share a prefix share its path and words that share a suffix
+* share its tail. The graph is built from the words in sorted order,
+* merging each subtree as soon as no later word can add to it, so the full
+* trie never exists.
+*
+* Nodes and edges are stored in two flat arrays. The edges of a node are
+* consecutive and sorted by label.
+*
+* The graph is an index over a hash map's keys, not a replacement for the
+* map: the words it suggests are the map's own keys, so the map must stay
+* loaded and unchanged while the graph is used.
+*/
+
+// Edges pack the label in the low 8 bits and the target node above it.
+#define DAWG_LABEL_BITS 8
+#define DAWG_MAX_NODES (1 << (32 - DAWG_LABEL_BITS))
+
+typedef struct Dawg Dawg;
+typedef struct DawgNode DawgNode;
+
+struct DawgNode
+{
+     // Index of the node's first edge.
+     int firstEdge;
+     unsigned short edgeCount;
+     // 1 if the path to this node spells a word.
+     unsigned char final;
+};
+
+struct Dawg
+{
+     DawgNode* nodes;
+     int nodeCount;
+     unsigned int* edges;
+     int edgeCount;
+     int root;
+     // Number of words, and the length of the longest one.
+     int size;
+     int maxLength;
+     // Map the graph was built from; dawgNearest returns its keys.
+     HashMap* map;
+};
+
+Dawg* dawgBuildFromMap(HashMap* map);
+void dawgDelete(Dawg* dawg);
+int dawgContainsKey(Dawg* dawg, const char* key);
+int dawgContainsSlice(Dawg* dawg, const char* key, int length);
+int dawgNearest(Dawg* dawg, const char* query, int minDistance, Suggestion* nearest, int count);
+size_t dawgMemory(Dawg* dawg);
+
+#endif
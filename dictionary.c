@@ -0,0 +1,56 @@
+/****************************************************************
+** Program Filename: dictionary.c
+** Author: Chelsea Egan
+** Description: Loads a word list into a hash map. Shared by the
+** spell checker and the benchmark, so both time the same code.
+****************************************************************/
+
+#include "dictionary.h"
+#include "tokenizer.h"
+#include "fileMap.h"
+#include <stdlib.h>
+
+/**
+* Loads the words of the file into the hash map. The file is mapped into
+* memory and split into words in place by a tokenizer, as the checker splits
+* documents, and the words are then put all at once, so the table is sized
+* once and each word is copied exactly once: into the map's arena.
+* @param path
+* @param map
+* @param pool Threads to build the table with, or NULL.
+* @return Number of words read, or -1 if the file cannot be opened.
+*/
+int loadDictionary(const char* path, HashMap* map, ThreadPool* pool)
+{
+     FileMap file;
+     if (fileMapOpen(&file, path) != 0) {
+          return -1;
+     }
+
+     Tokenizer tokenizer;
+     Token token;
+     int count = 0;
+     int capacity = 1024;
+     const char** words = malloc(sizeof(const char*) * capacity);
+     int* lengths = malloc(sizeof(int) * capacity);
+
+     tokenizerInitMemory(&tokenizer, file.data, file.length);
+     while (tokenizerNext(&tokenizer, &token)) {
+          if (count == capacity) {
+               capacity *= 2;
+               words = realloc(words, sizeof(const char*) * capacity);
+               lengths = realloc(lengths, sizeof(int) * capacity);
+          }
+          words[count] = token.word;
+          lengths[count] = token.length;
+          count++;
+     }
+     tokenizerCleanUp(&tokenizer);
+
+     hashMapPutAll(map, words, lengths, count, 1, pool);
+
+     free(words);
+     free(lengths);
+     fileMapClose(&file);
+     return count;
+}
@@ -0,0 +1,13 @@
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include "hashMap.h"
+
+/*
+* A dictionary file is a list of words separated by anything that is not a
+* word character (see isWordChar).
+*/
+
+int loadDictionary(const char* path, HashMap* map, ThreadPool* pool);
+
+#endif
@@ -0,0 +1,313 @@
+/****************************************************************
+** Program Filename: editBatch.c
+** Author: Chelsea Egan
+** Description: Computes the edit distance from one query to a
+** batch of words at once. Each word of the batch occupies one
+** 16-bit vector lane, and the dynamic programming column over
+** the query is advanced one character of every word per step.
+** A lane's result is captured at the column where its word
+** ends. The widest kernel the processor supports is picked at
+** runtime, with a scalar fallback.
+****************************************************************/
+
+#include "editBatch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EDIT_BATCH_X86 1
+#include <immintrin.h>
+#endif
+
+/**
+* Groups the words into batches and transposes their characters.
+* @param words Words to compare against. The set keeps the pointers, so the
+* words must outlive it.
+* @param count Number of words.
+* @return The allocated set.
+*/
+EditBatchSet* editBatchSetBuild(const char* const* words, int count)
+{
+     /* Choose the kernel before any threads can race to do it */
+     editBatchKernelName();
+
+     EditBatchSet* set = malloc(sizeof(EditBatchSet));
+     set->count = (count + EDIT_BATCH_LANES - 1) / EDIT_BATCH_LANES;
+     set->words = count;
+     set->batches = calloc(set->count > 0 ? set->count : 1, sizeof(EditBatch));
+
+     /* Size every batch by its longest word */
+     size_t total = 0;
+     for (int b = 0; b < set->count; b++) {
+          EditBatch* batch = &set->batches[b];
+          batch->count = count - b * EDIT_BATCH_LANES < EDIT_BATCH_LANES ?
+               count - b * EDIT_BATCH_LANES : EDIT_BATCH_LANES;
+          for (int lane = 0; lane < batch->count; lane++) {
+               const char* word = words[b * EDIT_BATCH_LANES + lane];
+               int length = (int)strlen(word);
+               batch->words[lane] = word;
+               batch->lengths[lane] = (short)(length < 0x7fff ? length : 0x7fff);
+               if (length > batch->maxLength) {
+                    batch->maxLength = length;
+               }
+          }
+          total += (size_t)batch->maxLength * EDIT_BATCH_LANES;
+     }
+
+     /* Transpose the characters */
+     set->chars = calloc(total > 0 ? total : 1, 1);
+     unsigned char* next = set->chars;
+     for (int b = 0; b < set->count; b++) {
+          EditBatch* batch = &set->batches[b];
+          batch->chars = next;
+          for (int lane = 0; lane < batch->count; lane++) {
+               for (int j = 0; j < batch->lengths[lane]; j++) {
+                    batch->chars[j * EDIT_BATCH_LANES + lane] = (unsigned char)batch->words[lane][j];
+               }
+          }
+          next += (size_t)batch->maxLength * EDIT_BATCH_LANES;
+     }
+     return set;
+}
+
+/**
+* Frees the set. The words are not freed.
+* @param set
+*/
+void editBatchSetDelete(EditBatchSet* set)
+{
+     free(set->chars);
+     free(set->batches);
+     free(set);
+}
+
+/**
+* Compares the query with each word of the batch in turn.
+*/
+static void batchScalar(const EditPattern* query, const EditBatch* batch, int maxDistance,
+     int* distances)
+{
+     for (int lane = 0; lane < batch->count; lane++) {
+          distances[lane] = editPatternDistance(query, batch->words[lane], batch->lengths[lane],
+               maxDistance);
+     }
+}
+
+#ifdef EDIT_BATCH_X86
+
+/* Source: the inter-sequence layout of M. Farrar and T. Rognes' SIMD Smith-Waterman kernels */
+
+/**
+* Compares the query with 16 words at once in AVX2 lanes. The smallest entry
+* of a column never decreases from one column to the next, so once it is
+* over maxDistance in every lane whose word is longer than the columns done,
+* those words are all too far and the rest of the batch is skipped.
+*/
+__attribute__((target("avx2")))
+static void batchAvx2(const EditPattern* query, const EditBatch* batch, int maxDistance,
+     int* distances)
+{
+     int m = query->length;
+     const __m256i one = _mm256_set1_epi16(1);
+     const __m256i limit = _mm256_set1_epi16((short)maxDistance);
+     __m256i column[EDIT_BATCH_MAX_QUERY + 1];
+     __m256i lengths = _mm256_loadu_si256((const __m256i*)batch->lengths);
+     /* Words of length 0 are the query's length away */
+     __m256i result = _mm256_set1_epi16((short)m);
+
+     for (int i = 0; i <= m; i++) {
+          column[i] = _mm256_set1_epi16((short)i);
+     }
+
+     for (int j = 0; j < batch->maxLength; j++) {
+          __m128i packed = _mm_loadu_si128((const __m128i*)(batch->chars + j * EDIT_BATCH_LANES));
+          __m256i chars = _mm256_cvtepu8_epi16(packed);
+          __m256i diagonal = column[0];
+          column[0] = _mm256_set1_epi16((short)(j + 1));
+
+          __m256i smallest = column[0];
+          for (int i = 1; i <= m; i++) {
+               __m256i match = _mm256_cmpeq_epi16(chars,
+                    _mm256_set1_epi16((unsigned char)query->word[i - 1]));
+               /* Substitution costs 1, or 0 where the characters match (match is -1) */
+               __m256i substitute = _mm256_add_epi16(diagonal, _mm256_add_epi16(one, match));
+               __m256i remove = _mm256_add_epi16(column[i], one);
+               __m256i insert = _mm256_add_epi16(column[i - 1], one);
+               diagonal = column[i];
+               column[i] = _mm256_min_epi16(substitute, _mm256_min_epi16(remove, insert));
+               smallest = _mm256_min_epi16(smallest, column[i]);
+          }
+
+          /* Keep the bottom of the column for words ending here */
+          __m256i position = _mm256_set1_epi16((short)(j + 1));
+          __m256i ends = _mm256_cmpeq_epi16(lengths, position);
+          result = _mm256_blendv_epi8(result, column[m], ends);
+
+          /* Stop when every longer word is already too far */
+          __m256i longer = _mm256_cmpgt_epi16(lengths, position);
+          __m256i near = _mm256_and_si256(longer, _mm256_cmpgt_epi16(_mm256_add_epi16(limit, one), smallest));
+          if (_mm256_movemask_epi8(near) == 0) {
+               result = _mm256_blendv_epi8(result, _mm256_add_epi16(limit, one), longer);
+               break;
+          }
+     }
+
+     short lanes[EDIT_BATCH_LANES];
+     _mm256_storeu_si256((__m256i*)lanes, result);
+     for (int lane = 0; lane < batch->count; lane++) {
+          distances[lane] = lanes[lane];
+     }
+}
+
+/**
+* Compares the query with 8 words at once in SSE2 lanes, stopping early like
+* batchAvx2.
+* @param query
+* @param chars Transposed characters, EDIT_BATCH_LANES apart.
+* @param lengths Lengths of the 8 words.
+* @param maxLength
+* @param maxDistance
+* @param distances
+*/
+__attribute__((target("sse2")))
+static void batchSse2Half(const EditPattern* query, const unsigned char* chars,
+     const short* lengths, int maxLength, int maxDistance, short* distances)
+{
+     int m = query->length;
+     const __m128i one = _mm_set1_epi16(1);
+     const __m128i beyond = _mm_set1_epi16((short)(maxDistance + 1));
+     const __m128i zero = _mm_setzero_si128();
+     __m128i column[EDIT_BATCH_MAX_QUERY + 1];
+     __m128i wordLengths = _mm_loadu_si128((const __m128i*)lengths);
+     __m128i result = _mm_set1_epi16((short)m);
+
+     for (int i = 0; i <= m; i++) {
+          column[i] = _mm_set1_epi16((short)i);
+     }
+
+     for (int j = 0; j < maxLength; j++) {
+          __m128i packed = _mm_loadl_epi64((const __m128i*)(chars + j * EDIT_BATCH_LANES));
+          __m128i wordChars = _mm_unpacklo_epi8(packed, zero);
+          __m128i diagonal = column[0];
+          column[0] = _mm_set1_epi16((short)(j + 1));
+
+          __m128i smallest = column[0];
+          for (int i = 1; i <= m; i++) {
+               __m128i match = _mm_cmpeq_epi16(wordChars,
+                    _mm_set1_epi16((unsigned char)query->word[i - 1]));
+               __m128i substitute = _mm_add_epi16(diagonal, _mm_add_epi16(one, match));
+               __m128i remove = _mm_add_epi16(column[i], one);
+               __m128i insert = _mm_add_epi16(column[i - 1], one);
+               diagonal = column[i];
+               column[i] = _mm_min_epi16(substitute, _mm_min_epi16(remove, insert));
+               smallest = _mm_min_epi16(smallest, column[i]);
+          }
+
+          __m128i position = _mm_set1_epi16((short)(j + 1));
+          __m128i ends = _mm_cmpeq_epi16(wordLengths, position);
+          result = _mm_or_si128(_mm_and_si128(ends, column[m]), _mm_andnot_si128(ends, result));
+
+          __m128i longer = _mm_cmpgt_epi16(wordLengths, position);
+          if (_mm_movemask_epi8(_mm_and_si128(longer, _mm_cmplt_epi16(smallest, beyond))) == 0) {
+               result = _mm_or_si128(_mm_and_si128(longer, beyond), _mm_andnot_si128(longer, result));
+               break;
+          }
+     }
+
+     _mm_storeu_si128((__m128i*)distances, result);
+}
+
+/**
+* Compares the query with 16 words as two halves of 8 SSE2 lanes.
+*/
+static void batchSse2(const EditPattern* query, const EditBatch* batch, int maxDistance,
+     int* distances)
+{
+     short lanes[EDIT_BATCH_LANES];
+     batchSse2Half(query, batch->chars, batch->lengths, batch->maxLength, maxDistance, lanes);
+     if (batch->count > EDIT_BATCH_LANES / 2) {
+          batchSse2Half(query, batch->chars + EDIT_BATCH_LANES / 2,
+               batch->lengths + EDIT_BATCH_LANES / 2, batch->maxLength, maxDistance,
+               lanes + EDIT_BATCH_LANES / 2);
+     }
+     for (int lane = 0; lane < batch->count; lane++) {
+          distances[lane] = lanes[lane];
+     }
+}
+
+#endif
+
+typedef void (*BatchKernel)(const EditPattern* query, const EditBatch* batch, int maxDistance,
+     int* distances);
+
+static BatchKernel batchKernel = 0;
+static const char* batchKernelName = 0;
+
+/**
+* Picks the widest kernel the processor supports.
+*/
+static void selectKernel(void)
+{
+#ifdef EDIT_BATCH_X86
+     __builtin_cpu_init();
+     if (__builtin_cpu_supports("avx2")) {
+          batchKernelName = "avx2";
+          batchKernel = batchAvx2;
+          return;
+     }
+     if (__builtin_cpu_supports("sse2")) {
+          batchKernelName = "sse2";
+          batchKernel = batchSse2;
+          return;
+     }
+#endif
+     batchKernelName = "scalar";
+     batchKernel = batchScalar;
+}
+
+/**
+* Returns the name of the kernel editBatchDistances uses on this processor.
+* @return "avx2", "sse2" or "scalar".
+*/
+const char* editBatchKernelName(void)
+{
+     if (batchKernel == 0) {
+          selectKernel();
+     }
+     return batchKernelName;
+}
+
+/**
+* Computes the exact distance from the query to every word of the batch.
+* @param query Preprocessed query.
+* @param batch
+* @param distances Filled with batch->count distances, in lane order.
+*/
+void editBatchDistances(const EditPattern* query, const EditBatch* batch, int* distances)
+{
+     editBatchDistancesBounded(query, batch, query->length + batch->maxLength, distances);
+}
+
+/**
+* Computes the distance from the query to every word of the batch, as far as
+* it is at most maxDistance: a word further away gets some distance over
+* maxDistance, not always its exact one. The kernel stops as soon as no word
+* left can come within maxDistance, so a tight bound saves most of the work.
+* @param query Preprocessed query.
+* @param batch
+* @param maxDistance Largest distance the caller needs exactly.
+* @param distances Filled with batch->count distances, in lane order.
+*/
+void editBatchDistancesBounded(const EditPattern* query, const EditBatch* batch, int maxDistance,
+     int* distances)
+{
+     if (batchKernel == 0) {
+          selectKernel();
+     }
+     if (query->length > EDIT_BATCH_MAX_QUERY) {
+          batchScalar(query, batch, maxDistance, distances);
+          return;
+     }
+     batchKernel(query, batch, maxDistance, distances);
+}
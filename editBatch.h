@@ -0,0 +1,52 @@
+#ifndef EDIT_BATCH_H
+#define EDIT_BATCH_H
+
+#include "editDistance.h"
+
+/*
+* One-to-many edit distance. Words are grouped into batches of
+* EDIT_BATCH_LANES and stored transposed (structure of arrays), so that
+* character j of every word in a batch is contiguous. A query is compared
+* against a whole batch at once, one vector lane per word, using AVX2 or SSE2
+* when the processor has them.
+*/
+
+#define EDIT_BATCH_LANES 16
+// Longest query the vector kernels accept; longer ones are compared one word
+// at a time.
+#define EDIT_BATCH_MAX_QUERY 64
+
+typedef struct EditBatch EditBatch;
+typedef struct EditBatchSet EditBatchSet;
+
+struct EditBatch
+{
+     // Number of words in use, at most EDIT_BATCH_LANES.
+     int count;
+     // Length of the longest word in the batch.
+     int maxLength;
+     const char* words[EDIT_BATCH_LANES];
+     short lengths[EDIT_BATCH_LANES];
+     // chars[j * EDIT_BATCH_LANES + lane] is character j of the lane's word,
+     // or 0 past its end.
+     unsigned char* chars;
+};
+
+struct EditBatchSet
+{
+     EditBatch* batches;
+     int count;
+     // Number of words over all batches.
+     int words;
+     // Backing store of every batch's characters.
+     unsigned char* chars;
+};
+
+EditBatchSet* editBatchSetBuild(const char* const* words, int count);
+void editBatchSetDelete(EditBatchSet* set);
+void editBatchDistances(const EditPattern* query, const EditBatch* batch, int* distances);
+void editBatchDistancesBounded(const EditPattern* query, const EditBatch* batch, int maxDistance,
+     int* distances);
+const char* editBatchKernelName(void);
+
+#endif
@@ -0,0 +1,228 @@
+/****************************************************************
+** Program Filename: editDistance.c
+** Author: Chelsea Egan
+** Description: Computes the Levenshtein distance between two
+** words: the number of single character insertions, deletions
+** and substitutions needed to turn one into the other. Words of
+** up to 64 characters use the bit-parallel algorithm of Myers
+** (as formulated by Hyyro), which handles a whole column of the
+** distance matrix per machine word. Longer words use a dynamic
+** programming row restricted to a band around the diagonal.
+** Both stop early once the distance cannot stay within the
+** caller's bound.
+****************************************************************/
+
+#include "editDistance.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+/*This is a macro used in the Levenshtein distance algorithm */
+
+#define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
+
+/**
+* Bit-parallel distance between a preprocessed word of 1 to 64 characters and
+* a text.
+* @param peq Match masks of the word.
+* @param m Length of the word.
+* @param text
+* @param n Length of the text.
+* @param maxDistance
+* @return The distance, or maxDistance + 1 if it is larger.
+*/
+/* Source: H. Hyyro, "Explaining and extending the bit-parallel approximate string matching algorithm of Myers", 2001 */
+static int myersDistance(const unsigned long long* peq, int m, const char* text, int n,
+     int maxDistance)
+{
+     unsigned long long pv = ~0ull;
+     unsigned long long mv = 0;
+     unsigned long long last = 1ull << (m - 1);
+     int score = m;
+
+     for (int j = 0; j < n; j++) {
+          unsigned long long eq = peq[(unsigned char)text[j]];
+          unsigned long long xv = eq | mv;
+          unsigned long long xh = (((eq & pv) + pv) ^ pv) | eq;
+          unsigned long long ph = mv | ~(xh | pv);
+          unsigned long long mh = pv & xh;
+
+          if (ph & last) {
+               score++;
+          }
+          else if (mh & last) {
+               score--;
+          }
+
+          /* The rest of the text can lower the score by at most one per character */
+          if (score - (n - j - 1) > maxDistance) {
+               return maxDistance + 1;
+          }
+
+          /* Row 0 of the matrix grows by one per text character */
+          ph = (ph << 1) | 1;
+          mh <<= 1;
+          pv = mh | ~(xv | ph);
+          mv = ph & xv;
+     }
+
+     return score <= maxDistance ? score : maxDistance + 1;
+}
+
+/**
+* Distance by dynamic programming over one row, only filling the cells within
+* maxDistance of the diagonal. Cells outside the band are treated as
+* maxDistance + 1.
+* @param s1 Longer word.
+* @param m Length of s1.
+* @param s2 Shorter word.
+* @param n Length of s2.
+* @param maxDistance
+* @return The distance, or maxDistance + 1 if it is larger.
+*/
+static int bandedDistance(const char* s1, int m, const char* s2, int n, int maxDistance)
+{
+     int k = maxDistance < m ? maxDistance : m;
+     int stackRow[EDIT_DISTANCE_MAX_ROW];
+     int* row = n < EDIT_DISTANCE_MAX_ROW ? stackRow : malloc(sizeof(int) * (n + 1));
+
+     for (int j = 0; j <= n; j++) {
+          row[j] = j <= k ? j : k + 1;
+     }
+
+     int result = -1;
+     for (int i = 1; i <= m && result < 0; i++) {
+          int lo = i - k > 1 ? i - k : 1;
+          int hi = i + k < n ? i + k : n;
+          int diagonal = row[lo - 1];
+          row[lo - 1] = lo == 1 && i <= k ? i : k + 1;
+          int rowMin = row[lo - 1];
+
+          for (int j = lo; j <= hi; j++) {
+               int up = row[j];
+               int value = MIN3(up + 1, row[j - 1] + 1, diagonal + (s1[i - 1] == s2[j - 1] ? 0 : 1));
+               diagonal = up;
+               row[j] = value < k + 1 ? value : k + 1;
+               if (row[j] < rowMin) {
+                    rowMin = row[j];
+               }
+          }
+
+          /* Every path to the corner passes through this row */
+          if (rowMin > k) {
+               result = k + 1;
+          }
+     }
+     if (result < 0) {
+          result = row[n];
+     }
+
+     if (row != stackRow) {
+          free(row);
+     }
+     return result <= maxDistance ? result : maxDistance + 1;
+}
+
+/**
+* Calculates the Levenshtein distance between two words, giving up once it is
+* known to exceed maxDistance.
+* @param s1
+* @param length1
+* @param s2
+* @param length2
+* @param maxDistance Largest distance of interest.
+* @return The distance, or maxDistance + 1 if it is larger.
+*/
+int editDistanceBounded(const char* s1, int length1, const char* s2, int length2,
+     int maxDistance)
+{
+     if (maxDistance < 0) {
+          return maxDistance + 1;
+     }
+     int difference = length1 > length2 ? length1 - length2 : length2 - length1;
+     if (difference > maxDistance) {
+          return maxDistance + 1;
+     }
+
+     /* Make s2 the shorter word */
+     if (length2 > length1) {
+          const char* s = s1;
+          s1 = s2;
+          s2 = s;
+          int length = length1;
+          length1 = length2;
+          length2 = length;
+     }
+     if (length2 == 0) {
+          return length1;
+     }
+
+     if (length2 <= EDIT_PATTERN_MAX_LENGTH) {
+          unsigned long long peq[256];
+          memset(peq, 0, sizeof(peq));
+          for (int i = 0; i < length2; i++) {
+               peq[(unsigned char)s2[i]] |= 1ull << i;
+          }
+          return myersDistance(peq, length2, s1, length1, maxDistance);
+     }
+     return bandedDistance(s1, length1, s2, length2, maxDistance);
+}
+
+/**
+* Calculates the Levenshtein distance between input word and dictionary words
+* @param user's string
+* @param string from dictionary
+* @returns Levenshtein distance
+*/
+int levenshtein(const char *s1, const char *s2) {
+     return editDistanceBounded(s1, (int)strlen(s1), s2, (int)strlen(s2), INT_MAX - 1);
+}
+
+/**
+* Preprocesses a word for editPatternDistance. The pattern keeps a pointer to
+* the word, which must stay valid while the pattern is used.
+* @param pattern
+* @param word
+* @param length
+*/
+void editPatternInit(EditPattern* pattern, const char* word, int length)
+{
+     pattern->word = word;
+     pattern->length = length;
+     if (length <= EDIT_PATTERN_MAX_LENGTH) {
+          memset(pattern->peq, 0, sizeof(pattern->peq));
+          for (int i = 0; i < length; i++) {
+               pattern->peq[(unsigned char)word[i]] |= 1ull << i;
+          }
+     }
+}
+
+/**
+* Calculates the Levenshtein distance between a preprocessed word and a text,
+* giving up once it is known to exceed maxDistance.
+* @param pattern
+* @param text
+* @param length Length of the text.
+* @param maxDistance Largest distance of interest.
+* @return The distance, or maxDistance + 1 if it is larger.
+*/
+int editPatternDistance(const EditPattern* pattern, const char* text, int length,
+     int maxDistance)
+{
+     int m = pattern->length;
+     if (maxDistance < 0) {
+          return maxDistance + 1;
+     }
+     int difference = m > length ? m - length : length - m;
+     if (difference > maxDistance) {
+          return maxDistance + 1;
+     }
+     if (m == 0 || length == 0) {
+          return difference;
+     }
+
+     if (m <= EDIT_PATTERN_MAX_LENGTH) {
+          return myersDistance(pattern->peq, m, text, length, maxDistance);
+     }
+     return editDistanceBounded(pattern->word, m, text, length, maxDistance);
+}
@@ -0,0 +1,37 @@
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+/*
+* Levenshtein distance kernels. The bounded versions take the largest distance
+* the caller cares about and give up as soon as it is exceeded, returning
+* maxDistance + 1. None of them allocate for words shorter than
+* EDIT_DISTANCE_MAX_ROW characters.
+*/
+
+// Longest word handled by the bit-parallel kernel.
+#define EDIT_PATTERN_MAX_LENGTH 64
+// Longest shorter word the banded kernel handles without allocating.
+#define EDIT_DISTANCE_MAX_ROW 1024
+
+typedef struct EditPattern EditPattern;
+
+/*
+* A word preprocessed for comparing against many other words.
+*/
+struct EditPattern
+{
+     const char* word;
+     int length;
+     // Bit i of peq[c] is set when character i of the word is c. Only used
+     // when length <= EDIT_PATTERN_MAX_LENGTH.
+     unsigned long long peq[256];
+};
+
+int levenshtein(const char* s1, const char* s2);
+int editDistanceBounded(const char* s1, int length1, const char* s2, int length2,
+     int maxDistance);
+void editPatternInit(EditPattern* pattern, const char* word, int length);
+int editPatternDistance(const EditPattern* pattern, const char* text, int length,
+     int maxDistance);
+
+#endif
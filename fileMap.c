@@ -0,0 +1,138 @@
+/****************************************************************
+** Program Filename: fileMap.c
+** Author: Chelsea Egan
+** Description: Maps a whole file into memory for reading so that
+** it can be parsed in place without copying it through stdio.
+****************************************************************/
+
+#include "fileMap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+* Reads everything left in the file descriptor into a heap buffer.
+* @param file
+* @param fd
+* @return 0 on success, -1 on a read error.
+*/
+static int readWhole(FileMap* file, int fd)
+{
+     size_t capacity = 64 * 1024;
+     size_t length = 0;
+     char* buffer = malloc(capacity);
+
+     while (1) {
+          if (length == capacity) {
+               capacity *= 2;
+               buffer = realloc(buffer, capacity);
+          }
+          ssize_t count = read(fd, buffer + length, capacity - length);
+          if (count < 0) {
+               free(buffer);
+               return -1;
+          }
+          if (count == 0) {
+               break;
+          }
+          length += (size_t)count;
+     }
+
+     file->data = buffer;
+     file->length = length;
+     file->mapped = 0;
+     return 0;
+}
+
+/**
+* Maps the file at the given path with the given protection.
+* @param file
+* @param path
+* @param protection PROT_READ, optionally with PROT_WRITE.
+* @param advice Expected access pattern passed to madvise.
+* @return 0 on success, -1 if the file cannot be opened or read.
+*/
+static int openFile(FileMap* file, const char* path, int protection, int advice)
+{
+     assert(file != 0);
+     file->data = 0;
+     file->length = 0;
+     file->mapped = 0;
+
+     int fd = open(path, O_RDONLY);
+     if (fd < 0) {
+          return -1;
+     }
+
+     struct stat info;
+     int result = 0;
+     if (fstat(fd, &info) != 0) {
+          result = -1;
+     }
+     else if (!S_ISREG(info.st_mode)) {
+          result = readWhole(file, fd);
+     }
+     else if (info.st_size > 0) {
+          void* data = mmap(0, (size_t)info.st_size, protection, MAP_PRIVATE, fd, 0);
+          if (data != MAP_FAILED) {
+               madvise(data, (size_t)info.st_size, advice);
+               file->data = data;
+               file->length = (size_t)info.st_size;
+               file->mapped = 1;
+          }
+          else {
+               result = readWhole(file, fd);
+          }
+     }
+
+     close(fd);
+     return result;
+}
+
+/**
+* Opens the file at the given path for reading in place, front to back.
+* @param file
+* @param path
+* @return 0 on success, -1 if the file cannot be opened or read.
+*/
+int fileMapOpen(FileMap* file, const char* path)
+{
+     return openFile(file, path, PROT_READ, MADV_SEQUENTIAL);
+}
+
+/**
+* Opens the file at the given path as a private copy-on-write mapping. The
+* data may be written through a cast; a written page is copied for this
+* process and every other page stays shared with other processes mapping the
+* same file.
+* @param file
+* @param path
+* @return 0 on success, -1 if the file cannot be opened or read.
+*/
+int fileMapOpenPrivate(FileMap* file, const char* path)
+{
+     return openFile(file, path, PROT_READ | PROT_WRITE, MADV_RANDOM);
+}
+
+/**
+* Unmaps or frees the file's contents.
+* @param file
+*/
+void fileMapClose(FileMap* file)
+{
+     assert(file != 0);
+
+     if (file->mapped) {
+          munmap((void*)file->data, file->length);
+     }
+     else {
+          free((void*)file->data);
+     }
+     file->data = 0;
+     file->length = 0;
+     file->mapped = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+#include <stddef.h>
+
+/*
+* Read-only view of a whole file. The file is memory mapped when possible
+* and read into a heap buffer otherwise (for example for pipes).
+*/
+
+typedef struct FileMap FileMap;
+
+struct FileMap
+{
+     const char* data;
+     size_t length;
+     // 1 if data is a mapping, 0 if it is a heap buffer.
+     int mapped;
+};
+
+int fileMapOpen(FileMap* file, const char* path);
+int fileMapOpenPrivate(FileMap* file, const char* path);
+void fileMapClose(FileMap* file);
+
+#endif
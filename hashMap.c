@@ -2,11 +2,13 @@
 ** Program Filename: hashMap.c
 ** Author: Chelsea Egan
 ** Date: 11/18/2017
-** Description: Implements a hash map. The hash map uses a table
-** of buckets, each containing a linked list of hash links. Each
-** hash link stores the key-value pair and a pointer to the next
-** link. HASH_FUNCTION is a macro that allows you to choose which
-** hash function to use.
+** Description: Implements a hash map. The hash map uses a single
+** flat table of slots with open addressing: keys are placed by
+** linear probing with Robin Hood displacement, so every key sits
+** close to the slot it hashes to. Each slot stores the key's hash
+** next to the key pointer so that most mismatches never touch the
+** key string. The hash function is chosen when the map is created;
+** HASH_FUNCTION is the default used by hashMapNew.
 ****************************************************************/
 
 /*
@@ -17,25 +19,29 @@
 */
 
 #include "hashMap.h"
+#include "threadPool.h"
+#include "bloomFilter.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+#include <time.h>
 
-int hashFunction1(const char* key)
+unsigned int hashFunction1(const char* key, int length)
 {
-     int r = 0;
-     for (int i = 0; key[i] != '\0'; i++)
+     unsigned int r = 0;
+     for (int i = 0; i < length; i++)
      {
           r += key[i];
      }
      return r;
 }
 
-int hashFunction2(const char* key)
+unsigned int hashFunction2(const char* key, int length)
 {
-     int r = 0;
-     for (int i = 0; key[i] != '\0'; i++)
+     unsigned int r = 0;
+     for (int i = 0; i < length; i++)
      {
           r += (i + 1) * key[i];
      }
@@ -43,432 +49,2053 @@ int hashFunction2(const char* key)
 }
 
 /**
-* Creates a new hash table link with a copy of the key string.
-* @param key Key string to copy in the link.
-* @param value Value to set in the link.
-* @param next Pointer to set as the link's next.
-* @return Hash table link allocated on the heap.
+* 32-bit FNV-1a.
+* @param key
+* @param length
+* @return Hash of the key.
+*/
+unsigned int hashFunctionFnv(const char* key, int length)
+{
+     unsigned int r = 2166136261u;
+     for (int i = 0; i < length; i++)
+     {
+          r ^= (unsigned char)key[i];
+          r *= 16777619u;
+     }
+     return r;
+}
+
+/* Source: https://github.com/wangyi-fudan/wyhash */
+static const uint64_t wySecret[4] = {
+     0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+     0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+/**
+* Multiplies two 64-bit numbers into 128 bits and folds the halves together.
+*/
+static uint64_t wyMix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+     __uint128_t r = (__uint128_t)a * b;
+     return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+     uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+     uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+     uint64_t t = rl + (rm0 << 32);
+     uint64_t c = t < rl;
+     uint64_t lo = t + (rm1 << 32);
+     c += lo < t;
+     uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+     return lo ^ hi;
+#endif
+}
+
+static uint64_t wyRead8(const unsigned char* p)
+{
+     uint64_t v;
+     memcpy(&v, p, 8);
+     return v;
+}
+
+static uint64_t wyRead4(const unsigned char* p)
+{
+     uint32_t v;
+     memcpy(&v, p, 4);
+     return v;
+}
+
+/**
+* 64-bit wyhash of a byte string.
+* @param key
+* @param length
+* @param seed
+* @return Hash of the key.
+*/
+static uint64_t wyHash(const char* key, int length, uint64_t seed)
+{
+     const unsigned char* p = (const unsigned char*)key;
+     uint64_t a, b;
+
+     seed ^= wyMix(seed ^ wySecret[0], wySecret[1]);
+     if (length <= 16) {
+          if (length >= 4) {
+               int shift = (length >> 3) << 2;
+               a = (wyRead4(p) << 32) | wyRead4(p + shift);
+               b = (wyRead4(p + length - 4) << 32) | wyRead4(p + length - 4 - shift);
+          }
+          else if (length > 0) {
+               a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+               b = 0;
+          }
+          else {
+               a = b = 0;
+          }
+     }
+     else {
+          int i = length;
+          while (i > 16) {
+               seed = wyMix(wyRead8(p) ^ wySecret[1], wyRead8(p + 8) ^ seed);
+               p += 16;
+               i -= 16;
+          }
+          a = wyRead8(p + i - 16);
+          b = wyRead8(p + i - 8);
+     }
+
+     return wyMix(wySecret[1] ^ (uint64_t)length, wyMix(a ^ wySecret[1], b ^ seed));
+}
+
+/**
+* 64-bit wyhash of a key. The map's filter is keyed by this hash.
+* @param key
+* @param length
+* @return Hash of the key.
+*/
+unsigned long long hashFunctionWy64(const char* key, int length)
+{
+     return wyHash(key, length, 0);
+}
+
+/**
+* wyhash folded to 32 bits. This is the default hash function.
+* @param key
+* @param length
+* @return Hash of the key.
+*/
+unsigned int hashFunctionWy(const char* key, int length)
+{
+     uint64_t h = wyHash(key, length, 0);
+     return (unsigned int)(h ^ (h >> 32));
+}
+
+/* Hash functions that can be selected by name */
+static const struct
+{
+     const char* name;
+     HashFunction function;
+} hashFunctions[] = {
+     { "sum", hashFunction1 },
+     { "weighted", hashFunction2 },
+     { "fnv", hashFunctionFnv },
+     { "wy", hashFunctionWy },
+};
+
+#define HASH_FUNCTION_COUNT ((int)(sizeof(hashFunctions) / sizeof(hashFunctions[0])))
+
+/**
+* Looks up a hash function by the name it is registered under.
+* @param name
+* @return The hash function or NULL if the name is unknown.
+*/
+HashFunction hashFunctionByName(const char* name)
+{
+     for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+          if (strcmp(hashFunctions[i].name, name) == 0) {
+               return hashFunctions[i].function;
+          }
+     }
+     return 0;
+}
+
+/**
+* Returns the name a hash function is registered under.
+* @param function
+* @return The name or "custom" for an unregistered function.
+*/
+const char* hashFunctionName(HashFunction function)
+{
+     for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+          if (hashFunctions[i].function == function) {
+               return hashFunctions[i].name;
+          }
+     }
+     return "custom";
+}
+
+/**
+* Prints the names of all registered hash functions on one line.
+* @param out
+*/
+void hashFunctionPrintNames(FILE* out)
+{
+     for (int i = 0; i < HASH_FUNCTION_COUNT; i++) {
+          fprintf(out, "%s%s", i > 0 ? " " : "", hashFunctions[i].name);
+     }
+     fprintf(out, "\n");
+}
+
+/**
+* Scrambles the bits of a hash. Linear probing needs neighbouring hash values
+* to land far apart, which the character-sum functions do not give on their
+* own. The result is never 0, since 0 marks an empty slot.
+* @param h
+* @return Mixed, non-zero hash.
+*/
+static unsigned int mixHash(unsigned int h)
+{
+     /* Murmur3 finalizer */
+     h ^= h >> 16;
+     h *= 0x85ebca6bu;
+     h ^= h >> 13;
+     h *= 0xc2b2ae35u;
+     h ^= h >> 16;
+     return h != 0 ? h : 1;
+}
+
+/**
+* Hashes the key with the map's hash function and mixes the result.
+* @param map
+* @param key
+* @param length
+* @return Mixed, non-zero hash of the key.
+*/
+static unsigned int hashKey(struct HashMap* map, const char* key, int length)
+{
+     return mixHash(map->hashFunction(key, length));
+}
+
+/**
+* Hashes a key for a lookup, unless the map's filter shows that the key is
+* not in the map, in which case the table need not be touched at all. The
+* filter counts the lookup only while the map's stats are on.
+* @param map
+* @param key
+* @param length
+* @param hash Set to the mixed hash of the key when it may be in the map.
+* @return 0 if the key is certainly absent, 1 otherwise.
+*/
+static int lookupHash(struct HashMap* map, const char* key, int length, unsigned int* hash)
+{
+     if (map->filter == 0) {
+          *hash = hashKey(map, key, length);
+          return 1;
+     }
+
+     unsigned long long wide = hashFunctionWy64(key, length);
+     int present = bloomFilterMayContain(map->filter, wide);
+     if (map->stats != 0) {
+          bloomFilterCountLookup(map->filter, !present);
+     }
+     if (!present) {
+          return 0;
+     }
+     /* The default hash function is this hash folded; do not hash twice */
+     if (map->hashFunction == hashFunctionWy) {
+          *hash = mixHash((unsigned int)(wide ^ (wide >> 32)));
+     }
+     else {
+          *hash = hashKey(map, key, length);
+     }
+     return 1;
+}
+
+/**
+* Returns how far the slot at the given index of a table is from the slot its
+* key hashes to.
+* @param table
+* @param capacity Number of slots in the table.
+* @param index Index of an occupied slot.
+* @return Probe distance of the slot.
+*/
+static int slotDistance(const struct HashSlot* table, int capacity, int index)
+{
+     unsigned int mask = (unsigned int)capacity - 1;
+     return (int)(((unsigned int)index - table[index].hash) & mask);
+}
+
+/**
+* Returns how far the slot at the given index is from the slot its key hashes
+* to.
+* @param map
+* @param index Index of an occupied slot.
+* @return Probe distance of the slot.
+*/
+static int probeDistance(struct HashMap* map, int index)
+{
+     return slotDistance(map->table, map->capacity, index);
+}
+
+/**
+* Returns the key stored in an occupied slot, resolving the key offset when the
+* table is served from a snapshot.
+* @param map
+* @param index Index of an occupied slot.
+* @return The slot's key.
+*/
+static const char* slotKey(struct HashMap* map, int index)
+{
+     if (map->snapshotKeys != 0) {
+          return map->snapshotKeys + map->table[index].keyOffset;
+     }
+     return map->table[index].key;
+}
+
+/**
+* Returns the index of the slot of a table holding the given key, or -1 if the
+* key is not in the table. The search stops as soon as it reaches a slot that
+* is closer to its home than the key would be, since Robin Hood insertion
+* would have placed the key there.
+* @param table
+* @param capacity Number of slots in the table.
+* @param snapshotKeys Key blob the slots' key offsets point into, or NULL if
+* the slots hold key pointers.
+* @param key
+* @param length Length of the key, which need not be null terminated.
+* @param hash Mixed hash of the key.
+* @param probes Increased by the number of slots compared, unless NULL.
+* @return Slot index or -1.
+*/
+static int findSlotIn(const struct HashSlot* table, int capacity, const char* snapshotKeys,
+     const char* key, int length, unsigned int hash, int* probes)
+{
+     unsigned int mask = (unsigned int)capacity - 1;
+     int index = (int)(hash & mask);
+     int distance = 0;
+
+     while (table[index].hash != 0 && distance <= slotDistance(table, capacity, index)) {
+          /* Compare the stored hash before the key string */
+          if (table[index].hash == hash) {
+               const char* slot = snapshotKeys != 0 ? snapshotKeys + table[index].keyOffset :
+                    table[index].key;
+               if (memcmp(slot, key, length) == 0 && slot[length] == '\0') {
+                    if (probes != 0) {
+                         *probes += distance + 1;
+                    }
+                    return index;
+               }
+          }
+          index = (int)((index + 1) & mask);
+          distance++;
+     }
+
+     if (probes != 0) {
+          *probes += distance + 1;
+     }
+     return -1;
+}
+
+/**
+* Returns the index of the slot of the map's table holding the given key, or
+* -1 if the key is not in that table.
+* @param map
+* @param key
+* @param length Length of the key, which need not be null terminated.
+* @param hash Mixed hash of the key.
+* @return Slot index or -1.
+*/
+static int findSlot(struct HashMap* map, const char* key, int length, unsigned int hash)
+{
+     return findSlotIn(map->table, map->capacity, map->snapshotKeys, key, length, hash, 0);
+}
+
+/**
+* Returns the slot holding the given key in either table of the map, or NULL
+* if the key is not in the map. The old table of an incremental resize is
+* only searched when the key is not in the new one.
+* @param map
+* @param key
+* @param length Length of the key, which need not be null terminated.
+* @param hash Mixed hash of the key.
+* @param probes Increased by the number of slots compared, unless NULL.
+* @return The slot or NULL.
+*/
+static struct HashSlot* findEntry(struct HashMap* map, const char* key, int length, unsigned int hash,
+     int* probes)
+{
+     int index = findSlotIn(map->table, map->capacity, map->snapshotKeys, key, length, hash, probes);
+     if (index >= 0) {
+          return &map->table[index];
+     }
+     if (map->oldTable != 0) {
+          index = findSlotIn(map->oldTable, map->oldCapacity, 0, key, length, hash, probes);
+          if (index >= 0) {
+               return &map->oldTable[index];
+          }
+     }
+     return 0;
+}
+
+/**
+* Returns the key stored in an occupied slot of either table.
+* @param map
+* @param slot
+* @return The slot's key.
+*/
+static const char* entryKey(struct HashMap* map, const struct HashSlot* slot)
+{
+     /* A map served from a snapshot is never in the middle of a resize */
+     if (map->snapshotKeys != 0) {
+          return map->snapshotKeys + slot->keyOffset;
+     }
+     return slot->key;
+}
+
+/**
+* Returns the time in seconds from a fixed point, for timing resizes.
+* @return Seconds.
+*/
+static double statsSeconds(void)
+{
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+/**
+* Counts a lookup in the map's stats. Lookups may run on several threads at
+* once, so the counters are updated atomically.
+* @param stats
+* @param probes Number of slots the lookup compared.
+* @param found 1 if the key was in the map.
+*/
+static void countLookup(struct HashMapStats* stats, int probes, int found)
+{
+     __atomic_add_fetch(&stats->lookups, 1, __ATOMIC_RELAXED);
+     __atomic_add_fetch(found ? &stats->hits : &stats->misses, 1, __ATOMIC_RELAXED);
+     __atomic_add_fetch(&stats->probes, probes, __ATOMIC_RELAXED);
+     __atomic_add_fetch(&stats->probeHistogram[probes < HASH_MAP_PROBE_BINS - 1 ? probes :
+          HASH_MAP_PROBE_BINS - 1], 1, __ATOMIC_RELAXED);
+
+     int longest = __atomic_load_n(&stats->maxProbe, __ATOMIC_RELAXED);
+     while (probes > longest && !__atomic_compare_exchange_n(&stats->maxProbe, &longest, probes, 1,
+          __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+     }
+}
+
+/**
+* Looks a key up for hashMapGetSlice and hashMapContainsSlice: checks the
+* filter, searches the tables and counts the lookup if stats are on.
+* @param map
+* @param key
+* @param length Length of the key, which need not be null terminated.
+* @return The slot or NULL.
+*/
+static struct HashSlot* lookupEntry(struct HashMap* map, const char* key, int length)
+{
+     unsigned int hash;
+     int probes = 0;
+     struct HashSlot* slot = 0;
+
+     if (lookupHash(map, key, length, &hash)) {
+          slot = findEntry(map, key, length, hash, map->stats != 0 ? &probes : 0);
+     }
+     if (map->stats != 0) {
+          countLookup(map->stats, probes, slot != 0);
+     }
+     return slot;
+}
+
+/**
+* Places a key that is not yet in the table. Whenever the new key has probed
+* further than the key occupying a slot, the two swap and the displaced key
+* continues probing.
+* @param map
+* @param key Key string owned by the map's arena.
+* @param value
+* @param hash Mixed hash of the key.
+*/
+static void insertSlot(struct HashMap* map, const char* key, int value, unsigned int hash)
+{
+     unsigned int mask = (unsigned int)map->capacity - 1;
+     struct HashSlot slot = { hash, value, { .key = key } };
+     int index = (int)(hash & mask);
+     int distance = 0;
+
+     while (map->table[index].hash != 0) {
+          int existing = probeDistance(map, index);
+          if (existing < distance) {
+               /* Take the slot from the richer key */
+               struct HashSlot temp = map->table[index];
+               map->table[index] = slot;
+               slot = temp;
+               distance = existing;
+          }
+          index = (int)((index + 1) & mask);
+          distance++;
+     }
+
+     map->table[index] = slot;
+}
+
+/**
+* Initializes a hash table map, allocating memory for a slot table with at
+* least the given number of slots. The capacity is rounded up to a power of
+* two so that slot indices can be taken with a mask.
+* @param map
+* @param capacity The minimum number of table slots.
+*/
+void hashMapInit(struct HashMap* map, int capacity)
+{
+     int slots = 8;
+     while (slots < capacity) {
+          slots *= 2;
+     }
+
+     map->capacity = slots;
+     map->size = 0;
+     map->table = calloc(slots, sizeof(struct HashSlot));
+}
+
+/**
+* Removes all keys in the map and frees all allocated memory. The key strings
+* all live in the map's arena, so they are released in one step.
+* @param map
+*/
+void hashMapCleanUp(struct HashMap* map)
+{
+     assert(map != 0);
+
+     arenaCleanUp(&map->keys);
+     if (map->snapshotKeys == 0) {
+          free(map->table);
+     }
+     free(map->oldTable);
+     map->oldTable = 0;
+     map->oldCapacity = 0;
+     map->migrateLeft = 0;
+     if (map->filter != 0) {
+          bloomFilterDelete(map->filter);
+          map->filter = 0;
+     }
+     free(map->stats);
+     map->stats = 0;
+     fileMapClose(&map->snapshotFile);
+     free(map->lengthIndex.keys);
+     free(map->lengthIndex.signatures);
+     free(map->lengthIndex.offsets);
+     map->lengthIndex = (struct HashMapLengthIndex){ 0 };
+     map->snapshotKeys = 0;
+     map->table = 0;
+     map->size = 0;
+     map->generation++;
+}
+
+/**
+* Copies a table served from a snapshot onto the heap so that it can be
+* modified. Slot key offsets become pointers into the snapshot's key blob,
+* which stays mapped until the map is deleted.
+* @param map
+*/
+static void detachSnapshot(struct HashMap* map)
+{
+     if (map->snapshotKeys == 0) {
+          return;
+     }
+
+     struct HashSlot* table = malloc(sizeof(struct HashSlot) * map->capacity);
+     for (int i = 0; i < map->capacity; i++) {
+          table[i].hash = map->table[i].hash;
+          table[i].value = map->table[i].value;
+          table[i].key = map->table[i].hash != 0 ? slotKey(map, i) : 0;
+     }
+     map->table = table;
+     map->snapshotKeys = 0;
+}
+
+/**
+* Creates a hash table map, allocating memory for a slot table with at least
+* the given number of slots. Keys are hashed with HASH_FUNCTION.
+* @param capacity The minimum number of slots.
+* @return The allocated map.
+*/
+struct HashMap* hashMapNew(int capacity)
+{
+     return hashMapNewWithHash(capacity, HASH_FUNCTION);
+}
+
+/**
+* Creates a hash table map that hashes keys with the given function.
+* @param capacity The minimum number of slots.
+* @param hashFunction
+* @return The allocated map.
+*/
+struct HashMap* hashMapNewWithHash(int capacity, HashFunction hashFunction)
+{
+     assert(hashFunction != 0);
+     struct HashMap* map = malloc(sizeof(struct HashMap));
+     map->hashFunction = hashFunction;
+     arenaInit(&map->keys);
+     map->snapshotKeys = 0;
+     map->snapshotFile = (FileMap){ 0 };
+     map->generation = 1;
+     map->lengthIndex = (struct HashMapLengthIndex){ 0 };
+     map->oldTable = 0;
+     map->oldCapacity = 0;
+     map->migrateIndex = 0;
+     map->migrateLeft = 0;
+     map->incrementalResize = 0;
+     map->filter = 0;
+     map->stats = 0;
+     hashMapInit(map, capacity);
+     return map;
+}
+
+/**
+* Removes all keys in the map and frees all allocated memory, including the
+* map itself.
+* @param map
+*/
+void hashMapDelete(struct HashMap* map)
+{
+     hashMapCleanUp(map);
+     free(map);
+}
+
+/**
+* Copies the slots of a table into a new one of the same size, with every key
+* copied into the arena of the map that will own the table.
+* @param map Map that will own the copy.
+* @param table
+* @param capacity Number of slots in the table.
+* @param snapshotKeys Key blob the table's key offsets point into, or NULL.
+* @return The copy.
+*/
+static struct HashSlot* cloneTable(struct HashMap* map, const struct HashSlot* table, int capacity,
+     const char* snapshotKeys)
+{
+     struct HashSlot* copy = malloc(sizeof(struct HashSlot) * capacity);
+     for (int i = 0; i < capacity; i++) {
+          copy[i].hash = table[i].hash;
+          copy[i].value = table[i].value;
+          copy[i].key = 0;
+          if (table[i].hash != 0) {
+               const char* key = snapshotKeys != 0 ? snapshotKeys + table[i].keyOffset : table[i].key;
+               copy[i].key = arenaCopyString(&map->keys, key, (int)strlen(key));
+          }
+     }
+     return copy;
+}
+
+/**
+* Creates a copy of the map that shares nothing with it: the slot tables are
+* copied as they are, including an incremental resize in progress, and every
+* key is copied into the new map's arena. The copy gets a filter like the
+* map's and keeps stats if the map does, starting from zero. The map itself
+* is only read, so it may be cloned while other threads look keys up in it.
+* @param map
+* @return The copy.
+*/
+struct HashMap* hashMapClone(struct HashMap* map)
+{
+     assert(map != 0);
+
+     struct HashMap* clone = malloc(sizeof(struct HashMap));
+     clone->hashFunction = map->hashFunction;
+     arenaInit(&clone->keys);
+     clone->snapshotKeys = 0;
+     clone->snapshotFile = (FileMap){ 0 };
+     clone->generation = 1;
+     clone->lengthIndex = (struct HashMapLengthIndex){ 0 };
+     clone->table = cloneTable(clone, map->table, map->capacity, map->snapshotKeys);
+     clone->size = map->size;
+     clone->capacity = map->capacity;
+     clone->oldTable = 0;
+     clone->oldCapacity = 0;
+     if (map->oldTable != 0) {
+          clone->oldTable = cloneTable(clone, map->oldTable, map->oldCapacity, 0);
+          clone->oldCapacity = map->oldCapacity;
+     }
+     clone->migrateIndex = map->migrateIndex;
+     clone->migrateLeft = map->migrateLeft;
+     clone->incrementalResize = map->incrementalResize;
+     clone->filter = 0;
+     clone->stats = 0;
+     if (map->filter != 0) {
+          hashMapSetFilter(clone, map->filter->falsePositiveRate);
+     }
+     hashMapSetStats(clone, map->stats != 0);
+     return clone;
+}
+
+/**
+* Returns a pointer to the value stored with the given key. Returns NULL if
+* the key is not in the table. The pointer is valid until the next put or
+* remove. Lookups never move keys, even during an incremental resize, so
+* threads may look keys up at the same time as long as none changes the map.
+* @param map
+* @param key
+* @return Pointer to the value or NULL if no matching key.
+*/
+int* hashMapGet(struct HashMap* map, const char* key)
+{
+     return hashMapGetSlice(map, key, (int)strlen(key));
+}
+
+/**
+* Same as hashMapGet for a key given as a pointer and length.
+* @param map
+* @param key
+* @param length
+* @return Pointer to the value or NULL if no matching key.
+*/
+int* hashMapGetSlice(struct HashMap* map, const char* key, int length)
+{
+     /* Confirm map is created */
+     assert(map != 0);
+
+     struct HashSlot* slot = lookupEntry(map, key, length);
+     if (slot == 0) {
+          return 0;
+     }
+     return &(slot->value);
+}
+
+/**
+* Resizes the hash table to have at least the given number of slots. Every
+* key is moved into the new table as is: only the slots are reallocated, the
+* key strings are not copied.
+* @param map
+* @param capacity The new minimum number of slots.
 */
-HashLink* hashLinkNew(const char* key, int value, HashLink* next)
+void resizeTable(struct HashMap* map, int capacity)
 {
-     HashLink* link = malloc(sizeof(HashLink));
-     link->key = malloc(sizeof(char) * (strlen(key) + 1));
-     strcpy(link->key, key);
-     link->value = value;
-     link->next = next;
-     return link;
+     hashMapFinishResize(map);
+
+     double start = map->stats != 0 ? statsSeconds() : 0;
+     struct HashSlot* oldTable = map->table;
+     int oldCapacity = map->capacity;
+     int size = map->size;
+
+     hashMapInit(map, capacity);
+     map->size = size;
+
+     for (int i = 0; i < oldCapacity; i++) {
+          if (oldTable[i].hash != 0) {
+               insertSlot(map, oldTable[i].key, oldTable[i].value, oldTable[i].hash);
+          }
+     }
+
+     free(oldTable);
+     if (map->stats != 0) {
+          map->stats->resizes++;
+          map->stats->resizeSeconds += statsSeconds() - start;
+     }
 }
 
 /**
-* Free the allocated memory for a hash table link created with hashLinkNew.
-* @param link
+* Moves keys from the old table of an incremental resize into the new one.
+* At least the given number of old slots are visited, and then the rest of
+* the probe run the last one belongs to, since stopping only at an empty slot
+* leaves every probe run of the old table either whole or gone and lookups
+* there keep working. Only the slots move; the key strings stay in the arena.
+* The old table is freed once all its slots have been visited.
+* @param map
+* @param slots Minimum number of old slots to visit.
 */
-static void hashLinkDelete(HashLink* link)
+static void migrateSlots(struct HashMap* map, int slots)
 {
-     free(link->key);
-     free(link);
+     unsigned int mask = (unsigned int)map->oldCapacity - 1;
+     double start = map->stats != 0 ? statsSeconds() : 0;
+
+     while (map->migrateLeft > 0) {
+          struct HashSlot* slot = &map->oldTable[map->migrateIndex];
+          if (slot->hash == 0) {
+               if (slots <= 0) {
+                    break;
+               }
+          }
+          else {
+               insertSlot(map, slot->key, slot->value, slot->hash);
+               slot->hash = 0;
+               slot->key = 0;
+          }
+          map->migrateIndex = (int)((map->migrateIndex + 1) & mask);
+          map->migrateLeft--;
+          slots--;
+     }
+
+     if (map->migrateLeft == 0) {
+          free(map->oldTable);
+          map->oldTable = 0;
+          map->oldCapacity = 0;
+     }
+     if (map->stats != 0) {
+          map->stats->resizeSeconds += statsSeconds() - start;
+     }
+}
+
+/**
+* Starts an incremental resize: allocates a table of twice the size and keeps
+* the current one as the old table, to be emptied by later inserts and
+* removes. Keys put in the meantime go to the new table.
+* @param map
+*/
+static void startResize(struct HashMap* map)
+{
+     hashMapFinishResize(map);
+
+     double start = map->stats != 0 ? statsSeconds() : 0;
+     struct HashSlot* oldTable = map->table;
+     int oldCapacity = map->capacity;
+     int size = map->size;
+
+     hashMapInit(map, 2 * oldCapacity);
+     map->size = size;
+     map->oldTable = oldTable;
+     map->oldCapacity = oldCapacity;
+
+     /* Start at an empty slot, so no probe run is cut in two */
+     int first = 0;
+     while (oldTable[first].hash != 0) {
+          first++;
+     }
+     map->migrateIndex = first;
+     map->migrateLeft = oldCapacity;
+     if (map->stats != 0) {
+          map->stats->resizes++;
+          map->stats->resizeSeconds += statsSeconds() - start;
+     }
+}
+
+/**
+* Copies a key that is not in the table yet into the arena and inserts it,
+* growing the table first if it is too full.
+* @param map
+* @param key
+* @param length Length of the key.
+* @param hash Mixed hash of the key.
+* @param value
+* @return The map's copy of the key.
+*/
+static const char* addKey(struct HashMap* map, const char* key, int length, unsigned int hash,
+     int value)
+{
+     if (map->oldTable != 0) {
+          migrateSlots(map, RESIZE_STEP);
+     }
+
+     /* Make sure the hash map is not overloaded */
+     if (hashMapTableLoad(map) >= MAX_TABLE_LOAD) {
+          /* If overloaded - resize */
+          if (map->incrementalResize) {
+               startResize(map);
+          }
+          else {
+               resizeTable(map, 2 * (map->capacity));
+          }
+     }
+
+     const char* copy = arenaCopyString(&map->keys, key, length);
+     insertSlot(map, copy, value, hash);
+     if (map->filter != 0) {
+          bloomFilterAdd(map->filter, hashFunctionWy64(key, length));
+     }
+     map->size++;
+     map->generation++;
+     return copy;
+}
+
+/**
+* Updates the given key-value pair in the hash table. If the key already
+* exists, this will just update the value. Otherwise, a copy of the key is
+* inserted with the given value.
+* @param map
+* @param key
+* @param value
+*/
+void hashMapPut(struct HashMap* map, const char* key, int value)
+{
+     hashMapPutSlice(map, key, (int)strlen(key), value);
+}
+
+/**
+* Same as hashMapPut for a key given as a pointer and length. The key does not
+* need to be null terminated, so it can point straight into a file buffer.
+* @param map
+* @param key
+* @param length
+* @param value
+*/
+void hashMapPutSlice(struct HashMap* map, const char* key, int length, int value)
+{
+     /* Confirm map is implemented */
+     assert(map != 0);
+
+     detachSnapshot(map);
+     unsigned int hash = hashKey(map, key, length);
+
+     /* Match - update the value */
+     struct HashSlot* slot = findEntry(map, key, length, hash, 0);
+     if (slot != 0) {
+          slot->value = value;
+          return;
+     }
+
+     /* No match - insert a copy of the key */
+     addKey(map, key, length, hash, value);
+}
+
+/**
+* Grows the table so that the given number of keys fit without another
+* resize.
+* @param map
+* @param keys Total number of keys the map will hold.
+*/
+void hashMapReserve(struct HashMap* map, int keys)
+{
+     assert(map != 0);
+
+     int capacity = map->capacity;
+     while (keys - 1 >= capacity * MAX_TABLE_LOAD) {
+          capacity *= 2;
+     }
+     if (capacity != map->capacity) {
+          detachSnapshot(map);
+          resizeTable(map, capacity);
+     }
+}
+
+/**
+* Turns incremental resizing on or off. When it is on, a full table is not
+* rehashed in one go: a table of twice the size is allocated and every later
+* insert or remove moves the keys of RESIZE_STEP or so old slots into it,
+* while lookups search both tables. No single put then pays for moving every
+* key. Turning it off finishes a resize in progress.
+* @param map
+* @param enabled 1 to resize incrementally, 0 to resize all at once.
+*/
+void hashMapSetIncrementalResize(struct HashMap* map, int enabled)
+{
+     assert(map != 0);
+
+     map->incrementalResize = enabled;
+     if (!enabled) {
+          hashMapFinishResize(map);
+     }
+}
+
+/**
+* Moves every key left in the old table of an incremental resize into the
+* new table. Walking the slots with hashMapKeyAt, building the length index
+* and writing a snapshot all do this first; call it before sharing the map
+* between threads if anything might do so while they look keys up.
+* @param map
+*/
+void hashMapFinishResize(struct HashMap* map)
+{
+     assert(map != 0);
+
+     if (map->oldTable != 0) {
+          migrateSlots(map, map->migrateLeft);
+     }
+}
+
+/* Smallest partition of the table worth giving its own task */
+#define BULK_MIN_PARTITION 4096
+
+/* Keys that did not fit in their partition during a bulk build */
+typedef struct BulkOverflow
+{
+     struct HashSlot* slots;
+     int count;
+     int capacity;
+} BulkOverflow;
+
+/* Shared state of a parallel hashMapPutAll */
+typedef struct BulkBuild
+{
+     struct HashMap* map;
+     const char* const* keys;
+     const int* lengths;
+     int count;
+     int value;
+     unsigned int* hashes;
+     // The keys are cut into slices for hashing and sorting.
+     int slices;
+     int sliceSize;
+     // The table is cut into partitions of 1 << shift slots each.
+     int partitions;
+     int shift;
+     // Keys of each slice in each partition, counts[slice * partitions +
+     // partition], turned into positions in order by the sort.
+     int* counts;
+     // Key numbers sorted by partition, in their original order within one.
+     int* order;
+     // Start of each partition in order, and one past the last.
+     int* starts;
+     // One arena per worker for key copies.
+     Arena* arenas;
+     BulkOverflow* overflow;
+     // Change in the number of keys in the table, per partition.
+     int* added;
+} BulkBuild;
+
+/**
+* Returns the partition a hash's home slot lies in.
+* @param build
+* @param hash
+* @return Partition number.
+*/
+static int bulkPartition(BulkBuild* build, unsigned int hash)
+{
+     return (int)((hash & ((unsigned int)build->map->capacity - 1)) >> build->shift);
+}
+
+/**
+* Hashes one slice of the keys and counts how many fall in each partition.
+* @param context The BulkBuild.
+* @param slice
+* @param worker
+*/
+static void bulkHashSlice(void* context, int slice, int worker)
+{
+     BulkBuild* build = context;
+     int* counts = build->counts + slice * build->partitions;
+     int end = (slice + 1) * build->sliceSize < build->count ? (slice + 1) * build->sliceSize : build->count;
+     (void)worker;
+
+     for (int i = slice * build->sliceSize; i < end; i++) {
+          build->hashes[i] = hashKey(build->map, build->keys[i], build->lengths[i]);
+          counts[bulkPartition(build, build->hashes[i])]++;
+     }
+}
+
+/**
+* Places the key numbers of one slice at their positions in the sorted order.
+* @param context The BulkBuild.
+* @param slice
+* @param worker
+*/
+static void bulkSortSlice(void* context, int slice, int worker)
+{
+     BulkBuild* build = context;
+     int* next = build->counts + slice * build->partitions;
+     int end = (slice + 1) * build->sliceSize < build->count ? (slice + 1) * build->sliceSize : build->count;
+     (void)worker;
+
+     for (int i = slice * build->sliceSize; i < end; i++) {
+          build->order[next[bulkPartition(build, build->hashes[i])]++] = i;
+     }
+}
+
+/**
+* Sets a slot aside for the fix-up pass.
+* @param overflow
+* @param slot
+*/
+static void bulkDefer(BulkOverflow* overflow, struct HashSlot slot)
+{
+     if (overflow->count == overflow->capacity) {
+          overflow->capacity = overflow->capacity > 0 ? overflow->capacity * 2 : 16;
+          overflow->slots = realloc(overflow->slots, sizeof(struct HashSlot) * overflow->capacity);
+     }
+     overflow->slots[overflow->count++] = slot;
+}
+
+/**
+* Puts the keys of one partition, probing and displacing like findSlot and
+* insertSlot but never past the end of the partition, so partitions can be
+* filled at the same time. A key whose probe reaches the end of the partition,
+* or that is displaced past it, is set aside for the fix-up pass.
+* @param context The BulkBuild.
+* @param partition
+* @param worker Selects the arena the keys are copied into.
+*/
+static void bulkFillPartition(void* context, int partition, int worker)
+{
+     BulkBuild* build = context;
+     struct HashMap* map = build->map;
+     Arena* arena = &build->arenas[worker];
+     BulkOverflow* overflow = &build->overflow[partition];
+     int end = (partition + 1) << build->shift;
+
+     for (int k = build->starts[partition]; k < build->starts[partition + 1]; k++) {
+          int i = build->order[k];
+          const char* key = build->keys[i];
+          int length = build->lengths[i];
+          unsigned int hash = build->hashes[i];
+          int index = (int)(hash & ((unsigned int)map->capacity - 1));
+          int distance = 0;
+          int updated = 0;
+
+          /* Match - update the value */
+          while (index < end && map->table[index].hash != 0 && distance <= probeDistance(map, index)) {
+               if (map->table[index].hash == hash && memcmp(map->table[index].key, key, length) == 0 &&
+                    map->table[index].key[length] == '\0') {
+                    map->table[index].value = build->value;
+                    updated = 1;
+                    break;
+               }
+               index++;
+               distance++;
+          }
+          if (updated) {
+               continue;
+          }
+
+          struct HashSlot slot = { hash, build->value, { .key = arenaCopyString(arena, key, length) } };
+          if (index == end) {
+               bulkDefer(overflow, slot);
+               continue;
+          }
+
+          /* No match - insert, taking slots from richer keys */
+          build->added[partition]++;
+          while (map->table[index].hash != 0) {
+               int existing = probeDistance(map, index);
+               if (existing < distance) {
+                    struct HashSlot temp = map->table[index];
+                    map->table[index] = slot;
+                    slot = temp;
+                    distance = existing;
+               }
+               index++;
+               distance++;
+               if (index == end) {
+                    break;
+               }
+          }
+          if (index == end) {
+               /* The key left holding the slot is out of the table for now */
+               build->added[partition]--;
+               bulkDefer(overflow, slot);
+          }
+          else {
+               map->table[index] = slot;
+          }
+     }
+}
+
+/**
+* Puts many keys with the same value at once. The table is grown to its final
+* size first, so nothing is rehashed while the keys go in. With a pool of more
+* than one thread the keys are hashed in parallel, sorted by the partition of
+* the table their home slot lies in, and each partition is filled by one
+* task. Keys that would probe past the end of their partition are inserted
+* one by one afterwards. The result is a valid table, though slots holding
+* keys with equal probe distances may be ordered differently than one-by-one
+* puts would leave them.
+* @param map
+* @param keys Keys, which need not be null terminated.
+* @param lengths Length of each key.
+* @param count Number of keys.
+* @param value Value for every key.
+* @param pool Threads to build with, or NULL.
+*/
+void hashMapPutAll(struct HashMap* map, const char* const* keys, const int* lengths, int count,
+     int value, ThreadPool* pool)
+{
+     assert(map != 0);
+
+     detachSnapshot(map);
+     hashMapFinishResize(map);
+     hashMapReserve(map, map->size + count);
+
+     int workers = pool != 0 ? threadPoolSize(pool) : 1;
+     int partitions = 1;
+     while (partitions < 8 * workers && map->capacity / (partitions * 2) >= BULK_MIN_PARTITION) {
+          partitions *= 2;
+     }
+     if (workers == 1 || partitions == 1) {
+          for (int i = 0; i < count; i++) {
+               hashMapPutSlice(map, keys[i], lengths[i], value);
+          }
+          return;
+     }
+
+     BulkBuild build;
+     build.map = map;
+     build.keys = keys;
+     build.lengths = lengths;
+     build.count = count;
+     build.value = value;
+     build.hashes = malloc(sizeof(unsigned int) * (count + 1));
+     build.slices = 4 * workers;
+     build.sliceSize = (count + build.slices - 1) / build.slices;
+     build.partitions = partitions;
+     build.shift = 0;
+     while ((partitions << build.shift) < map->capacity) {
+          build.shift++;
+     }
+     build.counts = calloc((size_t)build.slices * partitions, sizeof(int));
+     build.order = malloc(sizeof(int) * (count + 1));
+     build.starts = malloc(sizeof(int) * (partitions + 1));
+     build.arenas = malloc(sizeof(Arena) * workers);
+     for (int i = 0; i < workers; i++) {
+          arenaInit(&build.arenas[i]);
+     }
+     build.overflow = calloc(partitions, sizeof(BulkOverflow));
+     build.added = calloc(partitions, sizeof(int));
+
+     /* Hash, then sort by partition */
+     threadPoolRun(pool, bulkHashSlice, &build, build.slices);
+     int position = 0;
+     for (int p = 0; p < partitions; p++) {
+          build.starts[p] = position;
+          for (int slice = 0; slice < build.slices; slice++) {
+               int keysHere = build.counts[slice * partitions + p];
+               build.counts[slice * partitions + p] = position;
+               position += keysHere;
+          }
+     }
+     build.starts[partitions] = position;
+     threadPoolRun(pool, bulkSortSlice, &build, build.slices);
+
+     /* Fill the partitions side by side */
+     threadPoolRun(pool, bulkFillPartition, &build, partitions);
+     for (int i = 0; i < workers; i++) {
+          arenaAppend(&map->keys, &build.arenas[i]);
+     }
+
+     /* Fix up the keys that did not fit */
+     for (int p = 0; p < partitions; p++) {
+          map->size += build.added[p];
+          for (int i = 0; i < build.overflow[p].count; i++) {
+               struct HashSlot* slot = &build.overflow[p].slots[i];
+               int index = findSlot(map, slot->key, (int)strlen(slot->key), slot->hash);
+               if (index >= 0) {
+                    map->table[index].value = slot->value;
+               }
+               else {
+                    insertSlot(map, slot->key, slot->value, slot->hash);
+                    map->size++;
+               }
+          }
+          free(build.overflow[p].slots);
+     }
+     if (map->filter != 0) {
+          for (int i = 0; i < count; i++) {
+               bloomFilterAdd(map->filter, hashFunctionWy64(keys[i], lengths[i]));
+          }
+     }
+     map->generation++;
+
+     free(build.added);
+     free(build.overflow);
+     free(build.arenas);
+     free(build.starts);
+     free(build.order);
+     free(build.counts);
+     free(build.hashes);
+}
+
+/**
+* Returns the map's own copy of the given key, adding the key with value 0 if
+* it is not in the table yet. The returned string stays valid until the map is
+* deleted, even if the key is removed, so callers can hold on to it and
+* compare interned strings by pointer.
+* @param map
+* @param key
+* @return Interned copy of the key.
+*/
+const char* hashMapIntern(struct HashMap* map, const char* key)
+{
+     assert(map != 0);
+
+     int length = (int)strlen(key);
+     unsigned int hash = hashKey(map, key, length);
+
+     struct HashSlot* slot = findEntry(map, key, length, hash, 0);
+     if (slot != 0) {
+          return entryKey(map, slot);
+     }
+     detachSnapshot(map);
+     return addKey(map, key, length, hash, 0);
 }
 
 /**
-* Initializes a hash table map, allocating memory for a link pointer table with
-* the given number of buckets.
+* Returns the map's own copy of the given key without adding it. The returned
+* string is null terminated and stays valid until the map is deleted, as for
+* hashMapIntern.
 * @param map
-* @param capacity The number of table buckets.
+* @param key
+* @param length Length of the key, which need not be null terminated.
+* @return The map's copy of the key, or NULL if the key is not in the map.
 */
-void hashMapInit(struct HashMap* map, int capacity)
+const char* hashMapFindSlice(struct HashMap* map, const char* key, int length)
 {
-     map->capacity = capacity;
-     map->size = 0;
-     map->table = malloc(sizeof(HashLink*) * capacity);
-     for (int i = 0; i < capacity; i++)
-     {
-          map->table[i] = NULL;
+     assert(map != 0);
+
+     struct HashSlot* slot = lookupEntry(map, key, length);
+     if (slot == 0) {
+          return 0;
      }
+     return entryKey(map, slot);
 }
 
 /**
-* Removes all links in the map and frees all allocated memory. You can use
-* hashLinkDelete to free the links.
+* Removes the key from the table. If no such key exists, this does nothing.
+* The keys following it in its probe run are shifted back one slot, so no
+* tombstones are left behind. The key's bytes stay in the arena until the map
+* is deleted.
 * @param map
+* @param key
 */
-void hashMapCleanUp(struct HashMap* map)
+void hashMapRemove(struct HashMap* map, const char* key)
 {
-     // FIXME: implement
+     /* Confirm map is not empty */
      assert(map != 0);
+     assert(map->size > 0);
 
-     /* Loop through dyn array */
-     for (int i = 0; i < map->capacity; i++) {
-          /* Get first link */
-          struct HashLink * currentLink = map->table[i];
-          map->table[i] = 0;
-          /* If there are more links in this bucket */
-          while (currentLink != 0) {
-               /* Loop through linked list */
-               struct HashLink * temp = currentLink;
-               currentLink = currentLink->next;
-               /* Free current link */
-               hashLinkDelete(temp);
-          }
-          free(map->table[i]);
+     int length = (int)strlen(key);
+     unsigned int hash = hashKey(map, key, length);
+     struct HashSlot* table = map->table;
+     int capacity = map->capacity;
+     int index = findSlot(map, key, length, hash);
+     if (index >= 0) {
+          detachSnapshot(map);
+          table = map->table;
+     }
+     else if (map->oldTable != 0) {
+          /* The key has not been moved by the resize yet */
+          table = map->oldTable;
+          capacity = map->oldCapacity;
+          index = findSlotIn(table, capacity, 0, key, length, hash, 0);
+     }
+     if (index < 0) {
+          return;
+     }
+
+     /* Shift back until an empty slot or a key at its home slot */
+     unsigned int mask = (unsigned int)capacity - 1;
+     int next = (int)((index + 1) & mask);
+     while (table[next].hash != 0 && slotDistance(table, capacity, next) > 0) {
+          table[index] = table[next];
+          index = next;
+          next = (int)((next + 1) & mask);
+     }
+     table[index].hash = 0;
+     table[index].key = 0;
+
+     /* Decrement size of map */
+     map->size--;
+     map->generation++;
+
+     if (map->oldTable != 0) {
+          migrateSlots(map, RESIZE_STEP);
      }
-     free(map->table);
 }
 
 /**
-* Creates a hash table map, allocating memory for a link pointer table with
-* the given number of buckets.
-* @param capacity The number of buckets.
-* @return The allocated map.
+* Returns 1 if the given key is in the table and 0 otherwise.
+* @param map
+* @param key
+* @return 1 if the key is found, 0 otherwise.
 */
-struct HashMap* hashMapNew(int capacity)
+int hashMapContainsKey(struct HashMap* map, const char* key)
 {
-     struct HashMap* map = malloc(sizeof(struct HashMap));
-     hashMapInit(map, capacity);
-     return map;
+     return hashMapContainsSlice(map, key, (int)strlen(key));
 }
 
 /**
-* Removes all links in the map and frees all allocated memory, including the
-* map itself.
+* Same as hashMapContainsKey for a key given as a pointer and length.
 * @param map
+* @param key
+* @param length
+* @return 1 if the key is found, 0 otherwise.
 */
-void hashMapDelete(struct HashMap* map)
+int hashMapContainsSlice(struct HashMap* map, const char* key, int length)
 {
-     hashMapCleanUp(map);
-     free(map);
+     /* Confirm map is not empty */
+     assert(map != 0);
+
+     return lookupEntry(map, key, length) != 0;
 }
 
 /**
-* Returns a pointer to the value of the link with the given key. Returns NULL
-* if no link with that key is in the table.
-*
-* Use HASH_FUNCTION(key) and the map's capacity to find the index of the
-* correct linked list bucket. Also make sure to search the entire list.
-*
+* Returns the mixed hash the map uses for the given key. The key's home slot
+* is this hash masked by (capacity - 1).
 * @param map
 * @param key
-* @return Link value or NULL if no matching link.
+* @return Hash of the key.
 */
-int* hashMapGet(struct HashMap* map, const char* key)
+unsigned int hashMapHash(struct HashMap* map, const char* key)
 {
-     // FIXME: implement
-     /* Confirm map is created */
      assert(map != 0);
+     return hashKey(map, key, (int)strlen(key));
+}
 
-     /* Get hash index for key */
-     int hashIndex = HASH_FUNCTION(key) % (map->capacity);
+/**
+* Returns the key stored in the given slot, or NULL if the slot is empty.
+* Together with hashMapCapacity this allows walking every key in the map. The
+* map must not be in the middle of an incremental resize, since keys in the
+* old table have no slot number yet; see hashMapFinishResize.
+* @param map
+* @param index Slot index from 0 to capacity - 1.
+* @return The key or NULL.
+*/
+const char* hashMapKeyAt(struct HashMap* map, int index)
+{
+     assert(map != 0);
+     assert(map->oldTable == 0);
+     assert(index >= 0 && index < map->capacity);
 
-     /* Get first link in bucket */
-     struct HashLink *myNode = map->table[hashIndex];
+     if (map->table[index].hash == 0) {
+          return 0;
+     }
+     return slotKey(map, index);
+}
 
-     while (myNode != 0) {
-          /* This link has a matching key */
-          if (strcmp(myNode->key, key) == 0) {
-               /* Return the value */
-               return &(myNode->value);
+/**
+* Returns the letter set of a key: bit c - 'a' for each letter c, ignoring
+* case, and one of bits 26 to 31 for any other byte. Two words whose
+* signatures differ in n bits one way need at least n edits to turn one into
+* the other, since every edit introduces at most one new byte.
+* @param key
+* @param length
+* @return Signature of the key.
+*/
+unsigned int hashMapSignature(const char* key, int length)
+{
+     unsigned int signature = 0;
+     for (int i = 0; i < length; i++) {
+          unsigned char c = (unsigned char)key[i] | 0x20;
+          if (c >= 'a' && c <= 'z') {
+               signature |= 1u << (c - 'a');
           }
-          /* Not a match */
           else {
-               /* Move to next link */
-               myNode = myNode->next;
+               signature |= 1u << (26 + (unsigned char)key[i] % 6);
           }
      }
+     return signature;
+}
 
-     return 0;
+/**
+* Returns a lower bound on the Levenshtein distance between two words with
+* the given signatures.
+* @param a
+* @param b
+* @return Lower bound on the distance.
+*/
+int hashMapSignatureDistance(unsigned int a, unsigned int b)
+{
+     int added = __builtin_popcount(b & ~a);
+     int removed = __builtin_popcount(a & ~b);
+     return added > removed ? added : removed;
 }
 
 /**
-* Resizes the hash table to have a number of buckets equal to the given
-* capacity. After allocating the new table, all of the links need to be
-* rehashed into it because the capacity has changed.
-*
-* Remember to free the old table and any old links if you use hashMapPut to
-* rehash them.
-*
+* Rebuilds the length index from the table: counts the keys of each length,
+* then places every key after the keys shorter than it.
 * @param map
-* @param capacity The new number of buckets.
 */
-/* Source: https://github.com/moogalin/CS261-HashTables/blob/master/hashMap.c */
-/* Source: http://dl.interfaceware.com/oss/git/v2.6.3/hashmap.c */
-void resizeTable(struct HashMap* map, int capacity)
+static void buildLengthIndex(struct HashMap* map)
 {
-     struct HashLink ** h = map->table;
-     int i;
+     struct HashMapLengthIndex* index = &map->lengthIndex;
+     int* lengths = malloc(sizeof(int) * (map->size + 1));
+     int maxLength = 0;
+     int count = 0;
 
-     int oldSize = map->capacity;
-
-     hashMapInit(map, capacity);
-
-     for (i = 0; i < oldSize; i++) {
-          struct HashLink * currentLink = h[i];
-
-          while (currentLink) {
-               hashMapPut(map, currentLink->key, currentLink->value);
-               currentLink = currentLink->next;
+     for (int i = 0; i < map->capacity; i++) {
+          if (map->table[i].hash != 0) {
+               int length = (int)strlen(slotKey(map, i));
+               if (length > maxLength) {
+                    maxLength = length;
+               }
+               lengths[count++] = length;
           }
      }
 
-     /* Clean up hash map */
-     for (int i = 0; i < oldSize; i++) {
-          struct HashLink * garbage = h[i];
-          h[i] = 0;
+     free(index->keys);
+     free(index->signatures);
+     free(index->offsets);
+     index->keys = malloc(sizeof(const char*) * (count + 1));
+     index->signatures = malloc(sizeof(unsigned int) * (count + 1));
+     index->offsets = calloc(maxLength + 2, sizeof(int));
+     index->maxLength = maxLength;
 
-          while (garbage != 0) {
-               struct HashLink * temp = garbage;
-               garbage = garbage->next;
-               hashLinkDelete(temp);
-          }
+     for (int i = 0; i < count; i++) {
+          index->offsets[lengths[i] + 1]++;
+     }
+     for (int length = 0; length <= maxLength; length++) {
+          index->offsets[length + 1] += index->offsets[length];
+     }
 
-          free(h[i]);
+     /* Fill each length in slot order, using the next free position of each */
+     int* next = malloc(sizeof(int) * (maxLength + 1));
+     memcpy(next, index->offsets, sizeof(int) * (maxLength + 1));
+     count = 0;
+     for (int i = 0; i < map->capacity; i++) {
+          if (map->table[i].hash != 0) {
+               int position = next[lengths[count]]++;
+               index->keys[position] = slotKey(map, i);
+               index->signatures[position] = hashMapSignature(index->keys[position], lengths[count]);
+               count++;
+          }
      }
 
-     free(h);
+     free(next);
+     free(lengths);
+     index->generation = map->generation;
 }
 
 /**
-* Updates the given key-value pair in the hash table. If a link with the given
-* key already exists, this will just update the value. Otherwise, it will
-* create a new link with the given key and value and add it to the table
-* bucket's linked list. You can use hashLinkNew to create the link.
-*
-* Use HASH_FUNCTION(key) and the map's capacity to find the index of the
-* correct linked list bucket. Also make sure to search the entire list.
-*
+* Returns the map's keys grouped by length, rebuilding the index first if
+* keys were added or removed since it was last built. The index stays valid
+* until the next put of a new key or remove. Building it is not thread safe,
+* so a map shared between threads should have it built before they start.
 * @param map
-* @param key
-* @param value
+* @return The length index.
 */
-/* Source: https://github.com/100timesforever/CS261-assignment6/blob/master/hashMap.c */
-void hashMapPut(struct HashMap* map, const char* key, int value)
+const struct HashMapLengthIndex* hashMapLengthIndex(struct HashMap* map)
 {
-     // FIXME: implement
-     /* Confirm map is implemented */
      assert(map != 0);
 
-     /* Make sure the hash map is not overloaded */
-     if (hashMapTableLoad(map) >= MAX_TABLE_LOAD) {
-          /* If overloaded - resize */
-          resizeTable(map, 2 * (map->capacity));
-     }
-
-     /* Get index location of hash map */
-     int hashIndex = HASH_FUNCTION(key) % (map->capacity);
-     if (hashIndex < 0) {
-          hashIndex += map->capacity;
+     if (map->lengthIndex.generation != map->generation) {
+          hashMapFinishResize(map);
+          buildLengthIndex(map);
      }
+     return &map->lengthIndex;
+}
 
-     /* If bucket is not empty */
-     if (map->table[hashIndex] != 0) {
-          struct HashLink * currentLink = map->table[hashIndex];
-          /* If not a match, move to next */
-          while (strcmp(currentLink->key, key) != 0 && currentLink->next != 0) {
-               currentLink = currentLink->next;
-          }
-          /* No match */
-          if (currentLink->next == 0 && strcmp(currentLink->key, key) != 0) {
-               /* Create new node */
-               struct HashLink * newLink = hashLinkNew(key, value, map->table[hashIndex]);
-               map->table[hashIndex] = newLink;
-               map->size++;
-          }
-          /* Match */
-          else {
-               currentLink->value = value;
+/**
+* Returns the keys of the given length and their signatures.
+* @param map
+* @param length
+* @param keys Set to the first key of that length.
+* @param signatures Set to the signature of the first key, or NULL.
+* @return Number of keys of that length.
+*/
+int hashMapKeysOfLength(struct HashMap* map, int length, const char* const** keys,
+     const unsigned int** signatures)
+{
+     const struct HashMapLengthIndex* index = hashMapLengthIndex(map);
+     if (length < 0 || length > index->maxLength) {
+          *keys = index->keys;
+          if (signatures != 0) {
+               *signatures = index->signatures;
           }
+          return 0;
      }
 
-     /* Bucket is empty */
-     else {
-          /* Create new node */
-          struct HashLink * newLink = hashLinkNew(key, value, 0);
-          map->table[hashIndex] = newLink;
-          map->size++;
+     int start = index->offsets[length];
+     *keys = index->keys + start;
+     if (signatures != 0) {
+          *signatures = index->signatures + start;
      }
+     return index->offsets[length + 1] - start;
 }
 
 /**
-* Removes and frees the link with the given key from the table. If no such link
-* exists, this does nothing. Remember to search the entire linked list at the
-* bucket. You can use hashLinkDelete to free the link.
+* Builds a filter of the map's keys, replacing any it had, and consults it
+* before the table on every lookup, so most lookups of absent keys never
+* touch the table. Keys added later are added to the filter as well; keys
+* removed stay in it, which only costs false positives. The filter is sized
+* for the keys the map holds now and grows less accurate past that.
 * @param map
-* @param key
+* @param falsePositiveRate Rate of absent keys the filter lets through, or 0
+* to remove the filter.
 */
-/* Source: http://www.sanfoundry.com/c-program-implement-hash-tables-chaining-with-singly-linked-lists/ */
-void hashMapRemove(struct HashMap* map, const char* key)
+void hashMapSetFilter(struct HashMap* map, double falsePositiveRate)
 {
-     // FIXME: implement
-     /* Confirm map is not empty */
      assert(map != 0);
-     assert(map->size > 0);
 
-     /* Find hash index for key */
-     int hashIndex = HASH_FUNCTION(key) % map->capacity;
-
-     /* Get head link of bucket */
-     struct HashLink * currentLink, *headLink, *hashLink;
-     headLink = hashLink = currentLink = map->table[hashIndex];
-
-     /* Loop through list until end or found key */
-     while (currentLink != 0) {
-          if (strcmp(currentLink->key, key) == 0) {
-               /* If head of list */
-               if (headLink == currentLink) {
-                    /* Change head of list */
-                    headLink = currentLink->next;
-                    map->table[hashIndex] = headLink;
-               }
-               else {
-                    /* Unlink */
-                    hashLink->next = currentLink->next;
-               }
+     if (map->filter != 0) {
+          bloomFilterDelete(map->filter);
+          map->filter = 0;
+     }
+     if (falsePositiveRate <= 0) {
+          return;
+     }
 
-               /* Free memory */
-               hashLinkDelete(currentLink);
-               /* Decrement size of map */
-               map->size--;
-               currentLink = 0;
-          }
-          /* Key was not a match */
-          else {
-               /* Move to next node */
-               hashLink = currentLink;
-               currentLink = currentLink->next;
+     hashMapFinishResize(map);
+     BloomFilter* filter = bloomFilterNew(map->size, falsePositiveRate);
+     for (int i = 0; i < map->capacity; i++) {
+          if (map->table[i].hash != 0) {
+               const char* key = slotKey(map, i);
+               bloomFilterAdd(filter, hashFunctionWy64(key, (int)strlen(key)));
           }
      }
+     map->filter = filter;
 }
 
 /**
-* Returns 1 if a link with the given key is in the table and 0 otherwise.
-*
-* Use HASH_FUNCTION(key) and the map's capacity to find the index of the
-* correct linked list bucket. Also make sure to search the entire list.
-*
+* Returns the map's filter, for its statistics.
 * @param map
-* @param key
-* @return 1 if the key is found, 0 otherwise.
+* @return The filter or NULL.
 */
-int hashMapContainsKey(struct HashMap* map, const char* key)
+BloomFilter* hashMapFilter(struct HashMap* map)
+{
+     assert(map != 0);
+     return map->filter;
+}
+
+/**
+* Turns the map's stats on or off. While they are on, every lookup is counted
+* and timed resizes are added up; turning them on again starts from zero.
+* Lookups count with atomic adds on shared counters, so stats cost some
+* speed when many threads look keys up at once.
+* @param map
+* @param enabled 1 to keep stats, 0 to stop.
+*/
+void hashMapSetStats(struct HashMap* map, int enabled)
 {
-     // FIXME: implement
-     /* Confirm map is not empty */
      assert(map != 0);
 
-     /* Get hash index of key */
-     int hashIndex = HASH_FUNCTION(key) % (map->capacity);
+     free(map->stats);
+     map->stats = enabled ? calloc(1, sizeof(struct HashMapStats)) : 0;
+}
 
-     /* Get pointer to head of list */
-     struct HashLink * currentLink = map->table[hashIndex];
+/**
+* Copies the map's stats, all zero if they are off, and works out the bytes
+* the map has allocated.
+* @param map
+* @param stats Filled in with the counters.
+*/
+void hashMapGetStats(struct HashMap* map, struct HashMapStats* stats)
+{
+     assert(map != 0);
 
-     /* List is empty */
-     if (!currentLink) {
-          return 0;
+     if (map->stats != 0) {
+          *stats = *map->stats;
+     }
+     else {
+          memset(stats, 0, sizeof(struct HashMapStats));
      }
 
-     /* Loop through list */
-     while (currentLink != 0) {
-          /* Check if match */
-          if (strcmp(currentLink->key, key) == 0) {
-               return 1;
-          }
-          /* Move to next link */
-          else {
-               currentLink = currentLink->next;
-          }
+     size_t bytes = sizeof(struct HashMap) + map->keys.bytesReserved;
+     if (map->snapshotKeys == 0) {
+          bytes += sizeof(struct HashSlot) * (size_t)map->capacity;
+     }
+     bytes += sizeof(struct HashSlot) * (size_t)map->oldCapacity;
+     const struct HashMapLengthIndex* index = &map->lengthIndex;
+     if (index->offsets != 0) {
+          int count = index->offsets[index->maxLength + 1];
+          bytes += (sizeof(const char*) + sizeof(unsigned int)) * (size_t)(count + 1) +
+               sizeof(int) * (size_t)(index->maxLength + 2);
      }
+     if (map->filter != 0) {
+          bytes += bloomFilterMemory(map->filter);
+     }
+     stats->bytes = bytes;
+}
 
-     /* Key was not found in list */
-     return 0;
+/**
+* Prints the map's size and stats, with a histogram of the lookups' probe
+* lengths.
+* @param map
+* @param out
+*/
+void hashMapPrintStats(struct HashMap* map, FILE* out)
+{
+     struct HashMapStats stats;
+     hashMapGetStats(map, &stats);
+
+     fprintf(out, "Hash map: %d keys, %d slots, load %.3f, %.1f KB\n", map->size, map->capacity,
+          hashMapTableLoad(map), (double)stats.bytes / 1024);
+     fprintf(out, "Lookups: %lld (%lld hits, %lld misses), mean probe length %.3f, "
+          "max probe length %d\n", stats.lookups, stats.hits, stats.misses,
+          stats.lookups > 0 ? (double)stats.probes / stats.lookups : 0.0, stats.maxProbe);
+     fprintf(out, "Resizes: %d in %f seconds\n", stats.resizes, stats.resizeSeconds);
+     fprintf(out, "%8s %12s\n", "length", "lookups");
+     for (int i = 0; i < HASH_MAP_PROBE_BINS; i++) {
+          fprintf(out, "%7d%s %12lld\n", i, i == HASH_MAP_PROBE_BINS - 1 ? "+" : " ",
+               stats.probeHistogram[i]);
+     }
 }
 
 /**
-* Returns the number of links in the table.
+* Returns the number of keys in the table.
 * @param map
-* @return Number of links in the table.
+* @return Number of keys in the table.
 */
 int hashMapSize(struct HashMap* map)
 {
-     // FIXME: implement
      assert(map != 0);
      return(map->size);
 }
 
 /**
-* Returns the number of buckets in the table.
+* Returns the map's generation, which changes whenever a key is added or
+* removed. Anything derived from the keys can compare it with the generation
+* it was built for to tell whether it is stale.
+* @param map
+* @return Generation of the map.
+*/
+unsigned int hashMapGeneration(struct HashMap* map)
+{
+     assert(map != 0);
+     return map->generation;
+}
+
+/**
+* Returns the number of slots in the table. During an incremental resize this
+* is the size of the table the keys are moving into.
 * @param map
-* @return Number of buckets in the table.
+* @return Number of slots in the table.
 */
 int hashMapCapacity(struct HashMap* map)
 {
-     // FIXME: implement
      assert(map != 0);
      return(map->capacity);
 }
 
 /**
-* Returns the number of table buckets without any links.
+* Returns the number of table slots without a key. Every key has a slot of
+* its own, so once any resize is done this is the capacity less the size.
 * @param map
-* @return Number of empty buckets.
+* @return Number of empty slots.
 */
 int hashMapEmptyBuckets(struct HashMap* map)
 {
-     // FIXME: implement
      /* Confirm map is implemented */
      assert(map != 0);
+     hashMapFinishResize(map);
 
-     int bucketCounter = 0;
-
-     for (int i = 0; i < map->capacity; i++) {
-          /* If bucket is empty */
-          if (map->table[i] == 0) {
-               bucketCounter++;
-          }
-     }
-
-     return bucketCounter;
+     return map->capacity - map->size;
 }
 
 /**
-* Returns the ratio of (number of links) / (number of buckets) in the table.
-* Remember that the buckets are linked lists, so this ratio tells you nothing
-* about the number of empty buckets. Remember also that the load is a floating
-* point number, so don't do integer division.
+* Returns the ratio of (number of keys) / (number of slots) in the table.
+* With open addressing this is the fraction of slots in use, and it never
+* exceeds MAX_TABLE_LOAD.
 * @param map
 * @return Table load.
 */
 float hashMapTableLoad(struct HashMap* map)
 {
-     // FIXME: implement
      /* Confirm map is implemented */
      assert(map != 0);
 
-     /* Get number of buckets and number of links */
+     /* Get number of slots and number of keys */
      float buckets = (float)hashMapCapacity(map);
      float links = (float)hashMapSize(map);
 
-     /* Get ratio of links to buckets */
+     /* Get ratio of keys to slots */
      float load = links / buckets;
 
      return load;
 }
 
 /**
-* Prints all the links in each of the buckets in the table.
+* Prints all the keys in the table with their slot and probe distance.
 * @param map
 */
 void hashMapPrint(struct HashMap* map)
 {
+     hashMapFinishResize(map);
      for (int i = 0; i < map->capacity; i++)
      {
-          HashLink* link = map->table[i];
-          if (link != 0)
+          if (map->table[i].hash != 0)
           {
-               printf("\nBucket %i ->", i);
-               while (link != 0)
-               {
-                    printf(" (%s, %d) ->", link->key, link->value);
-                    link = link->next;
-               }
+               printf("\nSlot %i (+%d) -> (%s, %d)", i, probeDistance(map, i),
+                    slotKey(map, i), map->table[i].value);
           }
      }
      printf("\n");
-}
\ No newline at end of file
+}
+
+/**
+* Compares two hashes for qsort.
+*/
+static int compareHashes(const void* a, const void* b)
+{
+     unsigned int x = *(const unsigned int*)a;
+     unsigned int y = *(const unsigned int*)b;
+     return (x > y) - (x < y);
+}
+
+/**
+* Prints how well the hash function spreads the keys: how many keys share
+* their full hash with another key, how many keys hash to the same home slot
+* (the chain lengths a chained table would have), and how far keys had to
+* probe from their home slot.
+* @param map
+* @param out
+*/
+void hashMapPrintProbeReport(struct HashMap* map, FILE* out)
+{
+     assert(map != 0);
+     hashMapFinishResize(map);
+
+     enum { REPORT_BINS = 17 };
+     int chains[REPORT_BINS] = { 0 };
+     int probes[REPORT_BINS] = { 0 };
+     int* homeCounts = calloc(map->capacity, sizeof(int));
+     unsigned int* hashes = malloc(sizeof(unsigned int) * (map->size + 1));
+     unsigned int mask = (unsigned int)map->capacity - 1;
+     long long totalProbe = 0;
+     int maxProbe = 0;
+     int maxChain = 0;
+     int count = 0;
+
+     for (int i = 0; i < map->capacity; i++) {
+          if (map->table[i].hash != 0) {
+               int distance = probeDistance(map, i);
+               probes[distance < REPORT_BINS - 1 ? distance : REPORT_BINS - 1]++;
+               totalProbe += distance;
+               if (distance > maxProbe) {
+                    maxProbe = distance;
+               }
+               homeCounts[map->table[i].hash & mask]++;
+               hashes[count++] = map->table[i].hash;
+          }
+     }
+
+     for (int i = 0; i < map->capacity; i++) {
+          int chain = homeCounts[i];
+          chains[chain < REPORT_BINS - 1 ? chain : REPORT_BINS - 1]++;
+          if (chain > maxChain) {
+               maxChain = chain;
+          }
+     }
+
+     /* Keys whose full hash equals another key's can never be told apart */
+     qsort(hashes, count, sizeof(unsigned int), compareHashes);
+     int sharedHashes = 0;
+     for (int i = 0; i < count; i++) {
+          if ((i > 0 && hashes[i] == hashes[i - 1]) ||
+               (i + 1 < count && hashes[i] == hashes[i + 1])) {
+               sharedHashes++;
+          }
+     }
+
+     fprintf(out, "Hash function: %s\n", hashFunctionName(map->hashFunction));
+     fprintf(out, "Keys: %d  Slots: %d  Load: %.3f\n", map->size, map->capacity,
+          hashMapTableLoad(map));
+     fprintf(out, "Keys sharing a full hash: %d\n", sharedHashes);
+     fprintf(out, "Mean probe length: %.3f  Max probe length: %d  Max chain length: %d\n",
+          count > 0 ? (double)totalProbe / count : 0.0, maxProbe, maxChain);
+     fprintf(out, "%8s %12s %12s\n", "length", "home slots", "keys probing");
+     for (int i = 0; i < REPORT_BINS; i++) {
+          fprintf(out, "%7d%s %12d %12d\n", i, i == REPORT_BINS - 1 ? "+" : " ",
+               chains[i], probes[i]);
+     }
+
+     free(hashes);
+     free(homeCounts);
+}
+
+/*
+* Layout of a snapshot: this header, then the slot table at slotsOffset, then
+* the null terminated keys at keysOffset. Offsets are from the start of the
+* header. Slots hold key offsets into the key blob instead of pointers, so the
+* table can be used straight from a read-only mapping of the file. Numbers are
+* stored in the byte order of the machine that wrote the snapshot.
+*/
+#define SNAPSHOT_MAGIC "SPELLMAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_ALIGNMENT 64
+
+struct SnapshotHeader
+{
+     char magic[8];
+     unsigned int version;
+     unsigned int byteOrder;
+     unsigned int slotSize;
+     int size;
+     int capacity;
+     char hashName[20];
+     unsigned long long slotsOffset;
+     unsigned long long keysOffset;
+     unsigned long long keysLength;
+     // FNV-1a of the slot table and the key blob.
+     unsigned long long checksum;
+};
+
+/**
+* Continues a 64-bit FNV-1a checksum over the given bytes.
+* @param checksum Checksum so far.
+* @param data
+* @param length
+* @return The updated checksum.
+*/
+static unsigned long long snapshotChecksum(unsigned long long checksum, const void* data,
+     size_t length)
+{
+     const unsigned char* bytes = data;
+     for (size_t i = 0; i < length; i++) {
+          checksum ^= bytes[i];
+          checksum *= 1099511628211ull;
+     }
+     return checksum;
+}
+
+/**
+* Writes the map as a snapshot to the current position of the stream. The
+* snapshot can later be opened with hashMapOpenSnapshot, or with
+* hashMapViewSnapshot if it is embedded in a larger file at an offset that is
+* a multiple of 8.
+* @param map
+* @param out
+* @return 0 on success, -1 if the hash function is not registered or writing
+* fails.
+*/
+int hashMapWriteSnapshot(struct HashMap* map, FILE* out)
+{
+     assert(map != 0);
+
+     const char* hashName = hashFunctionName(map->hashFunction);
+     if (hashFunctionByName(hashName) != map->hashFunction) {
+          return -1;
+     }
+     hashMapFinishResize(map);
+
+     /* Lay the keys out in slot order and point each slot at its key */
+     struct HashSlot* slots = calloc(map->capacity, sizeof(struct HashSlot));
+     size_t keysLength = 0;
+     for (int i = 0; i < map->capacity; i++) {
+          if (map->table[i].hash != 0) {
+               keysLength += strlen(slotKey(map, i)) + 1;
+          }
+     }
+     char* keys = malloc(keysLength + 1);
+     size_t offset = 0;
+     for (int i = 0; i < map->capacity; i++) {
+          if (map->table[i].hash != 0) {
+               const char* key = slotKey(map, i);
+               size_t length = strlen(key) + 1;
+               memcpy(keys + offset, key, length);
+               slots[i].hash = map->table[i].hash;
+               slots[i].value = map->table[i].value;
+               slots[i].keyOffset = offset;
+               offset += length;
+          }
+     }
+
+     struct SnapshotHeader header;
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+     header.version = SNAPSHOT_VERSION;
+     header.byteOrder = SNAPSHOT_BYTE_ORDER;
+     header.slotSize = sizeof(struct HashSlot);
+     header.size = map->size;
+     header.capacity = map->capacity;
+     strncpy(header.hashName, hashName, sizeof(header.hashName) - 1);
+     header.slotsOffset = (sizeof(header) + SNAPSHOT_ALIGNMENT - 1) & ~(SNAPSHOT_ALIGNMENT - 1);
+     header.keysOffset = header.slotsOffset + sizeof(struct HashSlot) * (size_t)map->capacity;
+     header.keysLength = keysLength;
+     header.checksum = snapshotChecksum(1469598103934665603ull, slots,
+          sizeof(struct HashSlot) * (size_t)map->capacity);
+     header.checksum = snapshotChecksum(header.checksum, keys, keysLength);
+
+     char padding[SNAPSHOT_ALIGNMENT] = { 0 };
+     int result = 0;
+     if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+          fwrite(padding, header.slotsOffset - sizeof(header), 1, out) != 1 ||
+          fwrite(slots, sizeof(struct HashSlot), map->capacity, out) != (size_t)map->capacity ||
+          (keysLength > 0 && fwrite(keys, keysLength, 1, out) != 1)) {
+          result = -1;
+     }
+
+     free(keys);
+     free(slots);
+     return result;
+}
+
+/**
+* Writes the map as a snapshot file at the given path.
+* @param map
+* @param path
+* @return 0 on success, -1 on failure.
+*/
+int hashMapSaveSnapshot(struct HashMap* map, const char* path)
+{
+     FILE* out = fopen(path, "wb");
+     if (out == NULL) {
+          return -1;
+     }
+     int result = hashMapWriteSnapshot(map, out);
+     if (fclose(out) != 0) {
+          result = -1;
+     }
+     return result;
+}
+
+/**
+* Creates a map served directly from a snapshot in memory. Lookups read the
+* snapshot's slots and keys in place, so nothing is rebuilt; the first change
+* to the map copies the slot table onto the heap. The memory must stay valid
+* and unchanged until the map is deleted.
+*
+* Without verify only the header is checked, which keeps opening a snapshot
+* independent of its size. With verify every slot and the checksum are
+* checked as well; use it for files that may be damaged.
+*
+* @param data Start of the snapshot, aligned to 8 bytes.
+* @param length Number of bytes available at data.
+* @param verify 1 to check the whole snapshot.
+* @return The map, or NULL if the snapshot is invalid.
+*/
+struct HashMap* hashMapViewSnapshot(const char* data, size_t length, int verify)
+{
+     struct SnapshotHeader header;
+     if (data == 0 || length < sizeof(header) || ((size_t)data & (sizeof(unsigned long long) - 1)) != 0) {
+          return 0;
+     }
+     memcpy(&header, data, sizeof(header));
+
+     /* Check the header */
+     header.hashName[sizeof(header.hashName) - 1] = '\0';
+     HashFunction hashFunction = hashFunctionByName(header.hashName);
+     if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+          header.version != SNAPSHOT_VERSION ||
+          header.byteOrder != SNAPSHOT_BYTE_ORDER ||
+          header.slotSize != sizeof(struct HashSlot) ||
+          hashFunction == 0 ||
+          header.capacity < 8 || (header.capacity & (header.capacity - 1)) != 0 ||
+          header.size < 0 || header.size > header.capacity ||
+          header.slotsOffset % SNAPSHOT_ALIGNMENT != 0 || header.slotsOffset > length ||
+          header.slotsOffset + sizeof(struct HashSlot) * (size_t)header.capacity > header.keysOffset ||
+          header.keysOffset > length || header.keysLength > length - header.keysOffset ||
+          (header.keysLength > 0 && data[header.keysOffset + header.keysLength - 1] != '\0')) {
+          return 0;
+     }
+
+     const struct HashSlot* slots = (const struct HashSlot*)(data + header.slotsOffset);
+     if (verify) {
+          unsigned long long checksum = snapshotChecksum(1469598103934665603ull, slots,
+               sizeof(struct HashSlot) * (size_t)header.capacity);
+          checksum = snapshotChecksum(checksum, data + header.keysOffset, header.keysLength);
+          if (checksum != header.checksum) {
+               return 0;
+          }
+          int size = 0;
+          for (int i = 0; i < header.capacity; i++) {
+               if (slots[i].hash != 0) {
+                    if (slots[i].keyOffset >= header.keysLength) {
+                         return 0;
+                    }
+                    size++;
+               }
+          }
+          if (size != header.size) {
+               return 0;
+          }
+     }
+
+     struct HashMap* map = malloc(sizeof(struct HashMap));
+     map->hashFunction = hashFunction;
+     arenaInit(&map->keys);
+     map->snapshotFile = (FileMap){ 0 };
+     map->generation = 1;
+     map->lengthIndex = (struct HashMapLengthIndex){ 0 };
+     map->oldTable = 0;
+     map->oldCapacity = 0;
+     map->migrateIndex = 0;
+     map->migrateLeft = 0;
+     map->incrementalResize = 0;
+     map->filter = 0;
+     map->stats = 0;
+     map->snapshotKeys = data + header.keysOffset;
+     map->table = (struct HashSlot*)slots;
+     map->size = header.size;
+     map->capacity = header.capacity;
+     return map;
+}
+
+/**
+* Opens a snapshot file written by hashMapSaveSnapshot. The file is mapped
+* copy-on-write, so processes opening the same snapshot share its pages and
+* startup does not depend on the number of keys.
+* @param path
+* @param verify 1 to check every slot and the checksum.
+* @return The map, or NULL if the file cannot be opened or is invalid.
+*/
+struct HashMap* hashMapOpenSnapshot(const char* path, int verify)
+{
+     FileMap file;
+     if (fileMapOpenPrivate(&file, path) != 0) {
+          return 0;
+     }
+
+     struct HashMap* map = hashMapViewSnapshot(file.data, file.length, verify);
+     if (map == 0) {
+          fileMapClose(&file);
+          return 0;
+     }
+     map->snapshotFile = file;
+     return map;
+}
@@ -6,39 +6,182 @@
 * Assignment 5
 */
 
-#define HASH_FUNCTION hashFunction1
+#include "arena.h"
+#include "fileMap.h"
+#include <stdio.h>
+
+#define HASH_FUNCTION hashFunctionWy
 #define MAX_TABLE_LOAD .75
+// Slots of the old table moved by each insert or remove while an incremental
+// resize is in progress.
+#define RESIZE_STEP 32
+// Bins of the lookup probe length histogram; the last counts longer probes.
+#define HASH_MAP_PROBE_BINS 17
 
 typedef struct HashMap HashMap;
-typedef struct HashLink HashLink;
+typedef struct HashSlot HashSlot;
+typedef struct HashMapLengthIndex HashMapLengthIndex;
+typedef struct HashMapStats HashMapStats;
+typedef struct ThreadPool ThreadPool;
+typedef struct BloomFilter BloomFilter;
+
+/*
+* A hash function takes a key and its length in bytes. Maps created with
+* hashMapNew use HASH_FUNCTION; hashMapNewWithHash picks one at runtime.
+*/
+typedef unsigned int (*HashFunction)(const char* key, int length);
+
+unsigned int hashFunction1(const char* key, int length);
+unsigned int hashFunction2(const char* key, int length);
+unsigned int hashFunctionFnv(const char* key, int length);
+unsigned int hashFunctionWy(const char* key, int length);
+unsigned long long hashFunctionWy64(const char* key, int length);
+
+HashFunction hashFunctionByName(const char* name);
+const char* hashFunctionName(HashFunction function);
+void hashFunctionPrintNames(FILE* out);
 
-struct HashLink
+/*
+* The table is a single flat array of slots using linear probing with Robin
+* Hood displacement. The hash of each key is stored in its slot so that most
+* mismatches are rejected without touching the key string.
+*/
+struct HashSlot
 {
-     char* key;
+     // Mixed hash of the key, or 0 if the slot is empty.
+     unsigned int hash;
      int value;
-     HashLink* next;
+     union
+     {
+          const char* key;
+          // Offset of the key in the key blob of a snapshot.
+          unsigned long long keyOffset;
+     };
+};
+
+/*
+* Secondary index of the keys grouped by length, built on demand. The keys of
+* length n are keys[offsets[n]] to keys[offsets[n + 1] - 1], in slot order,
+* and signatures[i] is the letter set of keys[i] (see hashMapSignature).
+*/
+struct HashMapLengthIndex
+{
+     const char** keys;
+     unsigned int* signatures;
+     // maxLength + 2 entries.
+     int* offsets;
+     // Length of the longest key.
+     int maxLength;
+     // Generation of the map the index was built for.
+     unsigned int generation;
+};
+
+/*
+* Counters a map keeps while stats are turned on with hashMapSetStats. A
+* lookup is a get or contains call; its probe length is the number of slots
+* it compared, in both tables during an incremental resize, and 0 when the
+* filter answered it. Probing is open addressing, so these probe runs stand
+* in for the chains of a chained table.
+*/
+struct HashMapStats
+{
+     long long lookups;
+     long long hits;
+     long long misses;
+     // Slots compared by all lookups together, and by the longest lookup.
+     long long probes;
+     int maxProbe;
+     // Lookups by probe length.
+     long long probeHistogram[HASH_MAP_PROBE_BINS];
+     // Table resizes, and the time spent moving keys, including the steps of
+     // incremental resizes.
+     int resizes;
+     double resizeSeconds;
+     // Bytes allocated for slots, keys, the length index and the filter. Set
+     // by hashMapGetStats.
+     size_t bytes;
 };
 
 struct HashMap
 {
-     HashLink** table;
-     // Number of links in the table.
+     HashSlot* table;
+     // Number of keys in the table.
      int size;
-     // Number of buckets in the table.
+     // Number of slots in the table. Always a power of two.
      int capacity;
+     HashFunction hashFunction;
+     // Owns the bytes of every key that has been put in the map.
+     Arena keys;
+     // Key blob of the snapshot the table is served from, or NULL. While set,
+     // table points into the snapshot and slots hold key offsets.
+     const char* snapshotKeys;
+     // Snapshot file owned by the map, if it opened one.
+     FileMap snapshotFile;
+     // Bumped whenever a key is added or removed.
+     unsigned int generation;
+     // Keys by length, rebuilt when it falls behind the map's generation.
+     HashMapLengthIndex lengthIndex;
+     // Table the keys are being moved out of by an incremental resize, or
+     // NULL. Until the move is done every key is in exactly one of the two.
+     HashSlot* oldTable;
+     int oldCapacity;
+     // Next slot of oldTable to move, and the number of slots left to visit.
+     int migrateIndex;
+     int migrateLeft;
+     // 1 if a full table grows a few slots at a time instead of all at once.
+     int incrementalResize;
+     // Filter of the keys checked before the table on lookups, or NULL.
+     // Owned by the map.
+     BloomFilter* filter;
+     // Counters, or NULL while stats are off. Owned by the map.
+     HashMapStats* stats;
 };
 
 HashMap* hashMapNew(int capacity);
+HashMap* hashMapNewWithHash(int capacity, HashFunction hashFunction);
 void hashMapDelete(HashMap* map);
+HashMap* hashMapClone(HashMap* map);
 int* hashMapGet(HashMap* map, const char* key);
 void hashMapPut(HashMap* map, const char* key, int value);
 void hashMapRemove(HashMap* map, const char* key);
 int hashMapContainsKey(HashMap* map, const char* key);
+int* hashMapGetSlice(HashMap* map, const char* key, int length);
+void hashMapPutSlice(HashMap* map, const char* key, int length, int value);
+void hashMapReserve(HashMap* map, int keys);
+void hashMapSetIncrementalResize(HashMap* map, int enabled);
+void hashMapFinishResize(HashMap* map);
+void hashMapPutAll(HashMap* map, const char* const* keys, const int* lengths, int count,
+     int value, ThreadPool* pool);
+int hashMapContainsSlice(HashMap* map, const char* key, int length);
+unsigned int hashMapHash(HashMap* map, const char* key);
+const char* hashMapIntern(HashMap* map, const char* key);
+const char* hashMapFindSlice(HashMap* map, const char* key, int length);
+const char* hashMapKeyAt(HashMap* map, int index);
+
+const HashMapLengthIndex* hashMapLengthIndex(HashMap* map);
+int hashMapKeysOfLength(HashMap* map, int length, const char* const** keys,
+     const unsigned int** signatures);
+unsigned int hashMapSignature(const char* key, int length);
+int hashMapSignatureDistance(unsigned int a, unsigned int b);
+
+void hashMapSetFilter(HashMap* map, double falsePositiveRate);
+BloomFilter* hashMapFilter(HashMap* map);
+
+void hashMapSetStats(HashMap* map, int enabled);
+void hashMapGetStats(HashMap* map, HashMapStats* stats);
+void hashMapPrintStats(HashMap* map, FILE* out);
 
 int hashMapSize(HashMap* map);
+unsigned int hashMapGeneration(HashMap* map);
 int hashMapCapacity(HashMap* map);
 int hashMapEmptyBuckets(HashMap* map);
 float hashMapTableLoad(HashMap* map);
 void hashMapPrint(HashMap* map);
+void hashMapPrintProbeReport(HashMap* map, FILE* out);
+
+int hashMapWriteSnapshot(HashMap* map, FILE* out);
+int hashMapSaveSnapshot(HashMap* map, const char* path);
+HashMap* hashMapViewSnapshot(const char* data, size_t length, int verify);
+HashMap* hashMapOpenSnapshot(const char* path, int verify);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,646 @@
+/****************************************************************
+** Program Filename: server.c
+** Author: Chelsea Egan
+** Description: Implements the spell checking server. An event
+** loop polls the listening socket and every connection, reads
+** whatever requests have arrived, answers each complete frame
+** into the connection's output buffer and writes the buffers as
+** the clients take them. The loop runs until SIGINT or SIGTERM,
+** or until no connection is left and nothing is listening.
+** SIGHUP starts a reload thread that publishes a freshly loaded
+** dictionary and its suggester while the loop keeps answering.
+****************************************************************/
+
+#include "server.h"
+#include "checker.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <assert.h>
+
+/* Set by the signal handlers to end serverRun and to start a reload */
+static volatile sig_atomic_t stopRequested = 0;
+static volatile sig_atomic_t reloadRequested = 0;
+
+/**
+* Asks the event loop to stop.
+* @param signal
+*/
+static void requestStop(int signal)
+{
+     (void)signal;
+     stopRequested = 1;
+}
+
+/**
+* Asks the event loop to reload the dictionary.
+* @param signal
+*/
+static void requestReload(int signal)
+{
+     (void)signal;
+     reloadRequested = 1;
+}
+
+/**
+* Creates a server answering from the given dictionary and suggester, which
+* stay owned by the caller. A reload replaces both: once serverRun returns,
+* the caller deletes server->suggester and the concurrent map, which then
+* hold the ones in use.
+* @param map
+* @param suggester
+* @param options How reloads build their suggester; must outlive the server.
+* @return The allocated server.
+*/
+Server* serverNew(ConcurrentMap* map, Suggester* suggester, const SuggestOptions* options)
+{
+     Server* server = malloc(sizeof(Server));
+     server->map = map;
+     server->suggester = suggester;
+     server->options = options;
+     server->load = 0;
+     server->loadContext = 0;
+     server->reloadStarted = 0;
+     server->reloading = 0;
+     server->reloads = 0;
+     server->listenFd = -1;
+     server->socketPath = 0;
+     server->connections = 0;
+     server->connectionCount = 0;
+     server->connectionCapacity = 0;
+     server->requests = 0;
+     server->words = 0;
+     return server;
+}
+
+/**
+* Closes a connection and frees it.
+* @param connection
+*/
+static void connectionDelete(ServerConnection* connection)
+{
+     if (connection->owned) {
+          close(connection->inFd);
+          if (connection->outFd != connection->inFd) {
+               close(connection->outFd);
+          }
+     }
+     free(connection->input);
+     free(connection->output);
+     free(connection);
+}
+
+/**
+* Closes every connection and the listening socket, removing the socket's
+* file, and frees the server.
+* @param server
+*/
+void serverDelete(Server* server)
+{
+     for (int i = 0; i < server->connectionCount; i++) {
+          connectionDelete(server->connections[i]);
+     }
+     if (server->listenFd >= 0) {
+          close(server->listenFd);
+          unlink(server->socketPath);
+     }
+     free(server->socketPath);
+     free(server->connections);
+     free(server);
+}
+
+/**
+* Lets SIGHUP reload the dictionary with the given function. The function
+* runs on a thread of its own, so it must not submit work to a thread pool
+* used by the thread running the server.
+* @param server
+* @param load
+* @param context Passed to load.
+*/
+void serverSetReload(Server* server, ServerLoad load, void* context)
+{
+     server->load = load;
+     server->loadContext = context;
+}
+
+/**
+* Loads the dictionary again, builds a suggester for it and publishes both.
+* The suggester is stored before the map is published, so a request that
+* sees the new map also sees the new suggester; once the map is published,
+* every request that could have loaded the old suggester is done, and it can
+* be deleted.
+* @param argument The server.
+* @return NULL.
+*/
+static void* reloadRun(void* argument)
+{
+     Server* server = argument;
+
+     HashMap* map = server->load(server->loadContext);
+     if (map == 0) {
+          fprintf(stderr, "Cannot reload the dictionary; still serving the old one\n");
+     }
+     else {
+          int size = hashMapSize(map);
+          Suggester* suggester = suggesterNew(map, server->options);
+          Suggester* old = __atomic_exchange_n(&server->suggester, suggester, __ATOMIC_SEQ_CST);
+          concurrentMapSwap(server->map, map);
+          suggesterDelete(old);
+          __atomic_add_fetch(&server->reloads, 1, __ATOMIC_RELAXED);
+          fprintf(stderr, "Reloaded the dictionary: %d words\n", size);
+     }
+
+     __atomic_store_n(&server->reloading, 0, __ATOMIC_RELEASE);
+     return NULL;
+}
+
+/**
+* Starts a reload thread unless one is still running.
+* @param server
+*/
+static void startReload(Server* server)
+{
+     if (__atomic_load_n(&server->reloading, __ATOMIC_ACQUIRE)) {
+          fprintf(stderr, "A reload is already running\n");
+          return;
+     }
+     if (server->reloadStarted) {
+          pthread_join(server->reloadThread, NULL);
+     }
+
+     server->reloading = 1;
+     server->reloadStarted = 1;
+     if (pthread_create(&server->reloadThread, NULL, reloadRun, server) != 0) {
+          fprintf(stderr, "Cannot start a reload thread\n");
+          server->reloading = 0;
+          server->reloadStarted = 0;
+     }
+}
+
+/**
+* Adds a connection reading from one descriptor and writing to another.
+* @param server
+* @param inFd
+* @param outFd
+* @param owned 1 to close the descriptors with the connection.
+*/
+static void addConnection(Server* server, int inFd, int outFd, int owned)
+{
+     if (server->connectionCount == server->connectionCapacity) {
+          server->connectionCapacity = server->connectionCapacity > 0 ? server->connectionCapacity * 2 : 8;
+          server->connections = realloc(server->connections,
+               sizeof(ServerConnection*) * server->connectionCapacity);
+     }
+
+     ServerConnection* connection = calloc(1, sizeof(ServerConnection));
+     connection->inFd = inFd;
+     connection->outFd = outFd;
+     connection->owned = owned;
+     server->connections[server->connectionCount++] = connection;
+}
+
+/**
+* Serves requests read from inFd and writes the responses to outFd, for
+* example standard input and output. The descriptors stay open when the
+* connection ends.
+* @param server
+* @param inFd
+* @param outFd
+*/
+void serverAddPipe(Server* server, int inFd, int outFd)
+{
+     addConnection(server, inFd, outFd, 0);
+}
+
+/**
+* Listens for connections on a Unix domain socket at the given path. A
+* socket file left there by a server that did not exit cleanly is replaced;
+* any other file is not.
+* @param server
+* @param path
+* @return 0 on success, -1 on failure with errno set.
+*/
+int serverListen(Server* server, const char* path)
+{
+     assert(server->listenFd < 0);
+
+     struct sockaddr_un address;
+     memset(&address, 0, sizeof(address));
+     address.sun_family = AF_UNIX;
+     if (strlen(path) >= sizeof(address.sun_path)) {
+          errno = ENAMETOOLONG;
+          return -1;
+     }
+     strcpy(address.sun_path, path);
+
+     struct stat status;
+     if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+          unlink(path);
+     }
+
+     int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+     if (fd < 0) {
+          return -1;
+     }
+     if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0) {
+          int error = errno;
+          close(fd);
+          errno = error;
+          return -1;
+     }
+     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+     server->listenFd = fd;
+     server->socketPath = strdup(path);
+     return 0;
+}
+
+/**
+* Makes room for the given number of bytes at the end of a buffer.
+* @param buffer
+* @param length Bytes in use.
+* @param capacity
+* @param needed Bytes to be added.
+*/
+static void reserve(char** buffer, size_t length, size_t* capacity, size_t needed)
+{
+     if (length + needed <= *capacity) {
+          return;
+     }
+     size_t grown = *capacity > 0 ? *capacity * 2 : 4096;
+     while (grown < length + needed) {
+          grown *= 2;
+     }
+     *buffer = realloc(*buffer, grown);
+     *capacity = grown;
+}
+
+/**
+* Appends bytes to a connection's output.
+* @param connection
+* @param data
+* @param length
+*/
+static void writeBytes(ServerConnection* connection, const char* data, size_t length)
+{
+     reserve(&connection->output, connection->outputLength, &connection->outputCapacity, length);
+     memcpy(connection->output + connection->outputLength, data, length);
+     connection->outputLength += length;
+}
+
+/**
+* Starts a response frame, leaving room for its length.
+* @param connection
+* @return Offset of the frame in the output, for endFrame.
+*/
+static size_t beginFrame(ServerConnection* connection)
+{
+     size_t start = connection->outputLength;
+     writeBytes(connection, "\0\0\0\0", 4);
+     return start;
+}
+
+/**
+* Fills in the length of the response frame started at the given offset.
+* @param connection
+* @param start
+*/
+static void endFrame(ServerConnection* connection, size_t start)
+{
+     size_t length = connection->outputLength - start - 4;
+     unsigned char* header = (unsigned char*)connection->output + start;
+     header[0] = (unsigned char)(length >> 24);
+     header[1] = (unsigned char)(length >> 16);
+     header[2] = (unsigned char)(length >> 8);
+     header[3] = (unsigned char)length;
+}
+
+/**
+* Writes an error response.
+* @param connection
+* @param format printf format of the message.
+*/
+static void writeError(ServerConnection* connection, const char* format, ...)
+{
+     char message[256];
+     va_list arguments;
+     va_start(arguments, format);
+     int length = vsnprintf(message, sizeof(message), format, arguments);
+     va_end(arguments);
+     if (length >= (int)sizeof(message)) {
+          length = (int)sizeof(message) - 1;
+     }
+
+     size_t start = beginFrame(connection);
+     writeBytes(connection, "E ", 2);
+     writeBytes(connection, message, (size_t)length);
+     endFrame(connection, start);
+}
+
+/**
+* Answers a check or suggest request: one line per word of the text.
+* @param server
+* @param connection
+* @param map Published map, read for the whole request.
+* @param suggester Suggester loaded with the map.
+* @param text
+* @param length
+* @param suggest 1 to add suggestions for misspelled words.
+*/
+static void handleWords(Server* server, ServerConnection* connection, HashMap* map, Suggester* suggester,
+     const char* text, size_t length, int suggest)
+{
+     Tokenizer tokenizer;
+     Token token;
+     size_t start = beginFrame(connection);
+
+     tokenizerInitMemory(&tokenizer, text, length);
+     tokenizerSetFold(&tokenizer, 1);
+     while (tokenizerNext(&tokenizer, &token)) {
+          server->words++;
+
+          /* Words too long to look up are misspelled, with no suggestions */
+          if (token.fullLength > CHECK_MAX_WORD) {
+               writeBytes(connection, "0\n", 2);
+               continue;
+          }
+          if (checkWord(map, token.word, token.folded, token.length)) {
+               writeBytes(connection, "1\n", 2);
+               continue;
+          }
+
+          writeBytes(connection, "0", 1);
+          if (suggest) {
+               Suggestion suggestions[SUGGESTION_COUNT];
+               int found = checkSuggest(suggester, token.word, token.folded, token.length,
+                    suggestions, SUGGESTION_COUNT);
+               for (int k = 0; k < found; k++) {
+                    writeBytes(connection, " ", 1);
+                    writeBytes(connection, suggestions[k].word, strlen(suggestions[k].word));
+               }
+          }
+          writeBytes(connection, "\n", 1);
+     }
+     tokenizerCleanUp(&tokenizer);
+
+     endFrame(connection, start);
+}
+
+/**
+* Answers one request from the published map and its suggester, which stay
+* valid until the request is answered even if a reload publishes others.
+* @param server
+* @param connection
+* @param payload
+* @param length
+*/
+static void handleRequest(Server* server, ServerConnection* connection, const char* payload,
+     size_t length)
+{
+     server->requests++;
+     if (length == 0) {
+          writeError(connection, "empty request");
+          return;
+     }
+
+     int ticket;
+     HashMap* map = concurrentMapEnter(server->map, &ticket);
+     Suggester* suggester = __atomic_load_n(&server->suggester, __ATOMIC_SEQ_CST);
+
+     switch (payload[0]) {
+     case 'C':
+          handleWords(server, connection, map, suggester, payload + 1, length - 1, 0);
+          break;
+     case 'S':
+          handleWords(server, connection, map, suggester, payload + 1, length - 1, 1);
+          break;
+     case 'I': {
+          char line[192];
+          int lineLength = snprintf(line, sizeof(line), "words %d requests %lld checked %lld reloads %d\n",
+               hashMapSize(map), server->requests, server->words,
+               __atomic_load_n(&server->reloads, __ATOMIC_RELAXED));
+          size_t start = beginFrame(connection);
+          writeBytes(connection, line, (size_t)lineLength);
+          endFrame(connection, start);
+          break;
+     }
+     default:
+          writeError(connection, "unknown command '%c'", payload[0]);
+          break;
+     }
+
+     concurrentMapLeave(server->map, ticket);
+}
+
+/**
+* Answers every complete frame in a connection's input and keeps the bytes
+* of an incomplete one for the next read.
+* @param server
+* @param connection
+*/
+static void handleInput(Server* server, ServerConnection* connection)
+{
+     size_t offset = 0;
+
+     while (connection->inputLength - offset >= 4) {
+          const unsigned char* header = (const unsigned char*)connection->input + offset;
+          size_t length = ((size_t)header[0] << 24) | ((size_t)header[1] << 16) |
+               ((size_t)header[2] << 8) | header[3];
+          if (length > SERVER_MAX_REQUEST) {
+               writeError(connection, "request of %zu bytes is over the limit of %d", length,
+                    SERVER_MAX_REQUEST);
+               connection->closing = 1;
+               offset = connection->inputLength;
+               break;
+          }
+          if (connection->inputLength - offset - 4 < length) {
+               break;
+          }
+          handleRequest(server, connection, connection->input + offset + 4, length);
+          offset += 4 + length;
+     }
+
+     memmove(connection->input, connection->input + offset, connection->inputLength - offset);
+     connection->inputLength -= offset;
+}
+
+/**
+* Reads what the client has sent and answers the complete requests.
+* @param server
+* @param connection
+*/
+static void readConnection(Server* server, ServerConnection* connection)
+{
+     reserve(&connection->input, connection->inputLength, &connection->inputCapacity, SERVER_READ_SIZE);
+     ssize_t count = read(connection->inFd, connection->input + connection->inputLength, SERVER_READ_SIZE);
+     if (count < 0) {
+          if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+               connection->closing = 1;
+          }
+          return;
+     }
+     if (count == 0) {
+          /* The client is done sending; answer what came and then close */
+          connection->closing = 1;
+          return;
+     }
+
+     connection->inputLength += (size_t)count;
+     handleInput(server, connection);
+}
+
+/**
+* Writes as much of a connection's output as the client takes.
+* @param connection
+* @return 0, or -1 if the client is gone.
+*/
+static int writeConnection(ServerConnection* connection)
+{
+     while (connection->outputSent < connection->outputLength) {
+          ssize_t count = write(connection->outFd, connection->output + connection->outputSent,
+               connection->outputLength - connection->outputSent);
+          if (count < 0) {
+               if (errno == EINTR) {
+                    continue;
+               }
+               return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+          }
+          connection->outputSent += (size_t)count;
+     }
+
+     connection->outputLength = 0;
+     connection->outputSent = 0;
+     return 0;
+}
+
+/**
+* Accepts every connection waiting on the listening socket.
+* @param server
+*/
+static void acceptConnections(Server* server)
+{
+     while (1) {
+          int fd = accept(server->listenFd, NULL, NULL);
+          if (fd < 0) {
+               return;
+          }
+          fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+          addConnection(server, fd, fd, 1);
+     }
+}
+
+/**
+* Runs the event loop until SIGINT or SIGTERM, or until every connection has
+* ended and the server is not listening. Each pass polls the listening
+* socket for new clients, every connection that is not too far behind for
+* requests, and every connection with unsent output for room to write.
+* SIGHUP starts a reload if the server has a load function. A reload still
+* running when the loop ends is waited for.
+* @param server
+* @return 0 when stopped, -1 if polling fails.
+*/
+int serverRun(Server* server)
+{
+     struct sigaction action;
+     memset(&action, 0, sizeof(action));
+     action.sa_handler = requestStop;
+     sigemptyset(&action.sa_mask);
+     sigaction(SIGINT, &action, NULL);
+     sigaction(SIGTERM, &action, NULL);
+     if (server->load != 0) {
+          action.sa_handler = requestReload;
+          sigaction(SIGHUP, &action, NULL);
+     }
+     /* A client that goes away must not kill the server */
+     signal(SIGPIPE, SIG_IGN);
+     stopRequested = 0;
+     reloadRequested = 0;
+
+     struct pollfd* polls = NULL;
+     int pollCapacity = 0;
+     int result = 0;
+
+     while (!stopRequested && (server->listenFd >= 0 || server->connectionCount > 0)) {
+          if (reloadRequested) {
+               reloadRequested = 0;
+               startReload(server);
+          }
+          if (pollCapacity < 2 * server->connectionCount + 1) {
+               pollCapacity = 2 * server->connectionCount + 1;
+               polls = realloc(polls, sizeof(struct pollfd) * pollCapacity);
+          }
+
+          /* The listening socket, then two entries per connection */
+          int count = 0;
+          polls[count].fd = server->listenFd;
+          polls[count].events = POLLIN;
+          count++;
+          for (int i = 0; i < server->connectionCount; i++) {
+               ServerConnection* connection = server->connections[i];
+               size_t pending = connection->outputLength - connection->outputSent;
+               polls[count].fd = !connection->closing && pending <= SERVER_MAX_PENDING ? connection->inFd : -1;
+               polls[count].events = POLLIN;
+               count++;
+               polls[count].fd = pending > 0 ? connection->outFd : -1;
+               polls[count].events = POLLOUT;
+               count++;
+          }
+
+          if (poll(polls, (nfds_t)count, -1) < 0) {
+               if (errno == EINTR) {
+                    continue;
+               }
+               result = -1;
+               break;
+          }
+
+          int connectionCount = server->connectionCount;
+          for (int i = 0; i < connectionCount; i++) {
+               ServerConnection* connection = server->connections[i];
+               struct pollfd* in = &polls[1 + 2 * i];
+               if (in->fd >= 0 && (in->revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+                    readConnection(server, connection);
+               }
+               /* Answers go out right away where the client has room; the rest
+                  waits for POLLOUT. A client that is gone loses its answers. */
+               if (connection->outputLength > connection->outputSent && writeConnection(connection) != 0) {
+                    connection->closing = 1;
+                    connection->outputLength = 0;
+                    connection->outputSent = 0;
+               }
+          }
+
+          /* Drop the connections that are done */
+          int kept = 0;
+          for (int i = 0; i < server->connectionCount; i++) {
+               ServerConnection* connection = server->connections[i];
+               if (connection->closing && connection->outputLength == connection->outputSent) {
+                    connectionDelete(connection);
+               }
+               else {
+                    server->connections[kept++] = connection;
+               }
+          }
+          server->connectionCount = kept;
+
+          if (server->listenFd >= 0 && (polls[0].revents & POLLIN) != 0) {
+               acceptConnections(server);
+          }
+     }
+
+     free(polls);
+     if (server->reloadStarted) {
+          pthread_join(server->reloadThread, NULL);
+          server->reloadStarted = 0;
+     }
+     return result;
+}
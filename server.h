@@ -0,0 +1,110 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "hashMap.h"
+#include "concurrentMap.h"
+#include "suggest.h"
+#include <pthread.h>
+#include <stddef.h>
+
+/*
+* Serves check and suggest requests from a dictionary loaded once, over a
+* Unix domain socket, a pair of pipes such as standard input and output, or
+* both. One thread runs an event loop over every connection with poll, so
+* many clients share the dictionary without a thread each.
+*
+* Given a way to load it, the server reloads the dictionary on SIGHUP without
+* pausing: a thread of its own loads the new dictionary, builds a suggester
+* for it and publishes both, while the event loop goes on answering from the
+* old ones. Each request is answered from one dictionary throughout, read
+* from the concurrent map, and the old dictionary and suggester are deleted
+* once no request uses them. A failed reload keeps the old dictionary.
+*
+* Requests and responses are frames: a 4-byte length in network byte order,
+* then that many bytes of payload. A client may send any number of requests
+* without waiting; the responses come back in the same order. The first byte
+* of a request payload is its command, and the rest is text that is split
+* into words like a document (see isWordChar):
+*   C  check: one line per word, "1" if it is spelled correctly, else "0".
+*   S  suggest: one line per word, "1" if it is spelled correctly, else "0"
+*      followed by its suggestions, each after a space.
+*   I  info: one line with the dictionary size, the counts served so far and
+*      the number of reloads.
+* An unknown command or a bad frame gets a payload starting with "E " and a
+* message. A frame longer than SERVER_MAX_REQUEST closes the connection
+* after the error is sent.
+*/
+
+// Longest request payload accepted.
+#define SERVER_MAX_REQUEST (16 * 1024 * 1024)
+// Bytes read from a connection at a time.
+#define SERVER_READ_SIZE (64 * 1024)
+// A connection with more unsent response bytes than this is not read from
+// until the client catches up.
+#define SERVER_MAX_PENDING (4 * 1024 * 1024)
+
+typedef struct Server Server;
+typedef struct ServerConnection ServerConnection;
+
+/*
+* Loads a fresh copy of the dictionary for a reload, on the reload thread.
+* Returns NULL on failure.
+*/
+typedef HashMap* (*ServerLoad)(void* context);
+
+struct ServerConnection
+{
+     // Descriptors requests are read from and responses written to; the same
+     // for a socket.
+     int inFd;
+     int outFd;
+     // 1 if the descriptors belong to the connection and are closed with it.
+     int owned;
+     // Bytes read and not yet handled as a frame.
+     char* input;
+     size_t inputLength;
+     size_t inputCapacity;
+     // Responses, of which the first outputSent bytes are written.
+     char* output;
+     size_t outputLength;
+     size_t outputSent;
+     size_t outputCapacity;
+     // 1 once nothing more is read: the client is done or sent a bad frame.
+     // The connection closes when its output is written.
+     int closing;
+};
+
+struct Server
+{
+     ConcurrentMap* map;
+     // Suggester for the published map. Replaced by reloads.
+     Suggester* suggester;
+     // How reloads build their suggester.
+     const SuggestOptions* options;
+     // Reload: the function loading the dictionary, or NULL for none, and the
+     // thread running it. reloading is 1 while the thread runs.
+     ServerLoad load;
+     void* loadContext;
+     pthread_t reloadThread;
+     int reloadStarted;
+     int reloading;
+     int reloads;
+     // Listening socket, or -1.
+     int listenFd;
+     char* socketPath;
+     ServerConnection** connections;
+     int connectionCount;
+     int connectionCapacity;
+     // Requests answered and words checked.
+     long long requests;
+     long long words;
+};
+
+Server* serverNew(ConcurrentMap* map, Suggester* suggester, const SuggestOptions* options);
+void serverDelete(Server* server);
+void serverSetReload(Server* server, ServerLoad load, void* context);
+int serverListen(Server* server, const char* path);
+void serverAddPipe(Server* server, int inFd, int outFd);
+int serverRun(Server* server);
+
+#endif
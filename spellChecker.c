@@ -7,136 +7,384 @@
 ** Description: Implements a spell checker using a hash map. It
 ** prompts the user for a word, confirms if spelled correctly,
 ** and, if incorrect, provides 6 suggestions. The program loops
-** until the user types "quit". This spell checker is implemented
-** using the Levenshtein Distance algorithm.
+** until the user types "quit". With --check it checks a whole
+** document instead. This spell checker is implemented using the
+** Levenshtein Distance algorithm.
 ****************************************************************/
 
 #include "hashMap.h"
+#include "fileMap.h"
+#include "suggest.h"
+#include "checker.h"
+#include "threadPool.h"
+#include "suggestCache.h"
+#include "bloomFilter.h"
+#include "dictionary.h"
+#include "server.h"
+#include "concurrentMap.h"
+#include "symSpell.h"
 #include <assert.h>
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
 
-
-/*This is a macro used in the Levenshtein distance algorithm */
-
-#define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
-
-#define HASH_FUNCTION hashFunction1
+/**
+* Returns the time in seconds from a fixed point, for measuring elapsed wall
+* clock time when several threads are at work.
+* @return Seconds.
+*/
+static double wallSeconds(void)
+{
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
 
 /**
-* Allocates a string for the next word in the file and returns it. This string
-* is null terminated. Returns NULL after reaching the end of the file.
-* @param file
-* @return Allocated string or NULL.
+* Reads an option's value as a whole decimal number.
+* @param text
+* @param value Set to the number.
+* @return 1 if text is a number that fits in an int, 0 otherwise.
 */
-char* nextWord(FILE* file)
+static int parseInt(const char* text, int* value)
 {
-     int maxLength = 16;
-     int length = 0;
-     char* word = malloc(sizeof(char) * maxLength);
-     while (1)
-     {
-          char c = fgetc(file);
-          if ((c >= '0' && c <= '9') ||
-               (c >= 'A' && c <= 'Z') ||
-               (c >= 'a' && c <= 'z') ||
-               c == '\'')
-          {
-               if (length + 1 >= maxLength)
-               {
-                    maxLength *= 2;
-                    word = realloc(word, maxLength);
-               }
-               word[length] = c;
-               length++;
-          }
-          else if (length > 0 || c == EOF)
-          {
-               break;
-          }
-     }
-     if (length == 0)
-     {
-          free(word);
-          return NULL;
+     char* end;
+     errno = 0;
+     long number = strtol(text, &end, 10);
+     if (end == text || *end != '\0' || errno != 0 || number < INT_MIN || number > INT_MAX) {
+          return 0;
      }
-     word[length] = '\0';
-     return word;
+     *value = (int)number;
+     return 1;
 }
 
+/* Where the dictionary comes from and how its map is set up, kept to load
+   it again when the server reloads it */
+typedef struct DictionarySource
+{
+     // Snapshot to serve the dictionary from, or NULL for dictionary.txt.
+     const char* snapshotPath;
+     int verify;
+     HashFunction hashFunction;
+     int stats;
+     // False positive rate of the map's Bloom filter, or 0 for none.
+     double bloomRate;
+} DictionarySource;
+
 /**
-* Loads the contents of the file into the hash map.
-* @param file
-* @param map
+* Opens the snapshot or loads dictionary.txt into a new hash map, reporting
+* a failure on standard error. The Bloom filter is left to the caller.
+* @param source
+* @param pool Threads to load with, or NULL.
+* @return The map, or NULL on failure.
 */
-void loadDictionary(FILE* file, HashMap* map)
+static HashMap* openDictionary(const DictionarySource* source, ThreadPool* pool)
 {
-     // FIXME: implement
-     char * key = nextWord(file);
-     while (key != NULL) {
-          hashMapPut(map, key, 1);
-          free(key);
-          key = nextWord(file);
+     HashMap* map;
+     if (source->snapshotPath != NULL) {
+          /* Serve the dictionary straight from the snapshot */
+          map = hashMapOpenSnapshot(source->snapshotPath, source->verify);
+          if (map == NULL) {
+               fprintf(stderr, "Cannot open snapshot %s\n", source->snapshotPath);
+               return NULL;
+          }
+          hashMapSetStats(map, source->stats);
+     }
+     else {
+          /* Load the dictionary into the hash map */
+          map = hashMapNewWithHash(1000, source->hashFunction);
+          hashMapSetStats(map, source->stats);
+          if (loadDictionary("dictionary.txt", map, pool) < 0) {
+               fprintf(stderr, "Cannot open dictionary.txt\n");
+               hashMapDelete(map);
+               return NULL;
+          }
      }
+     return map;
 }
 
 /**
-* Calculates the Levenshtein distance between input word and dictionary words
-* @param user's string
-* @param string from dictionary
-* @returns Levenshtein distance
+* Loads the dictionary again for the server, with its Bloom filter. Runs on
+* the server's reload thread, so it loads without the thread pool.
+* @param context The DictionarySource.
+* @return The map, or NULL on failure.
 */
-/* Source: https://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C */
-int levenshtein(char *s1, char *s2) {
-     unsigned int s1len, s2len, x, y, lastdiag, olddiag;
-     s1len = strlen(s1);
-     s2len = strlen(s2);
-     unsigned int * column = malloc((s1len + 1) * sizeof(int));
-     for (y = 1; y <= s1len; y++)
-          column[y] = y;
-     for (x = 1; x <= s2len; x++) {
-          column[0] = x;
-          for (y = 1, lastdiag = x - 1; y <= s1len; y++) {
-               olddiag = column[y];
-               column[y] = MIN3(column[y] + 1, column[y - 1] + 1, lastdiag + (s1[y - 1] == s2[x - 1] ? 0 : 1));
-               lastdiag = olddiag;
-          }
-     }
-     int levDistance = column[s1len];
-     free(column);
-     return(levDistance);
+static HashMap* reloadDictionary(void* context)
+{
+     const DictionarySource* source = context;
+     HashMap* map = openDictionary(source, NULL);
+     if (map != NULL && source->bloomRate > 0) {
+          hashMapSetFilter(map, source->bloomRate);
+     }
+     return map;
 }
 
 /**
-* Prints the concordance of the given file and performance information. Uses
-* the file input1.txt by default or a file name specified as a command line
-* argument.
+* Loads dictionary.txt and prompts the user for words to check until they
+* type "quit". Options:
+*   --hash=NAME     hash function for the dictionary (default HASH_FUNCTION)
+*   --hash-report   print the probe length distribution after loading
+*   --compile=PATH  write the loaded dictionary as a snapshot to PATH and exit
+*   --snapshot=PATH serve the dictionary from a snapshot instead of
+*                   dictionary.txt
+*   --verify        check the whole snapshot when opening it
+*   --engine=NAME   suggestion engine: scan (default), bktree, symspell,
+*                   parallel or dawg
+*   --symspell-distance=N
+*                   largest distance the symspell engine finds (default 2)
+*   --symspell-index=PATH
+*                   load the symspell index from PATH, building and saving
+*                   it there if it is missing or stale
+*   --threads=N     threads for loading, the parallel engine and --check
+*                   (0, the default: one per processor)
+*   --cache=MB      cache the suggestions of up to MB megabytes of recent
+*                   misspellings
+*   --bloom=RATE    check words against a Bloom filter of the dictionary
+*                   with false positive rate RATE (for example 0.01) before
+*                   the hash map
+*   --stats         count hash map lookups, probe lengths and resizes and
+*                   print them on exit
+*   --check=PATH    check every word of PATH ("-" for standard input) and
+*                   print the misspelled ones as JSON lines instead of
+*                   prompting
+*   --serve=PATH    answer requests on a Unix domain socket at PATH, or on
+*                   standard input and output for "-", until interrupted;
+*                   SIGHUP reloads the dictionary (see server.h for the
+*                   protocol)
 * @param argc
 * @param argv
 * @return
 */
 int main(int argc, const char** argv)
 {
-     // FIXME: implement
-     HashMap* map = hashMapNew(1000);
+     HashFunction hashFunction = HASH_FUNCTION;
+     int hashReport = 0;
+     const char* compilePath = NULL;
+     const char* snapshotPath = NULL;
+     int verify = 0;
+     const char* checkPath = NULL;
+     const char* servePath = NULL;
+     double bloomRate = 0;
+     int mapStats = 0;
+     SuggestOptions options;
+     suggestOptionsInit(&options);
 
-     /* Open file */
-     FILE* file = fopen("dictionary.txt", "r");
-     /* Test that file opened correctly */
-     if (file == NULL) {
-          fprintf(stderr, "Cannot open dictionary.txt\n");
+     /* Read command line options */
+     for (int i = 1; i < argc; i++) {
+          if (strncmp(argv[i], "--hash=", 7) == 0) {
+               hashFunction = hashFunctionByName(argv[i] + 7);
+               if (hashFunction == NULL) {
+                    fprintf(stderr, "Unknown hash function %s. Choose one of: ", argv[i] + 7);
+                    hashFunctionPrintNames(stderr);
+                    return 1;
+               }
+          }
+          else if (strcmp(argv[i], "--hash-report") == 0) {
+               hashReport = 1;
+          }
+          else if (strncmp(argv[i], "--compile=", 10) == 0) {
+               compilePath = argv[i] + 10;
+          }
+          else if (strncmp(argv[i], "--snapshot=", 11) == 0) {
+               snapshotPath = argv[i] + 11;
+          }
+          else if (strcmp(argv[i], "--verify") == 0) {
+               verify = 1;
+          }
+          else if (strncmp(argv[i], "--engine=", 9) == 0) {
+               if (!suggestEngineByName(argv[i] + 9, &options.engine)) {
+                    fprintf(stderr, "Unknown engine %s. Choose one of: ", argv[i] + 9);
+                    suggestEnginePrintNames(stderr);
+                    return 1;
+               }
+          }
+          else if (strncmp(argv[i], "--symspell-distance=", 20) == 0) {
+               if (!parseInt(argv[i] + 20, &options.symSpellDistance) ||
+                    options.symSpellDistance < 1 || options.symSpellDistance > SYM_SPELL_MAX_DISTANCE) {
+                    fprintf(stderr, "The symspell distance must be between 1 and %d\n",
+                         SYM_SPELL_MAX_DISTANCE);
+                    return 1;
+               }
+          }
+          else if (strncmp(argv[i], "--symspell-index=", 17) == 0) {
+               options.symSpellPath = argv[i] + 17;
+          }
+          else if (strncmp(argv[i], "--threads=", 10) == 0) {
+               if (!parseInt(argv[i] + 10, &options.threads) || options.threads < 0) {
+                    fprintf(stderr, "The number of threads must be 0 (one per processor) or more\n");
+                    return 1;
+               }
+          }
+          else if (strncmp(argv[i], "--cache=", 8) == 0) {
+               int megabytes;
+               if (!parseInt(argv[i] + 8, &megabytes) || megabytes < 0 ||
+                    (size_t)megabytes > SIZE_MAX / (1024 * 1024)) {
+                    fprintf(stderr, "The cache size must be a number of megabytes, 0 or more\n");
+                    return 1;
+               }
+               options.cacheBytes = (size_t)megabytes * 1024 * 1024;
+          }
+          else if (strncmp(argv[i], "--bloom=", 8) == 0) {
+               bloomRate = atof(argv[i] + 8);
+               if (bloomRate <= 0 || bloomRate >= 1) {
+                    fprintf(stderr, "The Bloom filter's false positive rate must be between 0 and 1\n");
+                    return 1;
+               }
+          }
+          else if (strcmp(argv[i], "--stats") == 0) {
+               mapStats = 1;
+          }
+          else if (strncmp(argv[i], "--check=", 8) == 0) {
+               checkPath = argv[i] + 8;
+          }
+          else if (strncmp(argv[i], "--serve=", 8) == 0) {
+               servePath = argv[i] + 8;
+          }
+          else {
+               fprintf(stderr, "Unknown option %s\n", argv[i]);
+               return 1;
+          }
      }
-     clock_t timer = clock();
 
-     /* Load the dictionary into the hash map */
-     loadDictionary(file, map);
+     /* One pool of threads serves every stage that can use it */
+     ThreadPool* pool = options.threads != 1 ? threadPoolNew(options.threads) : NULL;
+     options.pool = pool;
 
-     timer = clock() - timer;
-     printf("Dictionary loaded in %f seconds\n", (float)timer / (float)CLOCKS_PER_SEC);
-     
-     fclose(file);
+     /* Keep standard output for the results when checking a document or
+        serving */
+     FILE* info = checkPath != NULL || servePath != NULL ? stderr : stdout;
+     DictionarySource source = { snapshotPath, verify, hashFunction, mapStats, bloomRate };
+     double timer = wallSeconds();
+
+     HashMap* map = openDictionary(&source, pool);
+     if (map == NULL) {
+          if (pool != NULL) {
+               threadPoolDelete(pool);
+          }
+          return 1;
+     }
+
+     fprintf(info, "Dictionary loaded in %f seconds\n", wallSeconds() - timer);
+
+     if (compilePath != NULL) {
+          int result = hashMapSaveSnapshot(map, compilePath);
+          if (result != 0) {
+               fprintf(stderr, "Cannot write snapshot %s\n", compilePath);
+          }
+          hashMapDelete(map);
+          if (pool != NULL) {
+               threadPoolDelete(pool);
+          }
+          return result != 0;
+     }
+
+     if (hashReport) {
+          hashMapPrintProbeReport(map, info);
+     }
+     if (bloomRate > 0) {
+          hashMapSetFilter(map, bloomRate);
+     }
+
+     /* Build the index the suggestion engine needs */
+     timer = wallSeconds();
+     Suggester* suggester = suggesterNew(map, &options);
+     timer = wallSeconds() - timer;
+     if (options.engine != SUGGEST_SCAN) {
+          fprintf(info, "Suggestion index built in %f seconds\n", timer);
+          suggesterPrintIndex(suggester, info);
+     }
+
+     if (servePath != NULL) {
+          /* Requests read the dictionary through a concurrent map, so a
+             reload can publish a new one under them */
+          ConcurrentMap* concurrent = concurrentMapNew(map);
+          Server* server = serverNew(concurrent, suggester, &options);
+          serverSetReload(server, reloadDictionary, &source);
+          int result = 0;
+          if (strcmp(servePath, "-") == 0) {
+               serverAddPipe(server, 0, 1);
+          }
+          else if (serverListen(server, servePath) != 0) {
+               fprintf(stderr, "Cannot listen on %s: %s\n", servePath, strerror(errno));
+               result = -1;
+          }
+          else {
+               fprintf(stderr, "Listening on %s\n", servePath);
+          }
+          if (result == 0) {
+               result = serverRun(server);
+               fprintf(stderr, "Served %lld requests, %lld words\n", server->requests, server->words);
+          }
+
+          /* Reloads leave the server with the dictionary and suggester in use */
+          suggester = server->suggester;
+          map = concurrent->current;
+          serverDelete(server);
+          if (suggester->cache != NULL) {
+               suggestCachePrintStats(suggester->cache, stderr);
+          }
+          if (mapStats) {
+               if (hashMapFilter(map) != NULL) {
+                    bloomFilterPrintStats(hashMapFilter(map), stderr);
+               }
+               hashMapPrintStats(map, stderr);
+          }
+          suggesterDelete(suggester);
+          concurrentMapDelete(concurrent);
+          if (pool != NULL) {
+               threadPoolDelete(pool);
+          }
+          return result != 0;
+     }
+
+     if (checkPath != NULL) {
+          FILE* document = strcmp(checkPath, "-") == 0 ? stdin : fopen(checkPath, "rb");
+          if (document == NULL) {
+               fprintf(stderr, "Cannot open %s\n", checkPath);
+               suggesterDelete(suggester);
+               hashMapDelete(map);
+               if (pool != NULL) {
+                    threadPoolDelete(pool);
+               }
+               return 1;
+          }
+
+          CheckStats stats;
+          double seconds = wallSeconds();
+          int result = pool != NULL ?
+               checkStreamParallel(document, stdout, map, suggester, pool, &stats) :
+               checkStream(document, stdout, map, suggester, &stats);
+          seconds = wallSeconds() - seconds;
+
+          if (result != 0) {
+               fprintf(stderr, "Cannot read %s\n", checkPath);
+          }
+          fprintf(stderr, "Checked %lld words (%lld misspelled) in %f seconds, %.0f words per second\n",
+               stats.words, stats.misspelled, seconds, seconds > 0 ? stats.words / seconds : 0.0);
+
+          if (document != stdin) {
+               fclose(document);
+          }
+          if (suggester->cache != NULL) {
+               suggestCachePrintStats(suggester->cache, stderr);
+          }
+          if (mapStats) {
+               if (hashMapFilter(map) != NULL) {
+                    bloomFilterPrintStats(hashMapFilter(map), stderr);
+               }
+               hashMapPrintStats(map, stderr);
+          }
+          suggesterDelete(suggester);
+          hashMapDelete(map);
+          if (pool != NULL) {
+               threadPoolDelete(pool);
+          }
+          return result != 0;
+     }
 
      /* Buffer to hold user's string */
      char inputBuffer[256];
@@ -147,8 +395,10 @@ int main(int argc, const char** argv)
      {
           /* Prompt user for word */
           printf("Enter a word or \"quit\" to quit: ");
-          /* Read in word */
-          scanf("%s", inputBuffer);
+          /* Read in word, stopping at the end of the input */
+          if (scanf("%255s", inputBuffer) != 1) {
+               break;
+          }
 
           // Implement the spell checker code here..
           /* Check if user chose to quit */
@@ -159,91 +409,37 @@ int main(int argc, const char** argv)
           /* If not quit... */
           else {
                /* Check if word is spelled correctly */
-               if (hashMapContainsKey(map, inputBuffer)) {
+               if (suggesterContains(suggester, inputBuffer)) {
                     printf("%s is spelled correctly.\n", inputBuffer);
                }
                /* If incorrect */
                else {
                     /* Array to hold six suggestions */
-                    char * suggestions[6];
-                    /* Fill suggestions array */
-                    for (int i = 0; i < 6; i++) {
-                         suggestions[i] = '\0';
-                    }
-                    /* Index if word would be entered into hash map */
-                    /* Allows algorithm to start at the best place */
-                    int index = HASH_FUNCTION(inputBuffer);
-                    /* Int to hold Levenshtein distance */
-                    /* Initialize as -1 to indicate it has not been calculated */
-                    int levDistance = -1;
-                    /* Preferred Levenshtein distance is 1 */
-                    /* If not enough words are found at this distance, it will be increased */
-                    int prefDistance = 1;
-                    /* Current link in hash map */
-                    struct HashLink * currentLink = map->table[index];
-                    /* Counter for number of suggestions */
-                    int counter = 0;
-                    /* Index for suggestions array (allows words to be overwritten with better ones) */
-                    int suggestionsIndex = 0;
-
-                    /* Loop through hash map until end or enough words have been found */
-                    while (index < map->capacity && counter < 6) {
-                         /* While not end of linked list */
-                         while (currentLink != 0) {
-                              /* Calculate Levenshtein distance between user's word and dictionary word */
-                              levDistance = levenshtein(inputBuffer, currentLink->key);
-                              /* If within preferred distance */
-                              if (levDistance > 0 && levDistance <= prefDistance) {
-                                   /* Check if word is already in array */
-                                   int duplicate = 0;
-                                   for (int i = 0; i < 6; i++) {
-                                        if (suggestions[i] == currentLink->key) {
-                                             duplicate = 1;
-                                        }
-                                   }
-                                   /* If not a duplicate */
-                                   if (!duplicate) {
-                                        /* Add word to array */
-                                        suggestions[suggestionsIndex] = currentLink->key;
-                                        /* Increment suggestions index */
-                                        suggestionsIndex++;
-                                        /* If we have not hit enough words yet, increment */
-                                        if (counter < 6) {
-                                             counter++;
-                                        }
-                                        /* If end of array index, loop back to 0 */
-                                        if (suggestionsIndex >= 6) {
-                                             suggestionsIndex = 0;
-                                        }
-                                   }
-                              }
-                              /* Move to next link */
-                              currentLink = currentLink->next;
-                              /* Reset levenshtein difference */
-                              levDistance = -1;
-                         }
-
-                         index++;
-                         /* If end of hash map array, but still not enough words */
-                         if (index >= map->capacity && counter < 6) {
-                              /* Loop back to end of array */
-                              index = 0;
-                              /* Increase allowed levenshtein difference */
-                              prefDistance++;
-                         }
-                         /* Move to next bucket in hash map array */
-                         currentLink = map->table[index];
-                    }
+                    Suggestion suggestions[SUGGESTION_COUNT];
+                    int found = suggesterFind(suggester, inputBuffer, suggestions, SUGGESTION_COUNT);
 
                     /* Print suggestions */
                     printf("Perhaps you meant...\n");
-                    for (int i = 0; i < 6; i++) {
-                              printf("%s\n", suggestions[i]);
+                    for (int i = 0; i < found; i++) {
+                              printf("%s\n", suggestions[i].word);
                     }
                }
           }
      }
 
+     if (suggester->cache != NULL) {
+          suggestCachePrintStats(suggester->cache, info);
+     }
+     if (mapStats) {
+          if (hashMapFilter(map) != NULL) {
+               bloomFilterPrintStats(hashMapFilter(map), info);
+          }
+          hashMapPrintStats(map, info);
+     }
+     suggesterDelete(suggester);
      hashMapDelete(map);
+     if (pool != NULL) {
+          threadPoolDelete(pool);
+     }
      return 0;
 };
\ No newline at end of file
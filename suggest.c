@@ -0,0 +1,729 @@
+/****************************************************************
+** Program Filename: suggest.c
+** Author: Chelsea Egan
+** Date: 11/18/2017
+** Description: Finds spelling suggestions for a misspelled word.
+** The scan engine compares the word with the words of the hash
+** map whose length is close enough, a vector batch at a time,
+** keeping the nearest words in a bounded heap whose worst
+** distance cuts off the comparisons that follow. The BK-tree
+** engine answers the same question from a metric tree built
+** over the dictionary at load time, and the symmetric delete
+** engine looks up precomputed deletion variants. The parallel
+** engine splits the scan across a pool of threads and merges
+** the closest words each thread found, and the DAWG engine
+** walks a minimized word graph of the map's keys once, pruning
+** prefixes that cannot beat the worst word kept. Any engine
+** can sit behind a cache of the suggestions for recent words.
+****************************************************************/
+
+#include "suggest.h"
+#include "bkTree.h"
+#include "symSpell.h"
+#include "dawg.h"
+#include "editBatch.h"
+#include "threadPool.h"
+#include "suggestCache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Engines that can be selected by name */
+static const struct
+{
+     const char* name;
+     SuggestEngine engine;
+} suggestEngines[] = {
+     { "scan", SUGGEST_SCAN },
+     { "bktree", SUGGEST_BKTREE },
+     { "symspell", SUGGEST_SYMSPELL },
+     { "parallel", SUGGEST_PARALLEL },
+     { "dawg", SUGGEST_DAWG },
+};
+
+#define SUGGEST_ENGINE_COUNT ((int)(sizeof(suggestEngines) / sizeof(suggestEngines[0])))
+
+/**
+* Looks up a suggestion engine by name.
+* @param name
+* @param engine Set to the engine if the name is known.
+* @return 1 if the name is known, 0 otherwise.
+*/
+int suggestEngineByName(const char* name, SuggestEngine* engine)
+{
+     for (int i = 0; i < SUGGEST_ENGINE_COUNT; i++) {
+          if (strcmp(suggestEngines[i].name, name) == 0) {
+               *engine = suggestEngines[i].engine;
+               return 1;
+          }
+     }
+     return 0;
+}
+
+/**
+* Returns the name of an engine.
+* @param engine
+* @return The name the engine is selected by.
+*/
+const char* suggestEngineName(SuggestEngine engine)
+{
+     for (int i = 0; i < SUGGEST_ENGINE_COUNT; i++) {
+          if (suggestEngines[i].engine == engine) {
+               return suggestEngines[i].name;
+          }
+     }
+     return "unknown";
+}
+
+/**
+* Returns the engine at the given position in the list of engines, for
+* walking all of them.
+* @param index
+* @param engine Set to the engine if there is one at index.
+* @return 1 if index is within the list, 0 otherwise.
+*/
+int suggestEngineByIndex(int index, SuggestEngine* engine)
+{
+     if (index < 0 || index >= SUGGEST_ENGINE_COUNT) {
+          return 0;
+     }
+     *engine = suggestEngines[index].engine;
+     return 1;
+}
+
+/**
+* Prints the names of all suggestion engines on one line.
+* @param out
+*/
+void suggestEnginePrintNames(FILE* out)
+{
+     for (int i = 0; i < SUGGEST_ENGINE_COUNT; i++) {
+          fprintf(out, "%s%s", i > 0 ? " " : "", suggestEngines[i].name);
+     }
+     fprintf(out, "\n");
+}
+
+/**
+* Groups the map's words by length for the scan engine, using the map's
+* length index, and splits each length into batches for editBatchDistances.
+* @param suggester
+*/
+static void buildScanIndex(Suggester* suggester)
+{
+     HashMap* map = suggester->map;
+     int maxLength = hashMapLengthIndex(map)->maxLength;
+
+     suggester->scanMaxLength = maxLength;
+     suggester->scanBands = malloc(sizeof(EditBatchSet*) * (maxLength + 1));
+     suggester->scanBatchOffsets = malloc(sizeof(int) * (maxLength + 2));
+     suggester->scanBatchOffsets[0] = 0;
+     for (int length = 0; length <= maxLength; length++) {
+          const char* const* keys;
+          int count = hashMapKeysOfLength(map, length, &keys, 0);
+          suggester->scanBands[length] = editBatchSetBuild(keys, count);
+          suggester->scanBatchOffsets[length + 1] = suggester->scanBatchOffsets[length] +
+               suggester->scanBands[length]->count;
+     }
+}
+
+/**
+* Sets the options to the defaults: the scan engine, a symmetric delete
+* index of SYM_SPELL_DISTANCE built in memory if that engine is chosen, and
+* one thread per processor for the parallel engine, and no cache.
+* @param options
+*/
+void suggestOptionsInit(SuggestOptions* options)
+{
+     options->engine = SUGGEST_SCAN;
+     options->symSpellDistance = SYM_SPELL_DISTANCE;
+     options->symSpellPath = 0;
+     options->threads = 0;
+     options->pool = 0;
+     options->cacheBytes = 0;
+}
+
+/**
+* Creates a suggester for the map, building whatever index the engine needs.
+* The map must outlive the suggester and must not change while it is in use.
+* @param map
+* @param options
+* @return The allocated suggester.
+*/
+Suggester* suggesterNew(HashMap* map, const SuggestOptions* options)
+{
+     assert(map != 0);
+
+     /* The engines walk the table's slots, and threads share it from here on */
+     hashMapFinishResize(map);
+
+     Suggester* suggester = malloc(sizeof(Suggester));
+     suggester->map = map;
+     suggester->engine = options->engine;
+     suggester->bkTree = 0;
+     suggester->symSpell = 0;
+     suggester->dawg = 0;
+     suggester->scanBands = 0;
+     suggester->scanBatchOffsets = 0;
+     suggester->scanMaxLength = -1;
+     suggester->pool = 0;
+     suggester->ownsPool = 0;
+     suggester->cache = 0;
+     if (options->cacheBytes > 0) {
+          suggester->cache = suggestCacheNew(options->cacheBytes);
+          if (suggester->cache == 0) {
+               fprintf(stderr, "Cannot allocate a suggestion cache of %zu bytes; running without one\n",
+                    options->cacheBytes);
+          }
+     }
+
+     if (options->engine == SUGGEST_SCAN) {
+          buildScanIndex(suggester);
+     }
+     else if (options->engine == SUGGEST_PARALLEL) {
+          /* Built before the threads start, so they only ever read it */
+          buildScanIndex(suggester);
+          suggester->pool = options->pool;
+          if (suggester->pool == 0) {
+               suggester->pool = threadPoolNew(options->threads);
+               suggester->ownsPool = 1;
+          }
+     }
+     else if (options->engine == SUGGEST_BKTREE) {
+          suggester->bkTree = bkTreeBuild(map);
+     }
+     else if (options->engine == SUGGEST_DAWG) {
+          suggester->dawg = dawgBuildFromMap(map);
+     }
+     else if (options->engine == SUGGEST_SYMSPELL) {
+          /* Reuse a saved index when it matches the dictionary */
+          if (options->symSpellPath != 0) {
+               suggester->symSpell = symSpellLoad(map, options->symSpellPath);
+               if (suggester->symSpell != 0 &&
+                    suggester->symSpell->maxDistance != options->symSpellDistance) {
+                    symSpellDelete(suggester->symSpell);
+                    suggester->symSpell = 0;
+               }
+          }
+          if (suggester->symSpell == 0) {
+               suggester->symSpell = symSpellBuild(map, options->symSpellDistance);
+               if (options->symSpellPath != 0 &&
+                    symSpellSave(suggester->symSpell, options->symSpellPath) != 0) {
+                    fprintf(stderr, "Cannot write %s\n", options->symSpellPath);
+               }
+          }
+     }
+     return suggester;
+}
+
+/**
+* Prints the size of the suggester's index, if its engine uses one.
+* @param suggester
+* @param out
+*/
+void suggesterPrintIndex(Suggester* suggester, FILE* out)
+{
+     if (suggester->scanBands != 0) {
+          fprintf(out, "Scan: %d batches of %d words in %d lengths, %s kernel\n",
+               suggester->scanBatchOffsets[suggester->scanMaxLength + 1], EDIT_BATCH_LANES,
+               suggester->scanMaxLength + 1, editBatchKernelName());
+     }
+     if (suggester->pool != 0) {
+          fprintf(out, "Parallel: %d threads\n", threadPoolSize(suggester->pool));
+     }
+     if (suggester->bkTree != 0) {
+          fprintf(out, "BK-tree: %d nodes, %.1f MB\n", suggester->bkTree->size,
+               (double)sizeof(BkNode) * suggester->bkTree->capacity / (1024 * 1024));
+     }
+     if (suggester->dawg != 0) {
+          /* The graph is kept beside the map, whose slots and key bytes it
+             suggests from, so its size adds to the map's */
+          const HashMapLengthIndex* index = hashMapLengthIndex(suggester->map);
+          size_t mapBytes = sizeof(HashSlot) * (size_t)hashMapCapacity(suggester->map);
+          for (int length = 0; length <= index->maxLength; length++) {
+               mapBytes += (size_t)(index->offsets[length + 1] - index->offsets[length]) * (length + 1);
+          }
+          int words = suggester->dawg->size > 0 ? suggester->dawg->size : 1;
+          fprintf(out, "DAWG: %d nodes, %d edges, %.1f bytes per word on top of the hash map's %.1f\n",
+               suggester->dawg->nodeCount, suggester->dawg->edgeCount,
+               (double)dawgMemory(suggester->dawg) / words, (double)mapBytes / words);
+     }
+     if (suggester->symSpell != 0) {
+          fprintf(out, "Symmetric delete index: distance %d, %d deletes, %.1f MB\n",
+               suggester->symSpell->maxDistance, hashMapSize(suggester->symSpell->deletes),
+               (double)symSpellMemory(suggester->symSpell) / (1024 * 1024));
+     }
+}
+
+/**
+* Frees the suggester and its indexes. The map is not freed.
+* @param suggester
+*/
+void suggesterDelete(Suggester* suggester)
+{
+     if (suggester->bkTree != 0) {
+          bkTreeDelete(suggester->bkTree);
+     }
+     if (suggester->symSpell != 0) {
+          symSpellDelete(suggester->symSpell);
+     }
+     if (suggester->dawg != 0) {
+          dawgDelete(suggester->dawg);
+     }
+     for (int length = 0; length <= suggester->scanMaxLength; length++) {
+          editBatchSetDelete(suggester->scanBands[length]);
+     }
+     free(suggester->scanBands);
+     free(suggester->scanBatchOffsets);
+     if (suggester->ownsPool) {
+          threadPoolDelete(suggester->pool);
+     }
+     if (suggester->cache != 0) {
+          suggestCacheDelete(suggester->cache);
+     }
+     free(suggester);
+}
+
+/**
+* Compares two suggestions by rank: nearer first, then alphabetically.
+* @param a
+* @param b
+* @return Negative if a ranks first, positive if b does, 0 for the same word.
+*/
+int suggestionCompare(const Suggestion* a, const Suggestion* b)
+{
+     if (a->distance != b->distance) {
+          return a->distance < b->distance ? -1 : 1;
+     }
+     return strcmp(a->word, b->word);
+}
+
+/**
+* Inserts a word into a list of suggestions kept sorted by
+* rank. The list holds at most count words; a word that ranks below all of
+* them when the list is full is dropped.
+* @param suggestions
+* @param found Number of words in the list.
+* @param count Capacity of the list.
+* @param word
+* @param distance
+* @return Number of words in the list afterwards.
+*/
+int suggestionInsert(Suggestion* suggestions, int found, int count, const char* word,
+     int distance)
+{
+     Suggestion suggestion = { word, distance };
+     int position = found;
+     while (position > 0 && suggestionCompare(&suggestions[position - 1], &suggestion) > 0) {
+          position--;
+     }
+     if (position >= count) {
+          return found;
+     }
+
+     int last = found < count ? found : count - 1;
+     memmove(&suggestions[position + 1], &suggestions[position],
+          sizeof(Suggestion) * (last - position));
+     suggestions[position] = suggestion;
+     return found < count ? found + 1 : count;
+}
+
+/**
+* Starts an empty top-k over the given storage.
+* @param top
+* @param storage Room for capacity suggestions; holds the heap.
+* @param capacity Number of suggestions to keep.
+*/
+void suggestTopKInit(SuggestTopK* top, Suggestion* storage, int capacity)
+{
+     top->heap = storage;
+     top->count = 0;
+     top->capacity = capacity > 0 ? capacity : 0;
+}
+
+/**
+* Returns the largest distance a word can have and still be kept: the worst
+* kept distance once the top-k is full, and limit until then. A word at that
+* distance is only kept if it ranks before the worst word.
+* @param top
+* @param limit Distance returned while the top-k is not full.
+* @return The cutoff distance.
+*/
+int suggestTopKCutoff(const SuggestTopK* top, int limit)
+{
+     if (top->count < top->capacity) {
+          return limit;
+     }
+     return top->capacity > 0 ? top->heap[0].distance : -1;
+}
+
+/**
+* Offers a word: keeps it if the top-k is not full or it ranks before the
+* worst word kept, which it then replaces.
+* @param top
+* @param word
+* @param distance
+* @return 1 if the word was kept, 0 otherwise.
+*/
+int suggestTopKOffer(SuggestTopK* top, const char* word, int distance)
+{
+     Suggestion suggestion = { word, distance };
+     Suggestion* heap = top->heap;
+     int index;
+
+     if (top->count < top->capacity) {
+          /* Sift up from the new leaf */
+          index = top->count++;
+          while (index > 0 && suggestionCompare(&heap[(index - 1) / 2], &suggestion) < 0) {
+               heap[index] = heap[(index - 1) / 2];
+               index = (index - 1) / 2;
+          }
+          heap[index] = suggestion;
+          return 1;
+     }
+     if (top->capacity == 0 || suggestionCompare(&suggestion, &heap[0]) >= 0) {
+          return 0;
+     }
+
+     /* Replace the worst word and sift down */
+     index = 0;
+     while (1) {
+          int child = 2 * index + 1;
+          if (child >= top->count) {
+               break;
+          }
+          if (child + 1 < top->count && suggestionCompare(&heap[child + 1], &heap[child]) > 0) {
+               child++;
+          }
+          if (suggestionCompare(&heap[child], &suggestion) <= 0) {
+               break;
+          }
+          heap[index] = heap[child];
+          index = child;
+     }
+     heap[index] = suggestion;
+     return 1;
+}
+
+/**
+* Compares two suggestions by rank for qsort.
+*/
+static int compareSuggestions(const void* a, const void* b)
+{
+     return suggestionCompare(a, b);
+}
+
+/**
+* Sorts the kept words best first, which ends the top-k: no more words may
+* be offered.
+* @param top
+* @return Number of words kept.
+*/
+int suggestTopKSort(SuggestTopK* top)
+{
+     qsort(top->heap, top->count, sizeof(Suggestion), compareSuggestions);
+     return top->count;
+}
+
+/**
+* Offers the words of one length to the top-k. A batch is skipped when the
+* letter sets of its words show that none can come within the cutoff, and
+* the kernel gives up on the words that cannot either; the cutoff is read
+* again for every batch, so it tightens as the top-k fills with nearer
+* words.
+* @param suggester
+* @param pattern The misspelled word.
+* @param signature Letter set of the misspelled word.
+* @param length Word length to visit.
+* @param top
+* @param limit Cutoff while the top-k is not full.
+*/
+static void scanLength(Suggester* suggester, const EditPattern* pattern, unsigned int signature,
+     int length, SuggestTopK* top, int limit)
+{
+     EditBatchSet* band = suggester->scanBands[length];
+     const char* const* keys;
+     const unsigned int* signatures;
+     int distances[EDIT_BATCH_LANES];
+     hashMapKeysOfLength(suggester->map, length, &keys, &signatures);
+
+     for (int b = 0; b < band->count; b++) {
+          EditBatch* batch = &band->batches[b];
+          int cutoff = suggestTopKCutoff(top, limit);
+
+          int bound = cutoff + 1;
+          for (int lane = 0; lane < batch->count; lane++) {
+               int lower = hashMapSignatureDistance(signature, signatures[b * EDIT_BATCH_LANES + lane]);
+               if (lower < bound) {
+                    bound = lower;
+               }
+          }
+          if (bound > cutoff) {
+               continue;
+          }
+
+          editBatchDistancesBounded(pattern, batch, cutoff, distances);
+          for (int lane = 0; lane < batch->count; lane++) {
+               /* The word itself is not a suggestion */
+               int distance = distances[lane];
+               if (distance > 0 && distance <= suggestTopKCutoff(top, limit)) {
+                    suggestTopKOffer(top, batch->words[lane], distance);
+               }
+          }
+     }
+}
+
+/**
+* Scans the dictionary for the nearest words in a single pass. A word's
+* distance is at least the difference of the lengths, so lengths are visited
+* nearest the word's own first: the top-k fills with near words early, and
+* the scan ends at the first length further away than the worst word kept.
+* @param suggester
+* @param word
+* @param suggestions
+* @param count Number of suggestions wanted.
+* @return Number of suggestions found.
+*/
+static int suggestScan(Suggester* suggester, const char* word, Suggestion* suggestions,
+     int count)
+{
+     int maxLength = suggester->scanMaxLength;
+     int length = (int)strlen(word);
+     /* No two words are further apart than this */
+     int limit = length + (maxLength > 0 ? maxLength : 0);
+
+     EditPattern pattern;
+     editPatternInit(&pattern, word, length);
+     unsigned int signature = hashMapSignature(word, length);
+     SuggestTopK top;
+     suggestTopKInit(&top, suggestions, count);
+
+     for (int delta = 0; delta <= limit && delta <= suggestTopKCutoff(&top, limit); delta++) {
+          if (length - delta >= 0 && length - delta <= maxLength) {
+               scanLength(suggester, &pattern, signature, length - delta, &top, limit);
+          }
+          if (delta > 0 && length + delta <= maxLength) {
+               scanLength(suggester, &pattern, signature, length + delta, &top, limit);
+          }
+     }
+     return suggestTopKSort(&top);
+}
+
+/* Number of batches in one task of a parallel search */
+#define PARALLEL_TASK_BATCHES 64
+
+/* A run of batches of one word length */
+typedef struct ScanRange
+{
+     int length;
+     int first;
+     int end;
+} ScanRange;
+
+/* A parallel search: the query, its tasks, and the top-k of each worker */
+typedef struct ParallelSearch
+{
+     Suggester* suggester;
+     EditPattern pattern;
+     int length;
+     unsigned int signature;
+     int count;
+     // Cutoff while a top-k is not full.
+     int limit;
+     ScanRange* tasks;
+     // A top-k for each worker, over count suggestions each in lists.
+     SuggestTopK* tops;
+     Suggestion* lists;
+} ParallelSearch;
+
+/**
+* Compares the query with one range of batches and offers the words to the
+* worker's own top-k, whose worst distance cuts off the comparisons as in
+* scanLength. A range whose length is further from the query's than that
+* distance is skipped whole.
+* @param context The ParallelSearch.
+* @param task Index of the range.
+* @param worker
+*/
+static void searchRange(void* context, int task, int worker)
+{
+     ParallelSearch* search = context;
+     Suggester* suggester = search->suggester;
+     ScanRange range = search->tasks[task];
+     EditBatchSet* band = suggester->scanBands[range.length];
+     SuggestTopK* top = &search->tops[worker];
+     int difference = abs(range.length - search->length);
+     int distances[EDIT_BATCH_LANES];
+     const char* const* keys;
+     const unsigned int* signatures;
+     hashMapKeysOfLength(suggester->map, range.length, &keys, &signatures);
+
+     for (int b = range.first; b < range.end; b++) {
+          EditBatch* batch = &band->batches[b];
+          int cutoff = suggestTopKCutoff(top, search->limit);
+          if (difference > cutoff) {
+               break;
+          }
+          int bound = cutoff + 1;
+          for (int lane = 0; lane < batch->count; lane++) {
+               int lower = hashMapSignatureDistance(search->signature,
+                    signatures[b * EDIT_BATCH_LANES + lane]);
+               if (lower < bound) {
+                    bound = lower;
+               }
+          }
+          if (bound > cutoff) {
+               continue;
+          }
+
+          editBatchDistancesBounded(&search->pattern, batch, cutoff, distances);
+          for (int lane = 0; lane < batch->count; lane++) {
+               int distance = distances[lane];
+               if (distance > 0 && distance <= suggestTopKCutoff(top, search->limit)) {
+                    suggestTopKOffer(top, batch->words[lane], distance);
+               }
+          }
+     }
+}
+
+/**
+* Finds the closest words to the given one by comparing it with the whole
+* dictionary on the suggester's thread pool. Each word length is split into
+* ranges of batches, handed out nearest length first so that workers fill
+* their top-k early and can prune the rest. The workers' words are merged in
+* a final top-k by rank, so the result does not depend on the number of
+* threads or on which thread compared which words.
+* @param suggester
+* @param word
+* @param suggestions
+* @param count Number of suggestions wanted.
+* @return Number of suggestions found.
+*/
+static int suggestParallel(Suggester* suggester, const char* word, Suggestion* suggestions,
+     int count)
+{
+     if (count <= 0) {
+          return 0;
+     }
+
+     ParallelSearch search;
+     int maxLength = suggester->scanMaxLength;
+     int workers = threadPoolSize(suggester->pool);
+     search.suggester = suggester;
+     search.length = (int)strlen(word);
+     editPatternInit(&search.pattern, word, search.length);
+     search.signature = hashMapSignature(word, search.length);
+     search.count = count;
+     search.limit = search.length + maxLength;
+     search.lists = malloc(sizeof(Suggestion) * count * workers);
+     search.tops = malloc(sizeof(SuggestTopK) * workers);
+     for (int worker = 0; worker < workers; worker++) {
+          suggestTopKInit(&search.tops[worker], search.lists + worker * count, count);
+     }
+     search.tasks = malloc(sizeof(ScanRange) *
+          (suggester->scanBatchOffsets[maxLength + 1] / PARALLEL_TASK_BATCHES + maxLength + 2));
+
+     /* Lengths nearest to the word's own come first */
+     int tasks = 0;
+     for (int delta = 0; delta <= search.length || delta <= maxLength; delta++) {
+          for (int side = 0; side < (delta > 0 ? 2 : 1); side++) {
+               int length = side == 0 ? search.length - delta : search.length + delta;
+               if (length < 0 || length > maxLength) {
+                    continue;
+               }
+               int batches = suggester->scanBands[length]->count;
+               for (int first = 0; first < batches; first += PARALLEL_TASK_BATCHES) {
+                    search.tasks[tasks].length = length;
+                    search.tasks[tasks].first = first;
+                    search.tasks[tasks].end = first + PARALLEL_TASK_BATCHES < batches ?
+                         first + PARALLEL_TASK_BATCHES : batches;
+                    tasks++;
+               }
+          }
+     }
+
+     threadPoolRun(suggester->pool, searchRange, &search, tasks);
+
+     /* Merge the workers' words */
+     SuggestTopK top;
+     suggestTopKInit(&top, suggestions, count);
+     for (int worker = 0; worker < workers; worker++) {
+          SuggestTopK* own = &search.tops[worker];
+          for (int i = 0; i < own->count; i++) {
+               suggestTopKOffer(&top, own->heap[i].word, own->heap[i].distance);
+          }
+     }
+
+     free(search.tasks);
+     free(search.tops);
+     free(search.lists);
+     return suggestTopKSort(&top);
+}
+
+/**
+* Finds suggestions for a misspelled word with the suggester's engine.
+* @param suggester
+* @param word
+* @param suggestions
+* @param count
+* @return Number of suggestions found.
+*/
+static int findWithEngine(Suggester* suggester, const char* word, Suggestion* suggestions,
+     int count)
+{
+     switch (suggester->engine) {
+     case SUGGEST_BKTREE:
+          return bkTreeNearest(suggester->bkTree, word, 1, suggestions, count);
+     case SUGGEST_SYMSPELL:
+          return symSpellFind(suggester->symSpell, word, 1, suggestions, count);
+     case SUGGEST_PARALLEL:
+          return suggestParallel(suggester, word, suggestions, count);
+     case SUGGEST_DAWG:
+          return dawgNearest(suggester->dawg, word, 1, suggestions, count);
+     case SUGGEST_SCAN:
+     default:
+          return suggestScan(suggester, word, suggestions, count);
+     }
+}
+
+/**
+* Returns 1 if the word is in the dictionary and 0 otherwise, asking the
+* word graph when the suggester has one and the map otherwise.
+* @param suggester
+* @param word
+* @return 1 if the word is found, 0 otherwise.
+*/
+int suggesterContains(Suggester* suggester, const char* word)
+{
+     assert(suggester != 0);
+
+     if (suggester->dawg != 0) {
+          return dawgContainsKey(suggester->dawg, word);
+     }
+     return hashMapContainsKey(suggester->map, word);
+}
+
+/**
+* Finds suggestions for a misspelled word, from the cache if the word was
+* looked up recently and with the suggester's engine otherwise.
+* @param suggester
+* @param word
+* @param suggestions Filled with the suggestions found.
+* @param count Number of suggestions wanted.
+* @return Number of suggestions found, at most count.
+*/
+int suggesterFind(Suggester* suggester, const char* word, Suggestion* suggestions, int count)
+{
+     assert(suggester != 0);
+
+     if (suggester->cache == 0 || count > SUGGESTION_COUNT) {
+          return findWithEngine(suggester, word, suggestions, count);
+     }
+
+     unsigned int generation = hashMapGeneration(suggester->map);
+     int found = suggestCacheGet(suggester->cache, word, generation, suggestions, count);
+     if (found < 0) {
+          found = findWithEngine(suggester, word, suggestions, count);
+          suggestCachePut(suggester->cache, word, generation, suggestions, count, found);
+     }
+     return found;
+}
@@ -0,0 +1,118 @@
+#ifndef SUGGEST_H
+#define SUGGEST_H
+
+#include "hashMap.h"
+
+/*
+* Finds dictionary words close to a misspelled word. Several engines are
+* available; all of them rank words by Levenshtein distance, and words at the
+* same distance alphabetically.
+*/
+
+#define SUGGESTION_COUNT 6
+
+typedef struct Suggestion Suggestion;
+typedef struct SuggestTopK SuggestTopK;
+typedef struct Suggester Suggester;
+typedef struct SuggestOptions SuggestOptions;
+typedef struct BkTree BkTree;
+typedef struct SymSpell SymSpell;
+typedef struct Dawg Dawg;
+typedef struct EditBatchSet EditBatchSet;
+typedef struct ThreadPool ThreadPool;
+typedef struct SuggestCache SuggestCache;
+
+struct Suggestion
+{
+     // Dictionary word, owned by the dictionary.
+     const char* word;
+     int distance;
+};
+
+/*
+* The best suggestions offered so far, at most capacity of them, in a heap
+* whose root is the worst one. A word is offered by comparing it with the
+* root alone. While the heap is full the root's distance is the largest
+* distance still worth computing, so searches pass it to the distance kernel
+* as a cutoff and tighten as better words come in.
+*/
+struct SuggestTopK
+{
+     Suggestion* heap;
+     int count;
+     int capacity;
+};
+
+typedef enum SuggestEngine
+{
+     // Compare with every word of the hash map.
+     SUGGEST_SCAN,
+     // Query a BK-tree built over the dictionary.
+     SUGGEST_BKTREE,
+     // Look up the word's deletes in a symmetric delete index.
+     SUGGEST_SYMSPELL,
+     // Compare with every word of the hash map on a pool of threads and keep
+     // the closest.
+     SUGGEST_PARALLEL,
+     // Walk a minimized word graph of the dictionary, abandoning prefixes
+     // that are already too far from the word.
+     SUGGEST_DAWG
+} SuggestEngine;
+
+struct SuggestOptions
+{
+     SuggestEngine engine;
+     // Largest distance the symmetric delete index answers.
+     int symSpellDistance;
+     // File to load the symmetric delete index from, or to save it to after
+     // building it. NULL to always build it in memory.
+     const char* symSpellPath;
+     // Threads the parallel engine searches with, or 0 for one per processor.
+     int threads;
+     // Pool the parallel engine uses instead of starting threads of its own,
+     // or NULL. The suggester does not delete it.
+     ThreadPool* pool;
+     // Memory for caching the suggestions of recent words, or 0 for no cache.
+     size_t cacheBytes;
+};
+
+struct Suggester
+{
+     HashMap* map;
+     SuggestEngine engine;
+     BkTree* bkTree;
+     SymSpell* symSpell;
+     Dawg* dawg;
+     // Scan engine: one batch set per word length, from the map's length
+     // index, and the number of batches before each length's set.
+     EditBatchSet** scanBands;
+     int* scanBatchOffsets;
+     int scanMaxLength;
+     // Parallel engine: the threads sharing the scan index.
+     ThreadPool* pool;
+     int ownsPool;
+     // Suggestions of recent words, or NULL.
+     SuggestCache* cache;
+};
+
+int suggestEngineByName(const char* name, SuggestEngine* engine);
+int suggestEngineByIndex(int index, SuggestEngine* engine);
+const char* suggestEngineName(SuggestEngine engine);
+void suggestEnginePrintNames(FILE* out);
+
+void suggestOptionsInit(SuggestOptions* options);
+Suggester* suggesterNew(HashMap* map, const SuggestOptions* options);
+void suggesterPrintIndex(Suggester* suggester, FILE* out);
+void suggesterDelete(Suggester* suggester);
+int suggesterContains(Suggester* suggester, const char* word);
+int suggesterFind(Suggester* suggester, const char* word, Suggestion* suggestions, int count);
+int suggestionInsert(Suggestion* suggestions, int found, int count, const char* word,
+     int distance);
+int suggestionCompare(const Suggestion* a, const Suggestion* b);
+
+void suggestTopKInit(SuggestTopK* top, Suggestion* storage, int capacity);
+int suggestTopKCutoff(const SuggestTopK* top, int limit);
+int suggestTopKOffer(SuggestTopK* top, const char* word, int distance);
+int suggestTopKSort(SuggestTopK* top);
+
+#endif
@@ -0,0 +1,283 @@
+/****************************************************************
+** Program Filename: suggestCache.c
+** Author: Chelsea Egan
+** Description: Implements a bounded cache of suggestions keyed
+** by the misspelled word. Each shard indexes its entries with a
+** hash map and evicts with the CLOCK algorithm. Evicted words
+** stay in the index's arena, so the index is rebuilt whenever
+** dead words take up more room than live ones.
+****************************************************************/
+
+#include "suggestCache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+
+/* Approximate bytes an entry costs besides the entry itself: up to three
+   index slots and its word with some slack */
+#define ENTRY_OVERHEAD (3 * sizeof(HashSlot) + 16)
+
+/**
+* Empties a shard's index, keeping its entries array. The index starts small
+* and grows incrementally, so no put stalls the shard's lock on a rehash.
+* @param shard
+*/
+static void resetShard(SuggestCacheShard* shard)
+{
+     if (shard->index != 0) {
+          hashMapDelete(shard->index);
+     }
+     shard->index = hashMapNew(SUGGEST_CACHE_INDEX_SLOTS);
+     hashMapSetIncrementalResize(shard->index, 1);
+     shard->size = 0;
+     shard->hand = 0;
+     shard->keyBytes = 0;
+}
+
+/**
+* Creates a cache that uses about the given number of bytes when full.
+* @param maxBytes
+* @return The allocated cache, or NULL if its entries cannot be allocated.
+*/
+SuggestCache* suggestCacheNew(size_t maxBytes)
+{
+     SuggestCache* cache = malloc(sizeof(SuggestCache));
+     size_t shards = maxBytes / (4 * ARENA_BLOCK_SIZE);
+     cache->shardCount = shards < 1 ? 1 : shards > SUGGEST_CACHE_SHARDS ? SUGGEST_CACHE_SHARDS : (int)shards;
+     cache->maxBytes = maxBytes;
+
+     /* Leave room for each shard's first arena block */
+     size_t budget = maxBytes / cache->shardCount;
+     budget -= budget > 2 * ARENA_BLOCK_SIZE ? ARENA_BLOCK_SIZE : budget / 2;
+     size_t perShard = budget / (sizeof(SuggestCacheEntry) + ENTRY_OVERHEAD);
+
+     for (int i = 0; i < cache->shardCount; i++) {
+          SuggestCacheShard* shard = &cache->shards[i];
+          pthread_mutex_init(&shard->lock, 0);
+          shard->capacity = perShard < 1 ? 1 : perShard > INT_MAX ? INT_MAX : (int)perShard;
+          shard->entries = malloc(sizeof(SuggestCacheEntry) * (size_t)shard->capacity);
+          if (shard->entries == 0) {
+               pthread_mutex_destroy(&shard->lock);
+               cache->shardCount = i;
+               suggestCacheDelete(cache);
+               return 0;
+          }
+          shard->index = 0;
+          shard->generation = 0;
+          shard->hits = 0;
+          shard->misses = 0;
+          shard->evictions = 0;
+          shard->invalidations = 0;
+          resetShard(shard);
+     }
+     return cache;
+}
+
+/**
+* Frees the cache.
+* @param cache
+*/
+void suggestCacheDelete(SuggestCache* cache)
+{
+     for (int i = 0; i < cache->shardCount; i++) {
+          hashMapDelete(cache->shards[i].index);
+          free(cache->shards[i].entries);
+          pthread_mutex_destroy(&cache->shards[i].lock);
+     }
+     free(cache);
+}
+
+/**
+* Returns the shard a word belongs to, locked, after emptying it if it was
+* filled for another dictionary generation.
+* @param cache
+* @param word
+* @param generation
+* @return The locked shard.
+*/
+static SuggestCacheShard* lockShard(SuggestCache* cache, const char* word, unsigned int generation)
+{
+     unsigned int hash = hashFunctionWy(word, (int)strlen(word));
+     SuggestCacheShard* shard = &cache->shards[(hash >> 16) % cache->shardCount];
+
+     pthread_mutex_lock(&shard->lock);
+     if (shard->generation != generation) {
+          if (shard->size > 0) {
+               shard->invalidations++;
+               resetShard(shard);
+          }
+          shard->generation = generation;
+     }
+     return shard;
+}
+
+/**
+* Looks up the suggestions cached for a word.
+* @param cache
+* @param word
+* @param generation Generation of the dictionary the suggestions are for.
+* @param suggestions Filled with the cached suggestions on a hit.
+* @param count Number of suggestions wanted.
+* @return Number of suggestions, or -1 if none are cached for count.
+*/
+int suggestCacheGet(SuggestCache* cache, const char* word, unsigned int generation,
+     Suggestion* suggestions, int count)
+{
+     assert(cache != 0);
+
+     SuggestCacheShard* shard = lockShard(cache, word, generation);
+     int found = -1;
+     int* value = hashMapGet(shard->index, word);
+     /* A shorter list than the one wanted is no use */
+     if (value != 0 && shard->entries[*value].count >= count) {
+          SuggestCacheEntry* entry = &shard->entries[*value];
+          found = entry->found < count ? entry->found : count;
+          memcpy(suggestions, entry->suggestions, sizeof(Suggestion) * found);
+          entry->referenced = 1;
+          shard->hits++;
+     }
+     else {
+          shard->misses++;
+     }
+     pthread_mutex_unlock(&shard->lock);
+     return found;
+}
+
+/**
+* Moves the clock hand to the next entry that was not used since the hand
+* last passed it, clearing marks on the way, and removes that entry's word.
+* @param shard
+* @return Index of the freed entry.
+*/
+static int evict(SuggestCacheShard* shard)
+{
+     while (shard->entries[shard->hand].referenced) {
+          shard->entries[shard->hand].referenced = 0;
+          shard->hand = (shard->hand + 1) % shard->capacity;
+     }
+     int victim = shard->hand;
+     shard->hand = (shard->hand + 1) % shard->capacity;
+     shard->keyBytes -= strlen(shard->entries[victim].word) + 1;
+     hashMapRemove(shard->index, shard->entries[victim].word);
+     shard->evictions++;
+     return victim;
+}
+
+/**
+* Rebuilds a shard's index from its live entries, dropping the bytes of
+* evicted words.
+* @param shard
+*/
+static void compactIndex(SuggestCacheShard* shard)
+{
+     HashMap* index = hashMapNew(shard->capacity * 4 / 3 + 1);
+     hashMapSetIncrementalResize(index, 1);
+     for (int i = 0; i < shard->size; i++) {
+          shard->entries[i].word = hashMapIntern(index, shard->entries[i].word);
+          *hashMapGet(index, shard->entries[i].word) = i;
+     }
+     hashMapDelete(shard->index);
+     shard->index = index;
+}
+
+/**
+* Caches the suggestions found for a word, evicting another word if the
+* word's shard is full.
+* @param cache
+* @param word
+* @param generation Generation of the dictionary the suggestions are for.
+* @param suggestions
+* @param count Number of suggestions that were asked for.
+* @param found Number of suggestions found, at most SUGGESTION_COUNT.
+*/
+void suggestCachePut(SuggestCache* cache, const char* word, unsigned int generation,
+     const Suggestion* suggestions, int count, int found)
+{
+     assert(cache != 0);
+     assert(found <= SUGGESTION_COUNT);
+
+     SuggestCacheShard* shard = lockShard(cache, word, generation);
+     int* value = hashMapGet(shard->index, word);
+     int slot;
+     if (value != 0) {
+          slot = *value;
+     }
+     else {
+          if (shard->size < shard->capacity) {
+               slot = shard->size++;
+          }
+          else {
+               slot = evict(shard);
+               /* Evicted words linger in the arena; drop them once they dominate */
+               if (shard->index->keys.bytesUsed > 2 * shard->keyBytes + ARENA_BLOCK_SIZE) {
+                    shard->entries[slot] = shard->entries[shard->size - 1];
+                    shard->size--;
+                    compactIndex(shard);
+                    slot = shard->size++;
+               }
+          }
+          shard->entries[slot].word = hashMapIntern(shard->index, word);
+          *hashMapGet(shard->index, word) = slot;
+          shard->keyBytes += strlen(word) + 1;
+     }
+
+     SuggestCacheEntry* entry = &shard->entries[slot];
+     entry->count = count;
+     entry->found = found;
+     memcpy(entry->suggestions, suggestions, sizeof(Suggestion) * found);
+     entry->referenced = 0;
+     pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+* Empties the cache. The counters are kept.
+* @param cache
+*/
+void suggestCacheClear(SuggestCache* cache)
+{
+     for (int i = 0; i < cache->shardCount; i++) {
+          pthread_mutex_lock(&cache->shards[i].lock);
+          resetShard(&cache->shards[i]);
+          pthread_mutex_unlock(&cache->shards[i].lock);
+     }
+}
+
+/**
+* Adds up the counters and memory use of all shards.
+* @param cache
+* @param stats
+*/
+void suggestCacheGetStats(SuggestCache* cache, SuggestCacheStats* stats)
+{
+     memset(stats, 0, sizeof(SuggestCacheStats));
+     for (int i = 0; i < cache->shardCount; i++) {
+          SuggestCacheShard* shard = &cache->shards[i];
+          pthread_mutex_lock(&shard->lock);
+          stats->hits += shard->hits;
+          stats->misses += shard->misses;
+          stats->evictions += shard->evictions;
+          stats->invalidations += shard->invalidations;
+          stats->entries += shard->size;
+          stats->bytes += sizeof(SuggestCacheEntry) * shard->capacity +
+               sizeof(HashSlot) * (hashMapCapacity(shard->index) + shard->index->oldCapacity) +
+               shard->index->keys.bytesReserved;
+          pthread_mutex_unlock(&shard->lock);
+     }
+}
+
+/**
+* Prints the cache's counters on one line.
+* @param cache
+* @param out
+*/
+void suggestCachePrintStats(SuggestCache* cache, FILE* out)
+{
+     SuggestCacheStats stats;
+     suggestCacheGetStats(cache, &stats);
+     long long lookups = stats.hits + stats.misses;
+     fprintf(out, "Suggestion cache: %d words, %.1f KB, %lld hits, %lld misses (%.1f%% hits), "
+          "%lld evictions, %lld invalidations\n", stats.entries, (double)stats.bytes / 1024,
+          stats.hits, stats.misses, lookups > 0 ? 100.0 * stats.hits / lookups : 0.0,
+          stats.evictions, stats.invalidations);
+}
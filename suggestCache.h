@@ -0,0 +1,88 @@
+#ifndef SUGGEST_CACHE_H
+#define SUGGEST_CACHE_H
+
+#include "suggest.h"
+#include <pthread.h>
+
+/*
+* Remembers the suggestions found for recent misspellings. The cache is split
+* into shards by the hash of the word, each with its own lock, so threads
+* checking a document rarely wait for each other. When a shard is full the
+* CLOCK algorithm picks the entry to evict: every hit marks its entry, and
+* the clock hand passes over marked entries once, clearing the mark, before
+* it evicts one.
+*
+* Suggestions point into the dictionary, so each shard remembers the
+* dictionary generation it was filled for and empties itself when the
+* dictionary has changed since.
+*/
+
+// Most shards a cache has. Small caches have fewer, since every shard needs
+// at least one arena block for its words.
+#define SUGGEST_CACHE_SHARDS 16
+// Slots a shard's index starts with; it grows as words are cached.
+#define SUGGEST_CACHE_INDEX_SLOTS 64
+
+typedef struct SuggestCache SuggestCache;
+typedef struct SuggestCacheEntry SuggestCacheEntry;
+typedef struct SuggestCacheShard SuggestCacheShard;
+typedef struct SuggestCacheStats SuggestCacheStats;
+
+struct SuggestCacheEntry
+{
+     // Misspelled word, owned by the shard's index.
+     const char* word;
+     // Number of suggestions asked for, and found, when the entry was made.
+     int count;
+     int found;
+     Suggestion suggestions[SUGGESTION_COUNT];
+     // Set by hits and cleared by the clock hand.
+     int referenced;
+};
+
+struct SuggestCacheShard
+{
+     pthread_mutex_t lock;
+     // Maps each cached word to its entry.
+     HashMap* index;
+     SuggestCacheEntry* entries;
+     int size;
+     int capacity;
+     int hand;
+     // Bytes of the words of live entries.
+     size_t keyBytes;
+     unsigned int generation;
+     long long hits;
+     long long misses;
+     long long evictions;
+     long long invalidations;
+};
+
+struct SuggestCache
+{
+     SuggestCacheShard shards[SUGGEST_CACHE_SHARDS];
+     int shardCount;
+     size_t maxBytes;
+};
+
+struct SuggestCacheStats
+{
+     long long hits;
+     long long misses;
+     long long evictions;
+     long long invalidations;
+     int entries;
+     size_t bytes;
+};
+
+SuggestCache* suggestCacheNew(size_t maxBytes);
+void suggestCacheDelete(SuggestCache* cache);
+int suggestCacheGet(SuggestCache* cache, const char* word, unsigned int generation,
+     Suggestion* suggestions, int count);
+void suggestCachePut(SuggestCache* cache, const char* word, unsigned int generation,
+     const Suggestion* suggestions, int count, int found);
+void suggestCacheClear(SuggestCache* cache);
+void suggestCacheGetStats(SuggestCache* cache, SuggestCacheStats* stats);
+void suggestCachePrintStats(SuggestCache* cache, FILE* out);
+
+#endif
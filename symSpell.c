@@ -0,0 +1,523 @@
+/****************************************************************
+** Program Filename: symSpell.c
+** Author: Chelsea Egan
+** Description: Implements a symmetric delete index for spelling
+** suggestions. The index maps every string obtained by deleting
+** up to maxDistance characters from a dictionary word to the
+** words it came from. Candidates are verified with the bounded
+** edit distance kernel. Posting lists are stored back to back in
+** one int array, and the index can be saved to a file that is
+** mapped back in on the next run.
+****************************************************************/
+
+#include "symSpell.h"
+#include "editDistance.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Words longer than this are only indexed under themselves */
+#define SYM_SPELL_MAX_LENGTH 256
+
+#define SYM_SPELL_MAGIC "SPELLSYM"
+#define SYM_SPELL_VERSION 2
+
+/* Called for the word itself and each of its deletes */
+typedef void (*DeleteVisit)(const char* variant, int length, void* context);
+
+/**
+* Calls visit for each string obtained by deleting between 1 and remaining
+* characters at positions from start onwards. Positions are deleted in
+* increasing order, so each combination of positions is visited once.
+* @param word
+* @param length
+* @param start First position that may be deleted.
+* @param remaining Number of characters that may still be deleted.
+* @param buffers One buffer per remaining deletion.
+* @param visit
+* @param context
+*/
+static void visitDeletes(const char* word, int length, int start, int remaining,
+     char (*buffers)[SYM_SPELL_MAX_LENGTH], DeleteVisit visit, void* context)
+{
+     char* variant = buffers[0];
+     for (int i = start; i < length; i++) {
+          memcpy(variant, word, i);
+          memcpy(variant + i, word + i + 1, length - i - 1);
+          visit(variant, length - 1, context);
+          if (remaining > 1) {
+               visitDeletes(variant, length - 1, i, remaining - 1, buffers + 1, visit, context);
+          }
+     }
+}
+
+/**
+* Calls visit for the word and for every delete of it up to maxDistance
+* characters. The same string can be visited more than once when the word has
+* repeated letters.
+* @param word
+* @param length
+* @param maxDistance
+* @param visit
+* @param context
+*/
+static void forEachVariant(const char* word, int length, int maxDistance, DeleteVisit visit,
+     void* context)
+{
+     char buffers[SYM_SPELL_MAX_DISTANCE][SYM_SPELL_MAX_LENGTH];
+
+     visit(word, length, context);
+     if (length <= SYM_SPELL_MAX_LENGTH) {
+          visitDeletes(word, length, 0, maxDistance, buffers, visit, context);
+     }
+}
+
+/*
+* State shared by the two passes that build the index.
+*/
+typedef struct
+{
+     SymSpell* index;
+     // Per delete: number of words, and the last word counted or stored.
+     int* counts;
+     int* lastWords;
+     int entries;
+     int capacity;
+     // Per delete during the second pass: next free position in postings.
+     int* fill;
+     int* postings;
+     // Position in the word list of the word being indexed.
+     int word;
+} BuildState;
+
+/**
+* First pass: registers the delete and counts the word under it once.
+*/
+static void countVariant(const char* variant, int length, void* context)
+{
+     BuildState* state = context;
+     int* entry = hashMapGetSlice(state->index->deletes, variant, length);
+     int id;
+     if (entry == 0) {
+          if (state->entries == state->capacity) {
+               state->capacity *= 2;
+               state->counts = realloc(state->counts, sizeof(int) * state->capacity);
+               state->lastWords = realloc(state->lastWords, sizeof(int) * state->capacity);
+          }
+          id = state->entries++;
+          state->counts[id] = 0;
+          state->lastWords[id] = -1;
+          hashMapPutSlice(state->index->deletes, variant, length, id);
+     }
+     else {
+          id = *entry;
+     }
+
+     if (state->lastWords[id] != state->word) {
+          state->lastWords[id] = state->word;
+          state->counts[id]++;
+     }
+}
+
+/**
+* Second pass: stores the word in the delete's posting list once.
+*/
+static void storeVariant(const char* variant, int length, void* context)
+{
+     BuildState* state = context;
+     int id = *hashMapGetSlice(state->index->deletes, variant, length);
+     if (state->lastWords[id] != state->word) {
+          state->lastWords[id] = state->word;
+          state->postings[state->fill[id]++] = state->word;
+     }
+}
+
+/**
+* Builds the index for every word in the dictionary.
+* @param dictionary Map of words. It must not change while the index is used.
+* @param maxDistance Largest edit distance the index can answer, from 1 to
+* SYM_SPELL_MAX_DISTANCE.
+* @return The allocated index.
+*/
+SymSpell* symSpellBuild(HashMap* dictionary, int maxDistance)
+{
+     assert(dictionary != 0);
+     if (maxDistance < 1) {
+          maxDistance = 1;
+     }
+     if (maxDistance > SYM_SPELL_MAX_DISTANCE) {
+          maxDistance = SYM_SPELL_MAX_DISTANCE;
+     }
+
+     SymSpell* index = malloc(sizeof(SymSpell));
+     index->dictionary = dictionary;
+     index->maxDistance = maxDistance;
+     index->words = malloc(sizeof(const char*) * (hashMapSize(dictionary) + 1));
+     index->wordCount = 0;
+     index->deletes = hashMapNew(hashMapSize(dictionary) * 8);
+     index->file = (FileMap){ 0 };
+
+     BuildState state;
+     state.index = index;
+     state.capacity = 1024;
+     state.entries = 0;
+     state.counts = malloc(sizeof(int) * state.capacity);
+     state.lastWords = malloc(sizeof(int) * state.capacity);
+
+     /* Number the words and count them under each delete */
+     int capacity = hashMapCapacity(dictionary);
+     for (int i = 0; i < capacity; i++) {
+          const char* key = hashMapKeyAt(dictionary, i);
+          if (key != 0) {
+               state.word = index->wordCount;
+               index->words[index->wordCount++] = key;
+               forEachVariant(key, (int)strlen(key), maxDistance, countVariant, &state);
+          }
+     }
+
+     /* Lay out the posting lists */
+     state.fill = malloc(sizeof(int) * (state.entries + 1));
+     int length = 0;
+     for (int id = 0; id < state.entries; id++) {
+          state.fill[id] = length + 1;
+          length += 1 + state.counts[id];
+     }
+     state.postings = malloc(sizeof(int) * (length + 1));
+     for (int id = 0; id < state.entries; id++) {
+          state.postings[state.fill[id] - 1] = state.counts[id];
+          state.lastWords[id] = -1;
+     }
+
+     /* Fill them in */
+     for (int i = 0; i < index->wordCount; i++) {
+          const char* key = index->words[i];
+          state.word = i;
+          forEachVariant(key, (int)strlen(key), maxDistance, storeVariant, &state);
+     }
+
+     /* Point each delete at its posting list */
+     int deletesCapacity = hashMapCapacity(index->deletes);
+     for (int i = 0; i < deletesCapacity; i++) {
+          const char* key = hashMapKeyAt(index->deletes, i);
+          if (key != 0) {
+               int* value = hashMapGet(index->deletes, key);
+               *value = state.fill[*value] - 1 - state.counts[*value];
+          }
+     }
+
+     index->postings = state.postings;
+     index->postingsLength = length;
+
+     free(state.fill);
+     free(state.counts);
+     free(state.lastWords);
+     return index;
+}
+
+/**
+* Frees the index. The dictionary is not freed.
+* @param index
+*/
+void symSpellDelete(SymSpell* index)
+{
+     hashMapDelete(index->deletes);
+     free(index->words);
+     if (index->file.data == 0) {
+          free((void*)index->postings);
+     }
+     fileMapClose(&index->file);
+     free(index);
+}
+
+/**
+* Returns the number of bytes the index occupies: the delete table, the
+* delete strings, the posting lists and the word list.
+* @param index
+* @return Size of the index in bytes.
+*/
+size_t symSpellMemory(SymSpell* index)
+{
+     size_t words = sizeof(const char*) * (size_t)index->wordCount;
+     if (index->file.data != 0) {
+          return index->file.length + words;
+     }
+     return sizeof(HashSlot) * (size_t)hashMapCapacity(index->deletes) +
+          index->deletes->keys.bytesReserved + sizeof(int) * (size_t)index->postingsLength + words;
+}
+
+/*
+* State of a query: the positions of all words found under the query's
+* deletes.
+*/
+typedef struct
+{
+     SymSpell* index;
+     int* words;
+     int size;
+     int capacity;
+} QueryState;
+
+/**
+* Adds the words stored under a delete of the query to the candidates.
+*/
+static void collectVariant(const char* variant, int length, void* context)
+{
+     QueryState* state = context;
+     int* offset = hashMapGetSlice(state->index->deletes, variant, length);
+     if (offset == 0) {
+          return;
+     }
+
+     /* Offsets and counts come from the index file; never read past the lists */
+     int postingsLength = state->index->postingsLength;
+     if (*offset < 0 || *offset >= postingsLength) {
+          return;
+     }
+     const int* list = state->index->postings + *offset;
+     int count = list[0];
+     if (count < 0 || count > postingsLength - *offset - 1) {
+          return;
+     }
+     if (state->size + count > state->capacity) {
+          while (state->size + count > state->capacity) {
+               state->capacity *= 2;
+          }
+          state->words = realloc(state->words, sizeof(int) * state->capacity);
+     }
+     memcpy(state->words + state->size, list + 1, sizeof(int) * count);
+     state->size += count;
+}
+
+static int compareInts(const void* a, const void* b)
+{
+     int x = *(const int*)a;
+     int y = *(const int*)b;
+     return (x > y) - (x < y);
+}
+
+/**
+* Finds the nearest dictionary words within the index's maximum distance.
+* @param index
+* @param word
+* @param minDistance Words closer than this are ignored; pass 1 to leave out
+* the word itself.
+* @param suggestions Filled with the words found, nearest first.
+* @param count Number of suggestions wanted.
+* @return Number of suggestions found, at most count.
+*/
+int symSpellFind(SymSpell* index, const char* word, int minDistance, Suggestion* suggestions,
+     int count)
+{
+     assert(index != 0);
+
+     QueryState state = { index, malloc(sizeof(int) * 256), 0, 256 };
+     forEachVariant(word, (int)strlen(word), index->maxDistance, collectVariant, &state);
+
+     /* Each candidate is verified once */
+     qsort(state.words, state.size, sizeof(int), compareInts);
+     EditPattern pattern;
+     editPatternInit(&pattern, word, (int)strlen(word));
+     int found = 0;
+     for (int i = 0; i < state.size; i++) {
+          if ((i > 0 && state.words[i] == state.words[i - 1]) ||
+               state.words[i] < 0 || state.words[i] >= index->wordCount) {
+               continue;
+          }
+          const char* candidate = index->words[state.words[i]];
+          int distance = editPatternDistance(&pattern, candidate, (int)strlen(candidate),
+               index->maxDistance);
+          if (distance >= minDistance && distance <= index->maxDistance) {
+               found = suggestionInsert(suggestions, found, count, candidate, distance);
+          }
+     }
+
+     free(state.words);
+     return found;
+}
+
+/*
+* Layout of an index file: this header, the posting lists at postingsOffset,
+* the words they number at wordsOffset, each null terminated, and a hash map
+* snapshot of the deletes at deletesOffset. The words are stored as text, so
+* an index fits any dictionary with the same words, however its table is laid
+* out.
+*/
+struct SymSpellHeader
+{
+     char magic[8];
+     unsigned int version;
+     int maxDistance;
+     int wordCount;
+     int postingsLength;
+     unsigned long long wordsLength;
+     unsigned long long postingsOffset;
+     unsigned long long wordsOffset;
+     unsigned long long deletesOffset;
+     // FNV-1a of the posting lists and the words.
+     unsigned long long checksum;
+};
+
+/**
+* Continues a 64-bit FNV-1a checksum over the given bytes.
+* @param checksum Checksum so far.
+* @param data
+* @param length
+* @return The updated checksum.
+*/
+static unsigned long long indexChecksum(unsigned long long checksum, const void* data,
+     size_t length)
+{
+     const unsigned char* bytes = data;
+     for (size_t i = 0; i < length; i++) {
+          checksum ^= bytes[i];
+          checksum *= 1099511628211ull;
+     }
+     return checksum;
+}
+
+/**
+* Writes the index to a file that symSpellLoad can map back in.
+* @param index
+* @param path
+* @return 0 on success, -1 on failure.
+*/
+int symSpellSave(SymSpell* index, const char* path)
+{
+     FILE* out = fopen(path, "wb");
+     if (out == NULL) {
+          return -1;
+     }
+
+     struct SymSpellHeader header;
+     memset(&header, 0, sizeof(header));
+     memcpy(header.magic, SYM_SPELL_MAGIC, sizeof(header.magic));
+     header.version = SYM_SPELL_VERSION;
+     header.maxDistance = index->maxDistance;
+     header.wordCount = index->wordCount;
+     header.postingsLength = index->postingsLength;
+     header.postingsOffset = sizeof(header);
+     header.wordsOffset = header.postingsOffset + sizeof(int) * (size_t)index->postingsLength;
+     header.checksum = indexChecksum(1469598103934665603ull, index->postings,
+          sizeof(int) * (size_t)index->postingsLength);
+     for (int i = 0; i < index->wordCount; i++) {
+          size_t length = strlen(index->words[i]) + 1;
+          header.checksum = indexChecksum(header.checksum, index->words[i], length);
+          header.wordsLength += length;
+     }
+     header.deletesOffset = (header.wordsOffset + header.wordsLength + 63) & ~63ull;
+
+     char padding[64] = { 0 };
+     size_t paddingLength = header.deletesOffset - header.wordsOffset - header.wordsLength;
+     int result = 0;
+     if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+          fwrite(index->postings, sizeof(int), index->postingsLength, out) !=
+               (size_t)index->postingsLength) {
+          result = -1;
+     }
+     for (int i = 0; i < index->wordCount && result == 0; i++) {
+          if (fwrite(index->words[i], strlen(index->words[i]) + 1, 1, out) != 1) {
+               result = -1;
+          }
+     }
+     if (result == 0 &&
+          ((paddingLength > 0 && fwrite(padding, paddingLength, 1, out) != 1) ||
+          hashMapWriteSnapshot(index->deletes, out) != 0)) {
+          result = -1;
+     }
+     if (fclose(out) != 0) {
+          result = -1;
+     }
+     return result;
+}
+
+/**
+* Finds each word of an index file in the dictionary.
+* @param dictionary
+* @param data The file's words, each null terminated.
+* @param length Bytes at data.
+* @param words Filled with the dictionary's copy of each word.
+* @param count Number of words expected.
+* @return 0 if there are exactly count words and all are in the dictionary,
+* -1 otherwise.
+*/
+static int resolveWords(HashMap* dictionary, const char* data, size_t length, const char** words,
+     int count)
+{
+     const char* end = data + length;
+     for (int i = 0; i < count; i++) {
+          const char* terminator = memchr(data, '\0', end - data);
+          if (terminator == 0) {
+               return -1;
+          }
+          words[i] = hashMapFindSlice(dictionary, data, (int)(terminator - data));
+          if (words[i] == 0) {
+               return -1;
+          }
+          data = terminator + 1;
+     }
+     return data == end ? 0 : -1;
+}
+
+/**
+* Maps an index saved by symSpellSave. The posting lists and the delete table
+* are used in place. The whole file is checked first: its checksum, the
+* delete table and that its words are the dictionary's.
+* @param dictionary The dictionary the index was built from.
+* @param path
+* @return The index, or NULL if the file is missing, invalid or was built from
+* a different dictionary.
+*/
+SymSpell* symSpellLoad(HashMap* dictionary, const char* path)
+{
+     FileMap file;
+     if (fileMapOpenPrivate(&file, path) != 0) {
+          return 0;
+     }
+
+     struct SymSpellHeader header;
+     if (file.length < sizeof(header)) {
+          fileMapClose(&file);
+          return 0;
+     }
+     memcpy(&header, file.data, sizeof(header));
+     if (memcmp(header.magic, SYM_SPELL_MAGIC, sizeof(header.magic)) != 0 ||
+          header.version != SYM_SPELL_VERSION ||
+          header.maxDistance < 1 || header.maxDistance > SYM_SPELL_MAX_DISTANCE ||
+          header.wordCount != hashMapSize(dictionary) ||
+          header.postingsOffset != sizeof(header) || header.postingsLength < 0 ||
+          header.wordsOffset != header.postingsOffset + sizeof(int) * (size_t)header.postingsLength ||
+          header.wordsLength > file.length || header.deletesOffset > file.length ||
+          header.wordsOffset + header.wordsLength > header.deletesOffset ||
+          header.deletesOffset % 8 != 0) {
+          fileMapClose(&file);
+          return 0;
+     }
+
+     unsigned long long checksum = indexChecksum(1469598103934665603ull,
+          file.data + header.postingsOffset,
+          header.wordsOffset + header.wordsLength - header.postingsOffset);
+     const char** words = malloc(sizeof(const char*) * (header.wordCount + 1));
+     HashMap* deletes = 0;
+     if (checksum == header.checksum &&
+          resolveWords(dictionary, file.data + header.wordsOffset, header.wordsLength, words,
+               header.wordCount) == 0) {
+          deletes = hashMapViewSnapshot(file.data + header.deletesOffset,
+               file.length - header.deletesOffset, 1);
+     }
+     if (deletes == 0) {
+          free(words);
+          fileMapClose(&file);
+          return 0;
+     }
+
+     SymSpell* index = malloc(sizeof(SymSpell));
+     index->dictionary = dictionary;
+     index->maxDistance = header.maxDistance;
+     index->words = words;
+     index->wordCount = header.wordCount;
+     index->deletes = deletes;
+     index->postings = (const int*)(file.data + header.postingsOffset);
+     index->postingsLength = header.postingsLength;
+     index->file = file;
+     return index;
+}
@@ -0,0 +1,49 @@
+#ifndef SYM_SPELL_H
+#define SYM_SPELL_H
+
+#include "suggest.h"
+
+/*
+* Symmetric delete index. Every word of the dictionary is stored under each
+* string obtained by deleting up to maxDistance of its characters. Two words
+* within maxDistance of each other always share such a delete, so a query
+* only has to generate its own deletes, look them up and verify the words
+* found with levenshtein().
+*
+* Posting lists refer to words by their position in the index's own word
+* list, which holds the dictionary's keys. The dictionary must not change
+* after the index is built.
+*/
+
+#define SYM_SPELL_DISTANCE 2
+// Larger distances make the index too big to be useful.
+#define SYM_SPELL_MAX_DISTANCE 3
+
+typedef struct SymSpell SymSpell;
+
+struct SymSpell
+{
+     HashMap* dictionary;
+     int maxDistance;
+     // Keys of the dictionary, in the order posting lists number them.
+     const char** words;
+     int wordCount;
+     // Maps each delete to the offset of its posting list in postings.
+     HashMap* deletes;
+     // Posting lists: a word count followed by that many positions in
+     // words.
+     const int* postings;
+     int postingsLength;
+     // Index file the postings and deletes are mapped from, if loaded.
+     FileMap file;
+};
+
+SymSpell* symSpellBuild(HashMap* dictionary, int maxDistance);
+SymSpell* symSpellLoad(HashMap* dictionary, const char* path);
+int symSpellSave(SymSpell* index, const char* path);
+void symSpellDelete(SymSpell* index);
+size_t symSpellMemory(SymSpell* index);
+int symSpellFind(SymSpell* index, const char* word, int minDistance, Suggestion* suggestions,
+     int count);
+
+#endif
@@ -0,0 +1,355 @@
+/****************************************************************
+** Program Filename: threadPool.c
+** Author: Chelsea Egan
+** Description: Implements a work-stealing pool of worker
+** threads. Every worker has its own queue of tasks: it runs the
+** newest task of its own queue first, which keeps the data that
+** task submitted warm in its cache, and steals the oldest task
+** of another queue when its own is empty. Idle workers sleep
+** until a task is submitted.
+****************************************************************/
+
+#include "threadPool.h"
+#include <stdlib.h>
+#include <sched.h>
+#include <unistd.h>
+#include <assert.h>
+
+/* Pool and worker number of the running thread, if it belongs to a pool */
+static __thread ThreadPool* currentPool = 0;
+static __thread int currentWorker = 0;
+
+/* Argument of a worker thread */
+typedef struct WorkerStart
+{
+     ThreadPool* pool;
+     int worker;
+} WorkerStart;
+
+/* A job of threadPoolRun: task numbers are handed out in order */
+typedef struct ThreadPoolJob
+{
+     ThreadPoolTask function;
+     void* context;
+     int taskCount;
+     int nextTask;
+} ThreadPoolJob;
+
+/**
+* Returns the number of processors online, which is the pool size used when
+* none is given.
+* @return Number of processors, at least 1.
+*/
+int threadPoolDefaultSize(void)
+{
+     long processors = sysconf(_SC_NPROCESSORS_ONLN);
+     return processors > 0 ? (int)processors : 1;
+}
+
+/**
+* Returns the worker number of the running thread in the pool: its own number
+* for a pool thread, and 0 for any other thread.
+* @param pool
+* @return Worker number.
+*/
+int threadPoolWorker(ThreadPool* pool)
+{
+     return currentPool == pool ? currentWorker : 0;
+}
+
+/**
+* Adds a task at the back of a queue, growing the queue if it is full.
+* @param queue
+* @param item
+*/
+static void queuePush(WorkQueue* queue, ThreadPoolItem item)
+{
+     pthread_mutex_lock(&queue->lock);
+     if (queue->count == queue->capacity) {
+          int capacity = queue->capacity * 2;
+          ThreadPoolItem* items = malloc(sizeof(ThreadPoolItem) * capacity);
+          for (int i = 0; i < queue->count; i++) {
+               items[i] = queue->items[(queue->head + i) % queue->capacity];
+          }
+          free(queue->items);
+          queue->items = items;
+          queue->capacity = capacity;
+          queue->head = 0;
+     }
+     queue->items[(queue->head + queue->count) % queue->capacity] = item;
+     __atomic_store_n(&queue->count, queue->count + 1, __ATOMIC_RELAXED);
+     pthread_mutex_unlock(&queue->lock);
+}
+
+/**
+* Takes a task from a queue: the newest one if the queue belongs to the
+* running worker, the oldest one if the worker is stealing it.
+* @param queue
+* @param newest 1 to take from the back, 0 to take from the front.
+* @param item Set to the task taken.
+* @return 1 if a task was taken, 0 if the queue was empty.
+*/
+static int queueTake(WorkQueue* queue, int newest, ThreadPoolItem* item)
+{
+     /* Check without the lock first, so idle thieves do not contend */
+     if (__atomic_load_n(&queue->count, __ATOMIC_RELAXED) == 0) {
+          return 0;
+     }
+
+     pthread_mutex_lock(&queue->lock);
+     int taken = queue->count > 0;
+     if (taken) {
+          if (newest) {
+               *item = queue->items[(queue->head + queue->count - 1) % queue->capacity];
+          }
+          else {
+               *item = queue->items[queue->head];
+               queue->head = (queue->head + 1) % queue->capacity;
+          }
+          __atomic_store_n(&queue->count, queue->count - 1, __ATOMIC_RELAXED);
+     }
+     pthread_mutex_unlock(&queue->lock);
+     return taken;
+}
+
+/**
+* Finds a task for the worker, from its own queue or else from another one.
+* @param pool
+* @param worker
+* @param item Set to the task found.
+* @return 1 if a task was found, 0 if all queues are empty.
+*/
+static int findTask(ThreadPool* pool, int worker, ThreadPoolItem* item)
+{
+     if (queueTake(&pool->queues[worker], 1, item)) {
+          __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_RELAXED);
+          return 1;
+     }
+     for (int i = 1; i < pool->size; i++) {
+          if (queueTake(&pool->queues[(worker + i) % pool->size], 0, item)) {
+               __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_RELAXED);
+               return 1;
+          }
+     }
+     return 0;
+}
+
+/**
+* Runs a task and marks it finished in its group.
+* @param item
+* @param worker
+*/
+static void runTask(ThreadPoolItem* item, int worker)
+{
+     item->function(item->context, item->task, worker);
+     __atomic_sub_fetch(&item->group->pending, 1, __ATOMIC_RELEASE);
+}
+
+/**
+* Body of a pool thread: runs tasks while there are any and sleeps otherwise.
+* @param argument WorkerStart, freed by the thread.
+* @return NULL
+*/
+static void* workerMain(void* argument)
+{
+     WorkerStart* start = argument;
+     ThreadPool* pool = start->pool;
+     int worker = start->worker;
+     free(start);
+     currentPool = pool;
+     currentWorker = worker;
+
+     for (;;) {
+          ThreadPoolItem item;
+          if (findTask(pool, worker, &item)) {
+               runTask(&item, worker);
+               continue;
+          }
+
+          pthread_mutex_lock(&pool->lock);
+          while (__atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0 && !pool->stopping) {
+               pool->sleeping++;
+               pthread_cond_wait(&pool->wake, &pool->lock);
+               pool->sleeping--;
+          }
+          int stopping = pool->stopping && __atomic_load_n(&pool->queued, __ATOMIC_ACQUIRE) == 0;
+          pthread_mutex_unlock(&pool->lock);
+          if (stopping) {
+               return 0;
+          }
+     }
+}
+
+/**
+* Creates a pool of the given number of workers, counting the calling thread,
+* which becomes worker 0.
+* @param size Number of workers, or 0 or less for one per processor.
+* @return The allocated pool.
+*/
+ThreadPool* threadPoolNew(int size)
+{
+     ThreadPool* pool = malloc(sizeof(ThreadPool));
+     pool->size = size > 0 ? size : threadPoolDefaultSize();
+     pool->threads = malloc(sizeof(pthread_t) * pool->size);
+     pool->queues = malloc(sizeof(WorkQueue) * pool->size);
+     for (int i = 0; i < pool->size; i++) {
+          pthread_mutex_init(&pool->queues[i].lock, 0);
+          pool->queues[i].capacity = 64;
+          pool->queues[i].items = malloc(sizeof(ThreadPoolItem) * pool->queues[i].capacity);
+          pool->queues[i].head = 0;
+          pool->queues[i].count = 0;
+     }
+     pthread_mutex_init(&pool->lock, 0);
+     pthread_cond_init(&pool->wake, 0);
+     pool->queued = 0;
+     pool->sleeping = 0;
+     pool->stopping = 0;
+
+     for (int i = 1; i < pool->size; i++) {
+          WorkerStart* start = malloc(sizeof(WorkerStart));
+          start->pool = pool;
+          start->worker = i;
+          if (pthread_create(&pool->threads[i], 0, workerMain, start) != 0) {
+               /* Run with the threads we have */
+               free(start);
+               pool->size = i;
+               break;
+          }
+     }
+     return pool;
+}
+
+/**
+* Stops the pool's threads and frees the pool. No tasks may be left.
+* @param pool
+*/
+void threadPoolDelete(ThreadPool* pool)
+{
+     pthread_mutex_lock(&pool->lock);
+     pool->stopping = 1;
+     pthread_cond_broadcast(&pool->wake);
+     pthread_mutex_unlock(&pool->lock);
+
+     for (int i = 1; i < pool->size; i++) {
+          pthread_join(pool->threads[i], 0);
+     }
+     for (int i = 0; i < pool->size; i++) {
+          pthread_mutex_destroy(&pool->queues[i].lock);
+          free(pool->queues[i].items);
+     }
+     pthread_cond_destroy(&pool->wake);
+     pthread_mutex_destroy(&pool->lock);
+     free(pool->queues);
+     free(pool->threads);
+     free(pool);
+}
+
+/**
+* Queues a task on the running worker's queue and wakes a sleeping worker to
+* take it.
+* @param pool
+* @param group Group the task counts towards.
+* @param function
+* @param context Passed to the task.
+* @param task Passed to the task.
+*/
+void threadPoolSubmit(ThreadPool* pool, ThreadPoolGroup* group, ThreadPoolTask function,
+     void* context, int task)
+{
+     assert(pool != 0);
+
+     ThreadPoolItem item = { function, context, task, group };
+     __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+     queuePush(&pool->queues[threadPoolWorker(pool)], item);
+     __atomic_add_fetch(&pool->queued, 1, __ATOMIC_RELEASE);
+
+     /* Taking the lock orders this with a worker deciding to sleep */
+     pthread_mutex_lock(&pool->lock);
+     if (pool->sleeping > 0) {
+          pthread_cond_signal(&pool->wake);
+     }
+     pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+* Returns when every task of the group has finished, running queued tasks of
+* any group in the meantime.
+* @param pool
+* @param group
+*/
+void threadPoolWait(ThreadPool* pool, ThreadPoolGroup* group)
+{
+     assert(pool != 0);
+
+     int worker = threadPoolWorker(pool);
+     while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE) > 0) {
+          ThreadPoolItem item;
+          if (findTask(pool, worker, &item)) {
+               runTask(&item, worker);
+          }
+          else {
+               /* The rest of the group is running on other workers */
+               sched_yield();
+          }
+     }
+}
+
+/**
+* Runs the tasks of a job in order of their numbers, for as long as any are
+* left.
+* @param context The ThreadPoolJob.
+* @param task Unused.
+* @param worker
+*/
+static void runJob(void* context, int task, int worker)
+{
+     ThreadPoolJob* job = context;
+     (void)task;
+     for (;;) {
+          int next = __atomic_fetch_add(&job->nextTask, 1, __ATOMIC_RELAXED);
+          if (next >= job->taskCount) {
+               return;
+          }
+          job->function(job->context, next, worker);
+     }
+}
+
+/**
+* Runs tasks 0 to taskCount - 1 of a job on the pool and returns when all of
+* them are done. Every worker that joins in takes the lowest task number
+* left, so tasks start roughly in order.
+* @param pool
+* @param function Called once for each task.
+* @param context Passed to every call.
+* @param taskCount
+*/
+void threadPoolRun(ThreadPool* pool, ThreadPoolTask function, void* context, int taskCount)
+{
+     assert(pool != 0);
+
+     ThreadPoolJob job = { function, context, taskCount, 0 };
+     if (pool->size == 1 || taskCount <= 1) {
+          runJob(&job, 0, threadPoolWorker(pool));
+          return;
+     }
+
+     /* One runner per worker that could help; the rest of the work is shared */
+     ThreadPoolGroup group = THREAD_POOL_GROUP_INIT;
+     int runners = taskCount < pool->size ? taskCount : pool->size;
+     for (int i = 1; i < runners; i++) {
+          threadPoolSubmit(pool, &group, runJob, &job, i);
+     }
+     runJob(&job, 0, threadPoolWorker(pool));
+     threadPoolWait(pool, &group);
+}
+
+/**
+* Returns the number of workers, including the thread that created the pool.
+* @param pool
+* @return Number of workers.
+*/
+int threadPoolSize(ThreadPool* pool)
+{
+     assert(pool != 0);
+     return pool->size;
+}
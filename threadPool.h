@@ -0,0 +1,86 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+/*
+* A fixed set of worker threads with one task queue each. A thread takes the
+* newest task from its own queue and, when that is empty, steals the oldest
+* task from another thread's queue, so tasks submitted by a busy thread are
+* picked up by idle ones. Tasks may submit more tasks and wait for them; a
+* thread that waits runs queued tasks until the ones it waits for are done.
+*
+* Worker 0 is the thread that created the pool. Only that thread and the
+* pool's own threads may submit tasks or wait.
+*/
+
+typedef struct ThreadPool ThreadPool;
+typedef struct ThreadPoolGroup ThreadPoolGroup;
+typedef struct ThreadPoolItem ThreadPoolItem;
+typedef struct WorkQueue WorkQueue;
+
+/*
+* Runs task number task of a job. worker identifies the thread running it,
+* from 0 to threadPoolSize - 1, so tasks can keep per-worker state without
+* locking as long as they do not wait.
+*/
+typedef void (*ThreadPoolTask)(void* context, int task, int worker);
+
+/*
+* A set of tasks that can be waited for together. Initialize it with
+* THREAD_POOL_GROUP_INIT.
+*/
+struct ThreadPoolGroup
+{
+     // Tasks submitted to the group and not finished yet.
+     int pending;
+};
+
+#define THREAD_POOL_GROUP_INIT { 0 }
+
+struct ThreadPoolItem
+{
+     ThreadPoolTask function;
+     void* context;
+     int task;
+     ThreadPoolGroup* group;
+};
+
+// Tasks a worker has submitted: a ring buffer that grows when full.
+struct WorkQueue
+{
+     pthread_mutex_t lock;
+     ThreadPoolItem* items;
+     int capacity;
+     // Oldest task, taken by thieves.
+     int head;
+     // Number of tasks in the queue.
+     int count;
+};
+
+struct ThreadPool
+{
+     pthread_t* threads;
+     // Number of workers, including the thread that created the pool.
+     int size;
+     WorkQueue* queues;
+     // Guards sleeping; idle workers wait on wake.
+     pthread_mutex_t lock;
+     pthread_cond_t wake;
+     // Tasks in all queues, changed atomically.
+     int queued;
+     int sleeping;
+     int stopping;
+};
+
+int threadPoolDefaultSize(void);
+ThreadPool* threadPoolNew(int size);
+void threadPoolDelete(ThreadPool* pool);
+void threadPoolSubmit(ThreadPool* pool, ThreadPoolGroup* group, ThreadPoolTask function,
+     void* context, int task);
+void threadPoolWait(ThreadPool* pool, ThreadPoolGroup* group);
+void threadPoolRun(ThreadPool* pool, ThreadPoolTask function, void* context, int taskCount);
+int threadPoolSize(ThreadPool* pool);
+int threadPoolWorker(ThreadPool* pool);
+
+#endif
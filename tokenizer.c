@@ -0,0 +1,539 @@
+/****************************************************************
+** Program Filename: tokenizer.c
+** Author: Chelsea Egan
+** Description: Splits text into words without copying them.
+** Words are yielded as slices of the text, or of a block buffer
+** a stream is read into; a word running past the end of a block
+** is moved to the front of the buffer and finished from the next
+** block. Bytes are classified into bit masks 64 at a time by the
+** widest kernel the processor supports, picked at runtime with a
+** scalar fallback, which can fold the text to lower case in the
+** same pass. Shared by the dictionary loader, the checker and the
+** server, so they all agree on what a word is.
+****************************************************************/
+
+#include "tokenizer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TOKENIZER_X86 1
+#include <immintrin.h>
+#endif
+
+/* Bytes classified by one step of a kernel: one bit of a mask each */
+#define CLASS_STEP 64
+
+/**
+* Returns 1 if the character can be part of a word: a letter, a digit or an
+* apostrophe.
+* @param c
+* @return 1 for a word character, 0 otherwise.
+*/
+int isWordChar(int c)
+{
+     return (c >= '0' && c <= '9') ||
+          (c >= 'A' && c <= 'Z') ||
+          (c >= 'a' && c <= 'z') ||
+          c == '\'';
+}
+
+/**
+* Classifies bytes one at a time.
+* @param data
+* @param steps Number of CLASS_STEP byte steps.
+* @param wordBits Filled with one mask of the word characters per step.
+* @param newlineBits Filled with one mask of the newlines per step.
+* @param folded Filled with the bytes in lower case, or NULL.
+*/
+static void classifyScalar(const unsigned char* data, size_t steps, unsigned long long* wordBits,
+     unsigned long long* newlineBits, char* folded)
+{
+     for (size_t step = 0; step < steps; step++) {
+          unsigned long long word = 0;
+          unsigned long long newline = 0;
+          for (int k = 0; k < CLASS_STEP; k++) {
+               unsigned char c = data[k];
+               word |= (unsigned long long)isWordChar(c) << k;
+               newline |= (unsigned long long)(c == '\n') << k;
+               if (folded != 0) {
+                    folded[k] = (char)(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+               }
+          }
+          wordBits[step] = word;
+          newlineBits[step] = newline;
+          data += CLASS_STEP;
+          if (folded != 0) {
+               folded += CLASS_STEP;
+          }
+     }
+}
+
+#ifdef TOKENIZER_X86
+
+/*
+* The vector kernels test a range of bytes with one signed comparison:
+* adding 0x80 minus the range's first byte moves the range to the bottom of
+* the signed bytes, below 0x80 plus the range's size. Setting the case bit
+* first folds the two ranges of letters into one.
+*/
+
+/**
+* Classifies bytes 16 at a time in SSE2 lanes.
+*/
+__attribute__((target("sse2")))
+static void classifySse2(const unsigned char* data, size_t steps, unsigned long long* wordBits,
+     unsigned long long* newlineBits, char* folded)
+{
+     const __m128i digitShift = _mm_set1_epi8((char)(0x80 - '0'));
+     const __m128i digitLimit = _mm_set1_epi8((char)(0x80 + 10));
+     const __m128i letterShift = _mm_set1_epi8((char)(0x80 - 'a'));
+     const __m128i upperShift = _mm_set1_epi8((char)(0x80 - 'A'));
+     const __m128i letterLimit = _mm_set1_epi8((char)(0x80 + 26));
+     const __m128i caseBit = _mm_set1_epi8(0x20);
+     const __m128i apostrophe = _mm_set1_epi8('\'');
+     const __m128i newline = _mm_set1_epi8('\n');
+
+     for (size_t step = 0; step < steps; step++) {
+          unsigned long long word = 0;
+          unsigned long long lines = 0;
+          for (int part = 0; part < CLASS_STEP / 16; part++) {
+               __m128i bytes = _mm_loadu_si128((const __m128i*)(data + part * 16));
+               __m128i digit = _mm_cmplt_epi8(_mm_add_epi8(bytes, digitShift), digitLimit);
+               __m128i letter = _mm_cmplt_epi8(
+                    _mm_add_epi8(_mm_or_si128(bytes, caseBit), letterShift), letterLimit);
+               __m128i isWord = _mm_or_si128(_mm_or_si128(digit, letter),
+                    _mm_cmpeq_epi8(bytes, apostrophe));
+               word |= (unsigned long long)(unsigned int)_mm_movemask_epi8(isWord) << (part * 16);
+               lines |= (unsigned long long)(unsigned int)_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(bytes, newline)) << (part * 16);
+               if (folded != 0) {
+                    __m128i upper = _mm_cmplt_epi8(_mm_add_epi8(bytes, upperShift), letterLimit);
+                    _mm_storeu_si128((__m128i*)(folded + part * 16),
+                         _mm_or_si128(bytes, _mm_and_si128(upper, caseBit)));
+               }
+          }
+          wordBits[step] = word;
+          newlineBits[step] = lines;
+          data += CLASS_STEP;
+          if (folded != 0) {
+               folded += CLASS_STEP;
+          }
+     }
+}
+
+/**
+* Classifies bytes 32 at a time in AVX2 lanes.
+*/
+__attribute__((target("avx2")))
+static void classifyAvx2(const unsigned char* data, size_t steps, unsigned long long* wordBits,
+     unsigned long long* newlineBits, char* folded)
+{
+     const __m256i digitShift = _mm256_set1_epi8((char)(0x80 - '0'));
+     const __m256i digitLimit = _mm256_set1_epi8((char)(0x80 + 10));
+     const __m256i letterShift = _mm256_set1_epi8((char)(0x80 - 'a'));
+     const __m256i upperShift = _mm256_set1_epi8((char)(0x80 - 'A'));
+     const __m256i letterLimit = _mm256_set1_epi8((char)(0x80 + 26));
+     const __m256i caseBit = _mm256_set1_epi8(0x20);
+     const __m256i apostrophe = _mm256_set1_epi8('\'');
+     const __m256i newline = _mm256_set1_epi8('\n');
+
+     for (size_t step = 0; step < steps; step++) {
+          unsigned long long word = 0;
+          unsigned long long lines = 0;
+          for (int part = 0; part < CLASS_STEP / 32; part++) {
+               __m256i bytes = _mm256_loadu_si256((const __m256i*)(data + part * 32));
+               __m256i digit = _mm256_cmpgt_epi8(digitLimit, _mm256_add_epi8(bytes, digitShift));
+               __m256i letter = _mm256_cmpgt_epi8(letterLimit,
+                    _mm256_add_epi8(_mm256_or_si256(bytes, caseBit), letterShift));
+               __m256i isWord = _mm256_or_si256(_mm256_or_si256(digit, letter),
+                    _mm256_cmpeq_epi8(bytes, apostrophe));
+               word |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(isWord) << (part * 32);
+               lines |= (unsigned long long)(unsigned int)_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(bytes, newline)) << (part * 32);
+               if (folded != 0) {
+                    __m256i upper = _mm256_cmpgt_epi8(letterLimit, _mm256_add_epi8(bytes, upperShift));
+                    _mm256_storeu_si256((__m256i*)(folded + part * 32),
+                         _mm256_or_si256(bytes, _mm256_and_si256(upper, caseBit)));
+               }
+          }
+          wordBits[step] = word;
+          newlineBits[step] = lines;
+          data += CLASS_STEP;
+          if (folded != 0) {
+               folded += CLASS_STEP;
+          }
+     }
+}
+
+#endif
+
+typedef void (*ClassKernel)(const unsigned char* data, size_t steps, unsigned long long* wordBits,
+     unsigned long long* newlineBits, char* folded);
+
+static ClassKernel classKernel = 0;
+static const char* classKernelName = 0;
+
+/**
+* Picks the widest kernel the processor supports.
+*/
+static void selectKernel(void)
+{
+#ifdef TOKENIZER_X86
+     __builtin_cpu_init();
+     if (__builtin_cpu_supports("avx2")) {
+          classKernelName = "avx2";
+          classKernel = classifyAvx2;
+          return;
+     }
+     if (__builtin_cpu_supports("sse2")) {
+          classKernelName = "sse2";
+          classKernel = classifySse2;
+          return;
+     }
+#endif
+     classKernelName = "scalar";
+     classKernel = classifyScalar;
+}
+
+/**
+* Returns the name of the kernel tokenizers classify bytes with on this
+* processor.
+* @return "avx2", "sse2" or "scalar".
+*/
+const char* tokenizerKernelName(void)
+{
+     if (classKernel == 0) {
+          selectKernel();
+     }
+     return classKernelName;
+}
+
+/**
+* Sets up a tokenizer over the given data with an empty window.
+* @param tokenizer
+* @param data
+* @param length
+* @param windowSize Bytes classified at a time.
+*/
+static void startTokenizer(Tokenizer* tokenizer, const char* data, size_t length,
+     size_t windowSize)
+{
+     tokenizer->in = 0;
+     tokenizer->buffer = 0;
+     tokenizer->data = data;
+     tokenizer->length = length;
+     tokenizer->position = 0;
+     tokenizer->offset = 0;
+     tokenizer->gapAt = 0;
+     tokenizer->gap = 0;
+     tokenizer->line = 1;
+     tokenizer->lineStart = 0;
+     tokenizer->wordBits = malloc(sizeof(unsigned long long) * (windowSize / CLASS_STEP + 1));
+     tokenizer->newlineBits = malloc(sizeof(unsigned long long) * (windowSize / CLASS_STEP + 1));
+     tokenizer->windowStart = 0;
+     tokenizer->windowEnd = 0;
+     tokenizer->windowSize = windowSize;
+     tokenizer->folded = 0;
+     tokenizer->maxWord = 0;
+     tokenizer->bytes = (long long)length;
+     tokenizer->done = 1;
+     tokenizer->error = 0;
+}
+
+/**
+* Starts a tokenizer over the given memory, which must outlive it. Words are
+* yielded whole, however long.
+* @param tokenizer
+* @param data
+* @param length
+*/
+void tokenizerInitMemory(Tokenizer* tokenizer, const char* data, size_t length)
+{
+     startTokenizer(tokenizer, data, length,
+          length < TOKENIZER_BLOCK_SIZE ? length : TOKENIZER_BLOCK_SIZE);
+}
+
+/**
+* Starts a tokenizer reading from the given stream.
+* @param tokenizer
+* @param in
+* @param maxWord Longest prefix of a word that is kept, at least 1.
+*/
+void tokenizerInitStream(Tokenizer* tokenizer, FILE* in, int maxWord)
+{
+     assert(in != 0);
+     assert(maxWord > 0);
+
+     /* A block always fits after the kept start of a word */
+     startTokenizer(tokenizer, 0, 0, TOKENIZER_BLOCK_SIZE + (size_t)maxWord);
+     tokenizer->in = in;
+     tokenizer->buffer = malloc(TOKENIZER_BLOCK_SIZE + (size_t)maxWord);
+     tokenizer->data = tokenizer->buffer;
+     tokenizer->maxWord = maxWord;
+     tokenizer->bytes = 0;
+     tokenizer->done = 0;
+}
+
+/**
+* Places the text somewhere other than the start of a document, for text cut
+* out of a longer one. Call before the first word is taken.
+* @param tokenizer
+* @param line Line of the first byte.
+* @param column Bytes before the first byte on its line.
+* @param dropped Bytes of the first word that were left out of the text
+* after its first run of word characters.
+*/
+void tokenizerSetStart(Tokenizer* tokenizer, long long line, long long column, long long dropped)
+{
+     tokenizer->line = line;
+     tokenizer->lineStart = -column;
+     tokenizer->gap = dropped;
+     tokenizer->gapAt = 0;
+     if (dropped > 0) {
+          while (tokenizer->gapAt < tokenizer->length &&
+               isWordChar((unsigned char)tokenizer->data[tokenizer->gapAt])) {
+               tokenizer->gapAt++;
+          }
+     }
+}
+
+/**
+* Turns folding on or off: while it is on, every token also gives the word
+* in ASCII lower case. Call before the first word is taken.
+* @param tokenizer
+* @param enabled
+*/
+void tokenizerSetFold(Tokenizer* tokenizer, int enabled)
+{
+     if (enabled && tokenizer->folded == 0) {
+          tokenizer->folded = malloc(tokenizer->windowSize + CLASS_STEP);
+     }
+     else if (!enabled) {
+          free(tokenizer->folded);
+          tokenizer->folded = 0;
+     }
+}
+
+/**
+* Frees the tokenizer's buffers. The stream is left open.
+* @param tokenizer
+*/
+void tokenizerCleanUp(Tokenizer* tokenizer)
+{
+     free(tokenizer->buffer);
+     free(tokenizer->wordBits);
+     free(tokenizer->newlineBits);
+     free(tokenizer->folded);
+     tokenizer->buffer = 0;
+     tokenizer->wordBits = 0;
+     tokenizer->newlineBits = 0;
+     tokenizer->folded = 0;
+     tokenizer->data = 0;
+     tokenizer->length = 0;
+}
+
+/**
+* Returns the offset in the text of a byte of the data.
+* @param tokenizer
+* @param index
+* @return Offset.
+*/
+static long long textOffset(const Tokenizer* tokenizer, size_t index)
+{
+     return tokenizer->offset + (long long)index + (index >= tokenizer->gapAt ? tokenizer->gap : 0);
+}
+
+/**
+* Classifies the data from start on, as much of it as fits the window.
+* @param tokenizer
+* @param start
+*/
+static void classifyWindow(Tokenizer* tokenizer, size_t start)
+{
+     if (classKernel == 0) {
+          selectKernel();
+     }
+
+     size_t length = tokenizer->length - start;
+     if (length > tokenizer->windowSize) {
+          length = tokenizer->windowSize;
+     }
+     const unsigned char* data = (const unsigned char*)tokenizer->data + start;
+     size_t steps = length / CLASS_STEP;
+     classKernel(data, steps, tokenizer->wordBits, tokenizer->newlineBits, tokenizer->folded);
+
+     /* The last step is padded with separators */
+     size_t rest = length - steps * CLASS_STEP;
+     if (rest > 0) {
+          unsigned char tail[CLASS_STEP];
+          memset(tail, 0, sizeof(tail));
+          memcpy(tail, data + steps * CLASS_STEP, rest);
+          classKernel(tail, 1, tokenizer->wordBits + steps, tokenizer->newlineBits + steps,
+               tokenizer->folded != 0 ? tokenizer->folded + steps * CLASS_STEP : 0);
+     }
+
+     tokenizer->windowStart = start;
+     tokenizer->windowEnd = start + length;
+}
+
+/**
+* Returns the first byte of the window from index on that is, or is not, a
+* word character.
+* @param tokenizer
+* @param index At least windowStart.
+* @param word 1 to find a word character, 0 to find a separator.
+* @return Index of the byte, or windowEnd if there is none.
+*/
+static size_t findInWindow(const Tokenizer* tokenizer, size_t index, int word)
+{
+     size_t k = index - tokenizer->windowStart;
+     size_t end = tokenizer->windowEnd - tokenizer->windowStart;
+     while (k < end) {
+          unsigned long long mask = tokenizer->wordBits[k / CLASS_STEP];
+          if (!word) {
+               mask = ~mask;
+          }
+          mask >>= k % CLASS_STEP;
+          if (mask != 0) {
+               k += (size_t)__builtin_ctzll(mask);
+               return tokenizer->windowStart + (k < end ? k : end);
+          }
+          k = (k / CLASS_STEP + 1) * CLASS_STEP;
+     }
+     return tokenizer->windowEnd;
+}
+
+/**
+* Counts the newlines among bytes of the window and moves the current line
+* past them.
+* @param tokenizer
+* @param from Index of the first byte.
+* @param to Index after the last byte.
+*/
+static void countLines(Tokenizer* tokenizer, size_t from, size_t to)
+{
+     size_t k = from - tokenizer->windowStart;
+     size_t end = to - tokenizer->windowStart;
+     while (k < end) {
+          size_t step = k / CLASS_STEP;
+          size_t next = (step + 1) * CLASS_STEP;
+          unsigned long long mask = tokenizer->newlineBits[step] >> (k % CLASS_STEP) << (k % CLASS_STEP);
+          if (end < next) {
+               mask &= (1ULL << (end % CLASS_STEP)) - 1;
+          }
+          if (mask != 0) {
+               size_t last = step * CLASS_STEP + CLASS_STEP - 1 - (size_t)__builtin_clzll(mask);
+               tokenizer->line += __builtin_popcountll(mask);
+               tokenizer->lineStart = textOffset(tokenizer, tokenizer->windowStart + last) + 1;
+          }
+          k = next;
+     }
+}
+
+/**
+* Reads the next block of the stream and classifies the buffer. The bytes
+* from keep on, the start of a word, are first moved to the front of the
+* buffer: up to maxWord of them, the rest becoming the gap.
+* @param tokenizer
+* @param keep Index of the first byte to keep, or the data's length.
+*/
+static void readBlock(Tokenizer* tokenizer, size_t keep)
+{
+     long long start = textOffset(tokenizer, keep);
+     long long span = textOffset(tokenizer, tokenizer->length) - start;
+     size_t kept = tokenizer->length - keep;
+     if (kept > (size_t)tokenizer->maxWord) {
+          kept = (size_t)tokenizer->maxWord;
+     }
+     memmove(tokenizer->buffer, tokenizer->buffer + keep, kept);
+
+     size_t count = fread(tokenizer->buffer + kept, 1, TOKENIZER_BLOCK_SIZE, tokenizer->in);
+     tokenizer->offset = start;
+     tokenizer->gapAt = kept;
+     tokenizer->gap = span - (long long)kept;
+     tokenizer->length = kept + count;
+     tokenizer->bytes += (long long)count;
+     if (count == 0) {
+          tokenizer->done = 1;
+          tokenizer->error = ferror(tokenizer->in) ? 1 : 0;
+     }
+     classifyWindow(tokenizer, 0);
+}
+
+/**
+* Takes the next word of the text.
+* @param tokenizer
+* @param token Set to the word.
+* @return 1 if a word was taken, 0 at the end of the text or of a stream
+* that failed, which sets the error flag.
+*/
+int tokenizerNext(Tokenizer* tokenizer, Token* token)
+{
+     size_t i = tokenizer->position;
+
+     /* Skip separators, counting lines */
+     for (;;) {
+          if (i >= tokenizer->windowEnd) {
+               if (i < tokenizer->length) {
+                    classifyWindow(tokenizer, i);
+               }
+               else if (tokenizer->done) {
+                    tokenizer->position = i;
+                    return 0;
+               }
+               else {
+                    readBlock(tokenizer, tokenizer->length);
+                    i = 0;
+                    continue;
+               }
+          }
+          size_t next = findInWindow(tokenizer, i, 1);
+          countLines(tokenizer, i, next);
+          i = next;
+          if (i < tokenizer->windowEnd) {
+               break;
+          }
+     }
+
+     /* Find the end of the word, which may be in a later window or block */
+     size_t start = i;
+     for (;;) {
+          i = findInWindow(tokenizer, i, 0);
+          if (i < tokenizer->windowEnd) {
+               break;
+          }
+          if (i < tokenizer->length) {
+               if (start == tokenizer->windowStart) {
+                    /* A word longer than the window is finished a byte at a time */
+                    while (i < tokenizer->length && isWordChar((unsigned char)tokenizer->data[i])) {
+                         i++;
+                    }
+                    break;
+               }
+               classifyWindow(tokenizer, start);
+               continue;
+          }
+          if (tokenizer->done) {
+               break;
+          }
+          readBlock(tokenizer, start);
+          start = 0;
+          i = tokenizer->gapAt;
+     }
+
+     size_t run = i - start;
+     if (tokenizer->in != 0 && run > (size_t)tokenizer->maxWord) {
+          run = (size_t)tokenizer->maxWord;
+     }
+     token->word = tokenizer->data + start;
+     token->length = (int)run;
+     token->fullLength = textOffset(tokenizer, i) - textOffset(tokenizer, start);
+     token->folded = tokenizer->folded != 0 && i <= tokenizer->windowEnd ?
+          tokenizer->folded + (start - tokenizer->windowStart) : 0;
+     token->line = tokenizer->line;
+     token->column = textOffset(tokenizer, start) - tokenizer->lineStart + 1;
+     tokenizer->position = i;
+     return 1;
+}
@@ -0,0 +1,98 @@
+#ifndef TOKENIZER_H
+#define TOKENIZER_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+* Splits text into words: runs of word characters (see isWordChar) separated
+* by anything else. A tokenizer yields each word as a slice of the text,
+* never a copy, together with the line and column it starts at.
+*
+* A tokenizer over memory yields slices of that memory. A tokenizer over a
+* stream reads it a block at a time into one buffer that is reused for the
+* whole stream; a word cut in two by the end of a block is moved to the
+* front of the buffer before the next block is read, so it is still yielded
+* as one slice. Only the first maxWord bytes of a longer word are kept.
+*
+* Bytes are classified a window at a time, 64 per step, by the widest vector
+* kernel the processor supports: each step gives a bit mask of the word
+* characters and one of the newlines, and words and lines are then found a
+* mask at a time. With folding on, the same pass writes the window out in
+* ASCII lower case, so a word can be looked up without case at no extra
+* cost.
+*/
+
+// Bytes read from a stream at a time, and classified at a time.
+#define TOKENIZER_BLOCK_SIZE (64 * 1024)
+
+typedef struct Token Token;
+typedef struct Tokenizer Tokenizer;
+
+struct Token
+{
+     // First byte of the word, valid until the next call to tokenizerNext.
+     // Not null terminated.
+     const char* word;
+     // Bytes at word: the whole word, or its first maxWord bytes when a
+     // stream's word is longer.
+     int length;
+     // Length of the word in the text.
+     long long fullLength;
+     // The length bytes at word in ASCII lower case, or NULL if folding is
+     // off or the word is too long to fit the tokenizer's window.
+     const char* folded;
+     // Position of the word's first byte, counting from 1. Columns are in
+     // bytes.
+     long long line;
+     long long column;
+};
+
+struct Tokenizer
+{
+     // Stream read from, or NULL for a tokenizer over memory.
+     FILE* in;
+     // Block buffer of a stream, owned by the tokenizer.
+     char* buffer;
+     // Text being split, and the next byte to look at.
+     const char* data;
+     size_t length;
+     size_t position;
+     // Offset in the text of data[0]. Bytes from data[gapAt] on are a further
+     // gap bytes in: the part of a long word that was not kept.
+     long long offset;
+     size_t gapAt;
+     long long gap;
+     // Current line, and the offset in the text at which it starts.
+     long long line;
+     long long lineStart;
+     // Window of classified bytes, data[windowStart] to data[windowEnd - 1]:
+     // bit k of wordBits and newlineBits is set if the byte windowStart + k
+     // is a word character or a newline. Holds up to windowSize bytes.
+     unsigned long long* wordBits;
+     unsigned long long* newlineBits;
+     size_t windowStart;
+     size_t windowEnd;
+     size_t windowSize;
+     // The window in lower case, or NULL while folding is off.
+     char* folded;
+     // Longest prefix of a word kept when it spans blocks.
+     int maxWord;
+     // Bytes read from the stream so far.
+     long long bytes;
+     // 1 once the stream is at its end or failed.
+     int done;
+     int error;
+};
+
+int isWordChar(int c);
+
+void tokenizerInitMemory(Tokenizer* tokenizer, const char* data, size_t length);
+void tokenizerInitStream(Tokenizer* tokenizer, FILE* in, int maxWord);
+void tokenizerSetStart(Tokenizer* tokenizer, long long line, long long column, long long dropped);
+void tokenizerSetFold(Tokenizer* tokenizer, int enabled);
+void tokenizerCleanUp(Tokenizer* tokenizer);
+int tokenizerNext(Tokenizer* tokenizer, Token* token);
+const char* tokenizerKernelName(void);
+
+#endif